@@ -7,7 +7,9 @@
 # No part of the project may be copied and/or distributed without the express
 # permission of the 15-441/641 course staff.
 
-from scapy.all import rdpcap, Raw, IP
+import csv
+import sys
+
 import matplotlib.pyplot as plt
 
 # Change this to be your pcap file
@@ -15,6 +17,37 @@ import matplotlib.pyplot as plt
 # https://support.rackspace.com/how-to/capturing-packets-with-tcpdump/
 FILE_TO_READ = "capture.pcap"
 
+
+def plot_trace(csv_file):
+    """Plots bytes in flight and cwnd from a CSV made by utils/trace_export.
+
+    The stack records these itself, so no packet capture is needed and it
+    works whichever side is sending. A CSV made by utils/pcap_analyze from a
+    capture has no cwnd; bytes in flight are plotted for each flow instead.
+    """
+    times, in_flight, cwnd = {}, {}, []
+    with open(csv_file) as f:
+        for row in csv.DictReader(f):
+            flow = row.get("flow", "bytes in flight")
+            times.setdefault(flow, []).append(int(row["time_us"]) / 1e6)
+            in_flight.setdefault(flow, []).append(int(row["in_flight"]))
+            if "cwnd" in row:
+                cwnd.append(int(row["cwnd"]))
+    for flow in times:
+        plt.plot(times[flow], in_flight[flow], label=flow)
+    if cwnd:
+        plt.plot(times["bytes in flight"], cwnd, label="cwnd")
+    plt.xlabel("time (s)")
+    plt.ylabel("bytes")
+    plt.legend()
+    plt.savefig("graph.pdf")
+
+if len(sys.argv) > 1 and sys.argv[1].endswith(".csv"):
+    plot_trace(sys.argv[1])
+    sys.exit(0)
+
+from scapy.all import rdpcap, Raw, IP  # noqa: E402
+
 packets = rdpcap(FILE_TO_READ)
 packet_list = []
 times = []
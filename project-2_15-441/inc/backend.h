@@ -16,6 +16,8 @@
 #ifndef PROJECT_2_15_441_INC_BACKEND_H_
 #define PROJECT_2_15_441_INC_BACKEND_H_
 
+#include "cmu_tcp.h"
+
 /**
  * Launches the CMU-TCP backend.
  *
@@ -23,4 +25,113 @@
  */
 void* begin_backend(void* in);
 
+/**
+ * Takes a segment from the socket's pool, allocating a new one if the pool is
+ * empty. Must be called with `recv_lock` held.
+ *
+ * @param sock The socket owning the pool.
+ *
+ * @return An empty segment with room for MSS bytes, or NULL on failure.
+ */
+cmu_segment_t* segment_get(cmu_socket_t* sock);
+
+/**
+ * Returns a segment to the socket's pool. Must be called with `recv_lock`
+ * held.
+ *
+ * @param sock The socket owning the pool.
+ * @param seg The segment to return.
+ */
+void segment_put(cmu_socket_t* sock, cmu_segment_t* seg);
+
+/**
+ * One packet's worth of a send batch.
+ */
+typedef struct {
+  uint16_t len;     // payload length
+  uint16_t stream;  // the stream the payload belongs to
+} send_chunk_t;
+
+/**
+ * Allocates the send and receive windows of a socket, and fills the receive
+ * window's slots from the segment pool. Does nothing if they already are.
+ * Listeners call it once a client commits to a connection, so that SYNs
+ * answered with cookies cost no memory. Must be called with `recv_lock`
+ * held, which guards the segment pool.
+ *
+ * @param sock The socket.
+ */
+void alloc_windows(cmu_socket_t* sock);
+
+/**
+ * Frees what `alloc_windows` allocated, and the socket's FEC state.
+ *
+ * @param sock The socket.
+ */
+void free_windows(cmu_socket_t* sock);
+
+/**
+ * Finds how far the receive window holds the data in order, from
+ * `next_seq_expected` on.
+ *
+ * @param sock The socket.
+ *
+ * @return The sequence number after the last byte held in order.
+ */
+uint32_t get_next_expected_seq(cmu_socket_t* sock);
+
+/**
+ * Copies a segment into the receive window. Must be called with `recv_lock`
+ * held.
+ *
+ * @param sock The socket the segment arrived on.
+ * @param seq Its sequence number.
+ * @param payload Its payload.
+ * @param payload_len The length of the payload.
+ * @param stream The stream it belongs to.
+ *
+ * @return 1 if it was stored, 0 if it falls outside the window, arrived
+ *         already or there is no room for it.
+ */
+int store_segment(cmu_socket_t* sock, uint32_t seq, const uint8_t* payload,
+                  uint16_t payload_len, uint16_t stream);
+
+/**
+ * Moves every segment in the receive window that is now in order onto the
+ * receive queue of its stream as is, and refills its slot from the pool. Must
+ * be called with `recv_lock` held.
+ *
+ * @param sock The socket.
+ *
+ * @return The next sequence number expected, which the caller acknowledges
+ *         and stores in `next_seq_expected`.
+ */
+uint32_t deliver_window(cmu_socket_t* sock);
+
+/**
+ * Takes what the application has written, interleaving the streams one
+ * packet at a time so that a stream with a lot queued does not hold back the
+ * others. The stream served first rotates from one batch to the next.
+ *
+ * Short packets at the end of a stream's data are left behind while the
+ * socket is corked, and under Nagle's algorithm while full packets of the
+ * same stream go out with this batch, so that later writes can fill them up.
+ * Nothing is in flight between batches, so the next batch takes them if
+ * nothing more comes.
+ *
+ * On a compressed connection each stream's bytes are compressed into frames
+ * first, and the frames are what is cut into packets.
+ *
+ * @param sock The socket to take the data of.
+ * @param flush Take everything, as the socket is shutting down.
+ * @param data Set to the data, in sending order. Must be freed by the caller.
+ * @param chunks Set to the packets to cut the data into. Must be freed by the
+ *               caller.
+ * @param nchunks Set to the number of packets.
+ *
+ * @return The number of bytes taken from the application.
+ */
+int take_send_batch(cmu_socket_t* sock, int flush, uint8_t** data,
+                    send_chunk_t** chunks, int* nchunks);
+
 #endif  // PROJECT_2_15_441_INC_BACKEND_H_
@@ -0,0 +1,35 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the clock used for all CMU-TCP timekeeping. It is
+ * monotonic, so timers are not affected by changes to the wall clock.
+ */
+
+#ifndef PROJECT_2_15_441_INC_CLOCK_H_
+#define PROJECT_2_15_441_INC_CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#define USEC_PER_MSEC UINT64_C(1000)
+#define USEC_PER_SEC UINT64_C(1000000)
+
+/**
+ * Gets the current time.
+ *
+ * @return Microseconds elapsed on CLOCK_MONOTONIC.
+ */
+static inline uint64_t get_curr_micros(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * USEC_PER_SEC + (uint64_t)ts.tv_nsec / 1000;
+}
+
+#endif  // PROJECT_2_15_441_INC_CLOCK_H_
@@ -0,0 +1,346 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the options carried in the CMU-TCP header extension.
+ *
+ * The extension data is a sequence of options, each made of a one byte kind,
+ * a one byte length covering the whole option, and the option value. Multi
+ * byte values are in network byte order. Unknown options are skipped.
+ */
+
+#ifndef PROJECT_2_15_441_INC_CMU_OPTIONS_H_
+#define PROJECT_2_15_441_INC_CMU_OPTIONS_H_
+
+#include <stdint.h>
+
+#include "fec.h"
+
+#define OPT_HDR_LEN 2
+
+// Timestamp option: TSval, the sender's clock when the packet was sent, and
+// TSecr, the most recent TSval received from the peer.
+#define OPT_TIMESTAMP 1
+#define OPT_TIMESTAMP_LEN (OPT_HDR_LEN + 8)
+
+// Fast open option, carried on SYNs and SYN-ACKs. Empty on a SYN, it asks the
+// listener for a cookie; otherwise it holds a cookie.
+#define OPT_FASTOPEN 2
+#define OPT_FASTOPEN_COOKIE_LEN 8
+
+// Stream option, carried on data segments of every stream but stream 0: the
+// stream the payload belongs to.
+#define OPT_STREAM 3
+#define OPT_STREAM_LEN (OPT_HDR_LEN + 2)
+
+// Path MTU option. On a padding-only probe it holds the probe's length; on
+// the ACK answering the probe it echoes that length.
+#define OPT_PMTU 4
+#define OPT_PMTU_LEN (OPT_HDR_LEN + 2)
+
+// CRC32C option: the CRC32C of the whole packet, header and payload, taken
+// with the option value set to zero. Sent on every packet once both sides
+// have shown they do, starting with the handshake.
+#define OPT_CRC32C 5
+#define OPT_CRC32C_LEN (OPT_HDR_LEN + 4)
+
+// Compression option, empty. Carried on the SYN and SYN-ACK by ends that
+// compress, and on the packets that can complete a SYN cookie handshake.
+#define OPT_COMPRESS 6
+#define OPT_COMPRESS_LEN OPT_HDR_LEN
+
+// Forward error correction options, see fec.h. OPT_FEC is empty and offers
+// it, on the same packets as the compression option. OPT_FEC_GROUP marks a
+// data packet with its group: the sequence number of the group's first
+// packet. OPT_FEC_REPAIR makes a packet a repair: the group, the number of
+// packets in it and the XOR of their sequence numbers, lengths and streams.
+// The payload is the XOR of theirs.
+#define OPT_FEC 7
+#define OPT_FEC_LEN OPT_HDR_LEN
+#define OPT_FEC_GROUP 8
+#define OPT_FEC_GROUP_LEN (OPT_HDR_LEN + 4)
+#define OPT_FEC_REPAIR 9
+#define OPT_FEC_REPAIR_LEN (OPT_HDR_LEN + 13)
+
+// Joins the path a packet came on to a connection, see multipath.h: the
+// initiator's initial sequence number, then the listener's. The listener
+// answers with the same option on the new path.
+#define OPT_MP_JOIN 10
+#define OPT_MP_JOIN_LEN (OPT_HDR_LEN + 8)
+
+// ECN options, see ecn.h. OPT_ECN is empty and offers it, on the same packets
+// as the compression option. OPT_ECN_ECHO goes on every ACK once both ends
+// offered it: the payload bytes received marked CE so far.
+#define OPT_ECN 11
+#define OPT_ECN_LEN OPT_HDR_LEN
+#define OPT_ECN_ECHO 12
+#define OPT_ECN_ECHO_LEN (OPT_HDR_LEN + 4)
+
+// The largest extension we ever put on a packet.
+#define OPT_MAX_LEN 64
+
+/**
+ * Appends a timestamp option.
+ *
+ * @param ext The extension data to append to.
+ * @param tsval The sender's timestamp.
+ * @param tsecr The timestamp being echoed.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_timestamp(uint8_t* ext, uint32_t tsval, uint32_t tsecr);
+
+/**
+ * Reads the timestamp option from the extension data, if there is one.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param tsval Set to the peer's timestamp.
+ * @param tsecr Set to the echoed timestamp.
+ *
+ * @return 1 if the option was found, 0 otherwise.
+ */
+int opt_get_timestamp(const uint8_t* ext, uint16_t ext_len, uint32_t* tsval,
+                      uint32_t* tsecr);
+
+/**
+ * Appends a fast open option.
+ *
+ * @param ext The extension data to append to.
+ * @param cookie The cookie, OPT_FASTOPEN_COOKIE_LEN bytes, or NULL to ask for
+ *               one.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_fastopen(uint8_t* ext, const uint8_t* cookie);
+
+/**
+ * Reads the fast open option from the extension data, if there is one.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param cookie Set to the cookie, if the option carries one.
+ *
+ * @return 1 if the option carries a cookie, 0 if it is a cookie request, -1
+ *         if there is no valid fast open option.
+ */
+int opt_get_fastopen(const uint8_t* ext, uint16_t ext_len, uint8_t* cookie);
+
+/**
+ * Appends a stream option.
+ *
+ * @param ext The extension data to append to.
+ * @param stream The stream ID.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_stream(uint8_t* ext, uint16_t stream);
+
+/**
+ * Reads the stream option from the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ *
+ * @return The stream ID, or 0 if there is no stream option.
+ */
+uint16_t opt_get_stream(const uint8_t* ext, uint16_t ext_len);
+
+/**
+ * Appends a path MTU option.
+ *
+ * @param ext The extension data to append to.
+ * @param size The probed packet length.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_pmtu(uint8_t* ext, uint16_t size);
+
+/**
+ * Reads the path MTU option from the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ *
+ * @return The probed packet length, or 0 if there is no path MTU option.
+ */
+uint16_t opt_get_pmtu(const uint8_t* ext, uint16_t ext_len);
+
+/**
+ * Appends a CRC32C option.
+ *
+ * @param ext The extension data to append to.
+ * @param crc The checksum, 0 until the rest of the packet is filled in.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_crc32c(uint8_t* ext, uint32_t crc);
+
+/**
+ * Appends a compression option.
+ *
+ * @param ext The extension data to append to.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_compress(uint8_t* ext);
+
+/**
+ * Tells if the extension data holds a compression option.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ *
+ * @return 1 if it does, 0 otherwise.
+ */
+int opt_get_compress(const uint8_t* ext, uint16_t ext_len);
+
+/**
+ * Appends a forward error correction offer.
+ *
+ * @param ext The extension data to append to.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_fec(uint8_t* ext);
+
+/**
+ * Tells if the extension data holds a forward error correction offer.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ *
+ * @return 1 if it does, 0 otherwise.
+ */
+int opt_get_fec(const uint8_t* ext, uint16_t ext_len);
+
+/**
+ * Appends an FEC group option.
+ *
+ * @param ext The extension data to append to.
+ * @param group The group of the packet.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_fec_group(uint8_t* ext, uint32_t group);
+
+/**
+ * Reads the FEC group option from the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param group Set to the group of the packet.
+ *
+ * @return 1 if there is an FEC group option, 0 otherwise.
+ */
+int opt_get_fec_group(const uint8_t* ext, uint16_t ext_len, uint32_t* group);
+
+/**
+ * Appends an FEC repair option.
+ *
+ * @param ext The extension data to append to.
+ * @param repair The repair.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_fec_repair(uint8_t* ext, const fec_repair_t* repair);
+
+/**
+ * Reads the FEC repair option from the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param repair Set to the repair.
+ *
+ * @return 1 if there is an FEC repair option, 0 otherwise.
+ */
+int opt_get_fec_repair(const uint8_t* ext, uint16_t ext_len,
+                       fec_repair_t* repair);
+
+/**
+ * Appends a multipath JOIN option.
+ *
+ * @param ext The extension data to append to.
+ * @param initiator_iss The initiator's initial sequence number.
+ * @param listener_iss The listener's initial sequence number.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_mp_join(uint8_t* ext, uint32_t initiator_iss,
+                         uint32_t listener_iss);
+
+/**
+ * Reads the multipath JOIN option from the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param initiator_iss Set to the initiator's initial sequence number.
+ * @param listener_iss Set to the listener's initial sequence number.
+ *
+ * @return 1 if there is a JOIN option, 0 otherwise.
+ */
+int opt_get_mp_join(const uint8_t* ext, uint16_t ext_len,
+                    uint32_t* initiator_iss, uint32_t* listener_iss);
+
+/**
+ * Appends an ECN offer.
+ *
+ * @param ext The extension data to append to.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_ecn(uint8_t* ext);
+
+/**
+ * Tells if the extension data holds an ECN offer.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ *
+ * @return 1 if it does, 0 otherwise.
+ */
+int opt_get_ecn(const uint8_t* ext, uint16_t ext_len);
+
+/**
+ * Appends an ECN echo option.
+ *
+ * @param ext The extension data to append to.
+ * @param ce_bytes The payload bytes received marked CE so far.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t opt_put_ecn_echo(uint8_t* ext, uint32_t ce_bytes);
+
+/**
+ * Reads the ECN echo option from the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param ce_bytes Set to the echoed count.
+ *
+ * @return 1 if there is an ECN echo option, 0 otherwise.
+ */
+int opt_get_ecn_echo(const uint8_t* ext, uint16_t ext_len,
+                     uint32_t* ce_bytes);
+
+/**
+ * Finds an option in the extension data.
+ *
+ * @param ext The extension data.
+ * @param ext_len The length of the extension data.
+ * @param kind The option to look for.
+ * @param len Set to the length of the option value.
+ *
+ * @return A pointer to the option value, or NULL if it is not present or the
+ *         extension is malformed.
+ */
+const uint8_t* opt_find(const uint8_t* ext, uint16_t ext_len, uint8_t kind,
+                        uint8_t* len);
+
+#endif  // PROJECT_2_15_441_INC_CMU_OPTIONS_H_
@@ -19,32 +19,88 @@
 #include <stdint.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "cmu_packet.h"
+#include "compress.h"
+#include "ecn.h"
+#include "fec.h"
 #include "grading.h"
+#include "link.h"
+#include "metrics.h"
+#include "multipath.h"
+#include "pmtu.h"
+#include "rtt.h"
+#include "stats.h"
+#include "trace.h"
 
 #define EXIT_SUCCESS 0
 #define EXIT_ERROR -1
 #define EXIT_FAILURE 1
 
+/**
+ * A buffer holding the payload of one received segment. Segments are filled
+ * by the receive window and, once in order, moved onto the socket's receive
+ * queue without copying. They can be lent to the application directly with
+ * `cmu_read_borrow`.
+ */
+typedef struct cmu_segment {
+  struct cmu_segment* next;  // the next segment in the queue or pool
+  uint32_t len;              // the number of payload bytes in data
+  uint32_t off;              // the number of bytes already read by the app
+  uint32_t size;             // bytes of storage in data, at least MSS
+  uint8_t data[];            // the payload
+} cmu_segment_t;
+
 typedef struct {
   /* data */
-  uint32_t payload_len;  // the length of payload in received window
-  uint32_t seq;          // the seq of payload in received window
-  uint8_t* payload;      // the payload of payload in received window
+  uint32_t payload_len;    // the length of payload in received window, 0 for
+                           // a free slot
+  uint32_t seq;            // the seq of payload in received window
+  cmu_segment_t* segment;  // the payload of payload in received window
+  uint16_t stream;         // the stream the payload belongs to
 } receiving_window;
 
 typedef struct {
   /* data */
-  uint64_t send_time;    // the sent time of payload in sending window
-  uint8_t* payload;      // the payload of payload in sending window
-  uint16_t payload_len;  // the length of payload in sending window
-  uint32_t seq;          // the seq of payload in sending window
+  uint64_t send_time;     // the last sent time of payload, in microseconds
+  uint8_t* payload;       // the payload of payload in sending window
+  uint16_t payload_len;   // the length of payload in sending window
+  uint32_t seq;           // the seq of payload in sending window
+  uint8_t retransmitted;  // set once resent, so it is not used for RTT
+  uint16_t stream;        // the stream the payload belongs to
+  uint8_t path;           // the path it was last sent on, see multipath.h
 } sending_window;
 
+// Number of streams a connection carries, see `cmu_stream_write`.
+#define CMU_MAX_STREAMS 16
+
+// Longest a corked socket holds back a short packet, see `cmu_set_cork`.
+#define CMU_CORK_MAX_US 200000
+
+// Largest message `cmu_send_msg` accepts.
+#define CMU_MAX_MSG_LEN (1 << 24)
+
+/**
+ * One stream of a connection. Streams share the connection's sequence space,
+ * window and congestion control; each has its own send buffer and receive
+ * queue. Guarded by `send_lock` and `recv_lock` respectively.
+ */
+typedef struct {
+  uint8_t* sending_buf;  // bytes written by the app
+  int sending_len;       // the number of bytes in sending_buf
+  cmu_segment_t* received_head;  // in-order segments not yet read by the app
+  cmu_segment_t* received_tail;
+  int received_len;              // unread bytes across the receive queue
+  compressor_t compressor;       // guarded by send_lock
+  decompressor_t decompressor;   // guarded by recv_lock
+} cmu_stream_t;
+
 typedef struct {
   uint32_t next_seq_expected;
   uint32_t last_ack_received;
+  uint32_t cwnd;      // congestion window, in bytes
+  uint32_t ssthresh;  // slow start threshold, in bytes
   receiving_window* received_windows;
   sending_window* sending_windows;
   pthread_mutex_t ack_lock;
@@ -64,8 +120,75 @@ typedef enum {
   ESTABLISHED = 2,
   CLOSED = 3,
   SYN_SENT = 4,
+  FIN_WAIT_1 = 5,  // we sent a FIN, it is not acknowledged yet
+  FIN_WAIT_2 = 6,  // our FIN was acknowledged, waiting for the peer's
+  CLOSING = 7,     // both sides sent a FIN, ours is not acknowledged yet
+  TIME_WAIT = 8,   // both FINs acknowledged, waiting in case our ACK was lost
+  CLOSE_WAIT = 9,  // the peer sent a FIN, we have not yet
+  LAST_ACK = 10,   // the peer sent a FIN, then we did, ours not acknowledged
 } server_state_t;
 
+/**
+ * State of the three-way handshake.
+ */
+typedef struct {
+  uint32_t iss;           // our initial sequence number
+  uint16_t syn_data_len;  // bytes of the first write carried on our SYN
+  uint8_t send_cookie;    // the peer wants a fast open cookie
+  uint8_t resend;         // the peer retransmitted its SYN, answer right away
+  uint8_t peer_compress;  // the peer's SYN offered compression
+  uint8_t peer_fec;       // the peer's SYN offered forward error correction
+  uint8_t peer_ecn;       // the peer's SYN offered ECN
+  uint32_t peer_iss;      // the peer's initial sequence number
+} handshake_t;
+
+/**
+ * Whether packets carry the CRC32C option, see crc32c.h.
+ */
+typedef enum {
+  CRC32C_OFF = 0,      // neither sent nor required
+  CRC32C_OFFERED = 1,  // sent, until the peer shows whether it does the same
+  CRC32C_ON = 2,       // sent, and required on everything but a bare SYN
+} cmu_crc32c_state_t;
+
+/**
+ * Whether stream bytes go out compressed, see compress.h.
+ */
+typedef enum {
+  COMPRESS_OFF = 0,      // not offered, or the peer did not offer it
+  COMPRESS_OFFERED = 1,  // offered on our SYN or SYN-ACK, no answer yet
+  COMPRESS_ON = 2,       // both ends offered it
+} cmu_compress_state_t;
+
+/**
+ * Whether data packets are followed by FEC repair packets, see fec.h.
+ */
+typedef enum {
+  FEC_OFF = 0,      // not offered, or the peer did not offer it
+  FEC_OFFERED = 1,  // offered on our SYN or SYN-ACK, no answer yet
+  FEC_ON = 2,       // both ends offered it
+} cmu_fec_state_t;
+
+/**
+ * Whether datagrams go out ECN-capable and ACKs echo marks, see ecn.h.
+ */
+typedef enum {
+  ECN_OFF = 0,      // not offered, or the peer did not offer it
+  ECN_OFFERED = 1,  // offered on our SYN or SYN-ACK, no answer yet
+  ECN_ON = 2,       // both ends offered it
+} cmu_ecn_state_t;
+
+/**
+ * Liveness timers, set with `cmu_set_keepalive` and `cmu_set_idle_timeout`.
+ * Times are in microseconds, 0 turns a timer off.
+ */
+typedef struct {
+  uint64_t keepalive_idle_us;      // silence from the peer before probing
+  uint64_t keepalive_interval_us;  // time between unanswered probes
+  uint32_t keepalive_probes;       // unanswered probes before giving up
+  uint64_t idle_timeout_us;        // no data either way before closing
+} cmu_timers_t;
+
 /**
  * This structure holds the state of a socket. You may modify this structure as
  * you see fit to include any additional state you need for your implementation.
@@ -75,23 +198,107 @@ typedef struct {
   pthread_t thread_id;
   uint16_t my_port;
   struct sockaddr_in conn;
-  uint8_t* received_buf;
-  int received_len;
+  cmu_stream_t streams[CMU_MAX_STREAMS];  // stream 0 is the default one
+  int received_len;              // unread bytes across all streams
+  cmu_segment_t* segment_pool;   // free segments ready for reuse
+  int segment_pool_len;
+  uint8_t* rx_bufs;  // datagram buffers for `recvmmsg`, owned by the backend
   pthread_mutex_t recv_lock;
   pthread_cond_t wait_cond;
-  uint8_t* sending_buf;
-  int sending_len;
+  int sending_len;       // bytes written but not taken, across all streams
+  uint16_t next_stream;  // the stream the backend serves first next time
+  int nodelay;           // see cmu_set_nodelay
+  int corked;            // see cmu_set_cork
+  uint64_t held_since;   // when the backend started holding back a short
+                         // packet because of the cork, 0 if it is not
   cmu_socket_type_t type;
   pthread_mutex_t send_lock;
   int dying;
+  int shutting_down;  // no more writes, send a FIN once the data is out
   pthread_mutex_t death_lock;
+  int aborted;        // dropped because the peer stopped answering
+  cmu_timers_t timers;  // guarded by death_lock
+  int wake_fd;   // eventfd the application uses to wake the backend up
+  int wake_pending;  // the backend consumed a wake-up it has not acted on
+  int fastopen;  // send the first write on the SYN when we have a cookie
+  handshake_t handshake;
   window_t window;
   server_state_t state;
-  uint64_t estRtt;
-  uint64_t devRtt;
-  uint64_t estRto;
+  rtt_estimator_t rtt;
+  pmtu_t pmtu;         // path MTU search, the backend packetizes by it
+  cmu_crc32c_state_t crc32c;
+  cmu_compress_state_t compress;
+  cmu_fec_state_t fec;
+  fec_encoder_t fec_tx;  // used by the backend only
+  fec_decoder_t fec_rx;  // used by the backend only
+  cmu_ecn_state_t ecn;
+  ecn_t ecn_cc;          // used by the backend only
+  int rx_ce;             // the packet being handled arrived marked CE, likewise
+  cmu_path_t paths[CMU_MAX_PATHS];  // path 0 is `socket` and `conn`
+  _Atomic int npaths;  // set by `cmu_add_path` on initiators, by the backend
+                       // on listeners
+  int cur_path;        // the path `send_packet` uses, used by the backend only
+  int rx_path;         // the path the last packet came on, likewise
+  uint32_t ts_recent;  // the last timestamp received from the peer
+  int received_fin;    // the peer's FIN arrived, guarded by recv_lock
+  uint32_t fin_seq;    // the sequence number of our FIN
+  uint64_t fin_send_time;  // when our FIN was last sent, 0 if it was not
+  int fin_retries;
+  uint64_t last_heard;  // when the peer last sent anything
+  uint64_t last_data;   // when data last went either way
+  uint32_t probes_sent;  // keepalive probes the peer has not answered
+  uint64_t probe_time;   // when the last of them was sent
+  cmu_counters_t stats;
+  cmu_link_t* link;  // link emulator under sendto, NULL for a real link
+  cmu_trace_t* trace;  // event trace, NULL unless tracing is on
 } cmu_socket_t;
 
+/**
+ * A snapshot of a connection's state and counters, filled by `cmu_get_stats`.
+ */
+typedef struct {
+  uint64_t bytes_sent;              // payload bytes sent, retransmits too
+  uint64_t segments_sent;           // data packets sent, retransmits too
+  uint64_t bytes_retransmitted;     // payload bytes sent more than once
+  uint64_t segments_retransmitted;  // data packets sent more than once
+  uint64_t rto_expirations;         // retransmission timeouts
+  uint64_t bytes_acked;             // payload bytes acknowledged by the peer
+  uint64_t dup_acks;                // ACKs that did not move the window
+  uint64_t bytes_received;          // payload bytes received, duplicates too
+  uint64_t segments_received;       // data packets received, duplicates too
+  uint64_t out_of_order;            // data packets received ahead of a gap
+  uint64_t dup_segments;            // data packets received twice
+  uint64_t window_limited_us;       // time spent with data but no window
+  uint64_t syn_cookies_sent;        // SYN-ACKs sent without keeping state
+  uint64_t syn_cookies_rejected;    // packets to a listener with a bad cookie
+  uint64_t foreign_packets;         // packets dropped as not from the peer
+  uint64_t keepalive_probes;        // keepalive probes sent
+  uint64_t pmtu_probes;             // path MTU probes sent
+  uint64_t checksum_errors;         // packets dropped for a bad CRC32C
+  uint64_t malformed_packets;       // dropped for a bad identifier, port or
+                                    // lengths
+  uint64_t compress_raw_bytes;      // stream bytes taken for compression
+  uint64_t compress_wire_bytes;     // the frames they became
+  uint64_t compress_stored_blocks;  // frames sent without compression
+  uint64_t fec_repairs_sent;        // FEC repair packets sent
+  uint64_t fec_recovered;           // data packets rebuilt from repairs
+  uint64_t path_failovers;          // paths given up as down
+  uint64_t ecn_ce_received;         // data packets that arrived marked CE
+  uint64_t ecn_reductions;          // window reductions for echoed marks
+  uint64_t srtt_us;                 // smoothed RTT
+  uint64_t rttvar_us;               // RTT variation
+  uint64_t rto_us;                  // retransmission timeout
+  uint64_t min_rtt_us;              // smallest RTT seen
+  uint32_t cwnd;                    // congestion window, in bytes
+  uint32_t ssthresh;                // slow start threshold, in bytes
+  uint32_t peer_window;             // window last advertised by the peer
+  uint32_t bytes_in_flight;         // bytes sent but not yet acknowledged
+  uint32_t pmtu;                    // largest packet known to get through
+  uint32_t recv_queue_bytes;        // received bytes the app has not read
+  uint32_t send_queue_bytes;        // written bytes the backend has not taken
+  uint32_t paths_up;                // paths of the connection that are up
+} cmu_stats_t;
+
 /*
  * DO NOT CHANGE THE DECLARATIONS BELOW
  */
@@ -125,9 +332,16 @@ int cmu_socket(cmu_socket_t* sock, const cmu_socket_type_t socket_type,
 /**
  * Closes a CMU-TCP socket.
  *
+ * Returns once everything written has been acknowledged and the peer has
+ * acknowledged our FIN, about one round trip after the last data. Waiting for
+ * the peer's FIN and TIME_WAIT carry on in the background. If the peer stops
+ * acknowledging, it gives up as the retransmissions or liveness timers run
+ * out, and fails. Segments borrowed with `cmu_read_borrow` must have been
+ * released first.
+ *
  * @param sock The socket to close.
  *
- * @return 0 on success, -1 on error.
+ * @return 0 on success, -1 on error or if the connection was aborted.
  */
 int cmu_close(cmu_socket_t* sock);
 
@@ -144,7 +358,8 @@ int cmu_close(cmu_socket_t* sock);
  *             `cmu_read_mode_t` for more information. `TIMEOUT` is not
  *             implemented for CMU-TCP.
  *
- * @return The number of bytes read on success, -1 on error.
+ * @return The number of bytes read on success, 0 once the peer has closed the
+ *         connection and everything it sent has been read, -1 on error.
  */
 int cmu_read(cmu_socket_t* sock, void* buf, const int length,
              cmu_read_mode_t flags);
@@ -164,4 +379,264 @@ int cmu_write(cmu_socket_t* sock, const void* buf, int length);
  * You can declare more functions after this point if you need to.
  */
 
+/**
+ * Constructs an initiator socket whose first write may ride on the SYN.
+ *
+ * Works like `cmu_socket` followed by `cmu_write`. If an earlier connection
+ * got a fast open cookie from the same listener, the start of `buf` is sent
+ * with the SYN and the listener can read it a round trip earlier. Otherwise
+ * the socket asks for a cookie and sends `buf` after the handshake.
+ *
+ * @param sock The structure with the socket state. It will be initialized by
+ *             this function.
+ * @param port Port to connect to.
+ * @param server_ip IP address of the server to connect to.
+ * @param buf The first data to send.
+ * @param length The number of bytes to send.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_socket_fastopen(cmu_socket_t* sock, const int port,
+                        const char* server_ip, const void* buf, int length);
+
+/**
+ * Closes the sending half of a CMU-TCP connection, like `shutdown(SHUT_WR)`.
+ *
+ * Data already written is still delivered, after which the peer reads the end
+ * of the stream. The socket can still be read until the peer closes its half.
+ * Writing to the socket fails from now on.
+ *
+ * @param sock The socket to shut down.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_shutdown(cmu_socket_t* sock);
+
+/**
+ * Turns on keepalive probes, like `SO_KEEPALIVE` with `TCP_KEEPIDLE`,
+ * `TCP_KEEPINTVL` and `TCP_KEEPCNT`.
+ *
+ * Once the peer has been silent for `idle_us`, the backend sends an empty
+ * probe the peer must acknowledge, and another every `interval_us` while
+ * none is. After `probes` unanswered probes the connection is dropped: its
+ * windows are freed, reads return the end of the stream once the data
+ * already received is read, and writes fail.
+ *
+ * @param sock The socket.
+ * @param idle_us How long the peer may be silent before the first probe, 0
+ *                to turn keepalive off.
+ * @param interval_us The time between probes.
+ * @param probes The number of unanswered probes after which the peer is
+ *               considered dead.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_set_keepalive(cmu_socket_t* sock, uint64_t idle_us,
+                      uint64_t interval_us, uint32_t probes);
+
+/**
+ * Closes the connection once no data has gone either way for `timeout_us`.
+ *
+ * The backend then shuts the socket down as `cmu_shutdown` does, so the peer
+ * reads the end of the stream, and reads here end once the peer closes its
+ * half in turn. Writes fail from then on. Keepalive probes do not count as
+ * data.
+ *
+ * @param sock The socket.
+ * @param timeout_us The idle time allowed, 0 to never time out.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_set_idle_timeout(cmu_socket_t* sock, uint64_t timeout_us);
+
+/**
+ * Turns Nagle's algorithm off or back on, like `TCP_NODELAY`.
+ *
+ * Writes made while data is in flight are always sent together once it is
+ * acknowledged. With Nagle's algorithm, which is on by default, a short
+ * packet at the end of the data is also held back until the rest is
+ * acknowledged, so that later writes can fill it up. Turning it off sends
+ * that packet right away, at the cost of more, smaller packets.
+ *
+ * @param sock The socket.
+ * @param nodelay 1 to send short packets right away, 0 to hold them back.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_set_nodelay(cmu_socket_t* sock, int nodelay);
+
+/**
+ * Corks or uncorks the socket, like `TCP_CORK`.
+ *
+ * While corked only full packets are sent, whatever `cmu_set_nodelay` says;
+ * short ones are held back until they fill up, the socket is uncorked, shut
+ * down or closed, or CMU_CORK_MAX_US has passed. Cork the socket, make a
+ * series of small writes, then uncork it to send them in as few packets as
+ * possible.
+ *
+ * @param sock The socket.
+ * @param cork 1 to cork, 0 to uncork and send what is held back.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_set_cork(cmu_socket_t* sock, int cork);
+
+/**
+ * Reads data from a CMU-TCP socket into multiple buffers.
+ *
+ * Fills each buffer in `iov` in order before moving on to the next one, the
+ * same way `readv` does. Waits for data the same way `cmu_read` does.
+ *
+ * @param sock The socket to read from.
+ * @param iov The buffers to read into.
+ * @param iovcnt The number of buffers in `iov`.
+ * @param flags Flags that determine how the socket should wait for data. Check
+ *             `cmu_read_mode_t` for more information. `TIMEOUT` is not
+ *             implemented for CMU-TCP.
+ *
+ * @return The number of bytes read on success, -1 on error.
+ */
+int cmu_readv(cmu_socket_t* sock, const struct iovec* iov, int iovcnt,
+              cmu_read_mode_t flags);
+
+/**
+ * Borrows the next in-order segment of received data without copying it.
+ *
+ * The segment is removed from the socket's receive queue and stays valid until
+ * it is handed back with `cmu_read_release`. Several segments may be borrowed
+ * at the same time. The socket does not keep track of them: every one must be
+ * released before `cmu_close`, which would otherwise leak it.
+ *
+ * @param sock The socket to read from.
+ * @param seg Set to the borrowed segment, or NULL if no data was available.
+ * @param data Set to the first unread byte of the segment.
+ * @param flags Flags that determine how the socket should wait for data. Check
+ *             `cmu_read_mode_t` for more information. `TIMEOUT` is not
+ *             implemented for CMU-TCP.
+ *
+ * @return The number of bytes available at `data` on success, -1 on error.
+ */
+int cmu_read_borrow(cmu_socket_t* sock, cmu_segment_t** seg, uint8_t** data,
+                    cmu_read_mode_t flags);
+
+/**
+ * Returns a segment obtained from `cmu_read_borrow` to the socket. The socket
+ * must not have been closed yet.
+ *
+ * @param sock The socket the segment was borrowed from.
+ * @param seg The segment to return.
+ */
+void cmu_read_release(cmu_socket_t* sock, cmu_segment_t* seg);
+
+/**
+ * Writes data to one stream of a CMU-TCP connection.
+ *
+ * A connection carries CMU_MAX_STREAMS independent byte streams, numbered
+ * from 0; stream 0 is the one `cmu_write` and `cmu_read` use. Streams need no
+ * setup: writing to one opens it. Bytes written to a stream arrive in order on
+ * the same stream at the peer. When several streams have data queued, the
+ * backend sends one segment of each in turn.
+ *
+ * Streams share the connection's handshake, window and congestion control, so
+ * a lost segment of one stream also holds back the others until it is
+ * retransmitted.
+ *
+ * @param sock The socket to write to.
+ * @param stream The stream ID, below CMU_MAX_STREAMS.
+ * @param buf The data to write.
+ * @param length The number of bytes to write.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_stream_write(cmu_socket_t* sock, uint16_t stream, const void* buf,
+                     int length);
+
+/**
+ * Reads data from one stream of a CMU-TCP connection. Works like `cmu_read`,
+ * but only returns data written to `stream` by the peer.
+ *
+ * @param sock The socket to read from.
+ * @param stream The stream ID, below CMU_MAX_STREAMS.
+ * @param buf The buffer to read into.
+ * @param length The maximum number of bytes to read.
+ * @param flags Flags that determine how the socket should wait for data. Check
+ *             `cmu_read_mode_t` for more information. `TIMEOUT` is not
+ *             implemented for CMU-TCP.
+ *
+ * @return The number of bytes read on success, 0 once the peer closed the
+ *         connection and the stream holds no more data, -1 on error.
+ */
+int cmu_stream_read(cmu_socket_t* sock, uint16_t stream, void* buf, int length,
+                    cmu_read_mode_t flags);
+
+/**
+ * Sends one message. The peer receives it whole with `cmu_recv_msg`, never
+ * merged with the messages around it or cut in pieces.
+ *
+ * Messages travel on stream 0 as a 4 byte length prefix followed by the
+ * message, so a connection should use either `cmu_send_msg`/`cmu_recv_msg` or
+ * `cmu_write`/`cmu_read` on stream 0, not both. Messages queued together
+ * share packets, so many small ones cost few packets.
+ *
+ * @param sock The socket to send on.
+ * @param buf The message.
+ * @param length The length of the message, from 1 to CMU_MAX_MSG_LEN.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_send_msg(cmu_socket_t* sock, const void* buf, int length);
+
+/**
+ * Receives one message sent with `cmu_send_msg`. Waits until the whole
+ * message has arrived and copies it straight into `buf`. If the message is
+ * longer than `length`, the rest of it is dropped.
+ *
+ * @param sock The socket to receive from.
+ * @param buf The buffer to receive into.
+ * @param length The size of the buffer.
+ * @param flags `NO_FLAG` to wait for a message, `NO_WAIT` to return 0 right
+ *              away if no whole message is there yet.
+ *
+ * @return The length of the message, which is more than `length` if it was
+ *         cut short, 0 once the peer closed the connection, -1 on error,
+ *         including when the connection closes in the middle of a message.
+ */
+int cmu_recv_msg(cmu_socket_t* sock, void* buf, int length,
+                 cmu_read_mode_t flags);
+
+/**
+ * Adds a path to a connection, see multipath.h.
+ *
+ * The path sends from a UDP socket of its own bound to `local_ip`, so it can
+ * leave through another interface, to `server_ip` and `port`, which may be
+ * another address of the listener. Once the connection is established, the
+ * backend joins the path to it and spreads segments over all paths that are
+ * up. The listener must accept multipath, see `cmu_set_multipath`; until it
+ * answers, or if it never does, the path is not used.
+ *
+ * It must not be called from two threads at once.
+ *
+ * @param sock An initiator socket.
+ * @param local_ip The local address to send from, NULL for any.
+ * @param server_ip The address of the listener to send to.
+ * @param port The port of the listener.
+ *
+ * @return The number of the path on success, -1 on error, including when the
+ *         connection already has CMU_MAX_PATHS paths.
+ */
+int cmu_add_path(cmu_socket_t* sock, const char* local_ip,
+                 const char* server_ip, const int port);
+
+/**
+ * Gets a snapshot of a connection's counters and state, similar to TCP_INFO.
+ *
+ * It is safe to call from any thread while the connection is running.
+ *
+ * @param sock The socket to inspect.
+ * @param stats Filled with the snapshot.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int cmu_get_stats(cmu_socket_t* sock, cmu_stats_t* stats);
+
 #endif  // PROJECT_2_15_441_INC_CMU_TCP_H_
@@ -0,0 +1,141 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the payload compression both ends of a connection can
+ * agree on during the handshake.
+ *
+ * The sender compresses each stream's bytes before they are cut into packets,
+ * COMPRESS_BLOCK bytes at a time, with a small LZ77 codec in the style of LZ4.
+ * Each block becomes a frame: a 2 byte raw length, a 2 byte encoded length and
+ * the encoded bytes, or the raw bytes when the encoded length is 0. The frames
+ * are what the sequence numbers count. The receiver reassembles the frames of
+ * each stream as its bytes are delivered in order and queues the decoded
+ * bytes for the application.
+ *
+ * Blocks that do not shrink by at least 1/COMPRESS_MIN_SAVING are stored, and
+ * every block stored doubles the number of blocks after it that are stored
+ * without trying, up to COMPRESS_MAX_BACKOFF. Incompressible data thus costs
+ * little more than the 4 byte frame header.
+ */
+
+#ifndef PROJECT_2_15_441_INC_COMPRESS_H_
+#define PROJECT_2_15_441_INC_COMPRESS_H_
+
+#include <stdint.h>
+
+// Raw bytes per frame, at most.
+#define COMPRESS_BLOCK 16384
+
+#define COMPRESS_FRAME_HDR_LEN 4
+
+// Blocks shorter than this are stored without trying.
+#define COMPRESS_MIN_LEN 64
+
+// A block must save 1/COMPRESS_MIN_SAVING of its size to be sent compressed.
+#define COMPRESS_MIN_SAVING 8
+
+// Most blocks stored without trying after blocks that did not compress.
+#define COMPRESS_MAX_BACKOFF 64
+
+/**
+ * The sending side of a stream's compression.
+ */
+typedef struct {
+  uint32_t backoff;        // blocks to skip after the next one stored
+  uint32_t skip;           // blocks left to store without trying
+  uint64_t stored_blocks;  // blocks sent as they were
+} compressor_t;
+
+/**
+ * The receiving side of a stream's compression: the frame being put back
+ * together.
+ */
+typedef struct {
+  uint8_t* frame;  // the frame, header included, allocated on first use
+  uint32_t len;    // bytes of it received so far
+} decompressor_t;
+
+/**
+ * Turns compression on or off for sockets created from now on.
+ *
+ * It is off by default, and only used when the peer turns it on too. The
+ * `CMU_COMPRESS` environment variable sets the same default when the first
+ * socket is created, e.g. `CMU_COMPRESS=1`.
+ *
+ * @param enabled 1 to offer compression on the handshake, 0 not to.
+ */
+void cmu_set_compression(int enabled);
+
+/**
+ * Tells if sockets created now offer compression.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+int compression_enabled(void);
+
+/**
+ * Gets the most bytes `compress_frames` can turn `len` bytes into.
+ */
+uint32_t compress_bound(uint32_t len);
+
+/**
+ * Compresses bytes of a stream into frames.
+ *
+ * @param c The stream's compressor.
+ * @param src The bytes.
+ * @param len The number of bytes.
+ * @param dst Where to write the frames, with room for `compress_bound(len)`
+ *            bytes.
+ *
+ * @return The number of bytes written.
+ */
+uint32_t compress_frames(compressor_t* c, const uint8_t* src, uint32_t len,
+                         uint8_t* dst);
+
+/**
+ * Takes bytes of a stream of frames, up to the end of the current frame.
+ *
+ * @param d The stream's decompressor.
+ * @param src The bytes.
+ * @param len The number of bytes.
+ *
+ * @return The number of bytes taken, or -1 on failure to allocate.
+ */
+int decompress_take(decompressor_t* d, const uint8_t* src, uint32_t len);
+
+/**
+ * Gets the raw length of the frame the decompressor holds, once all of it has
+ * arrived.
+ *
+ * @param d The decompressor.
+ *
+ * @return The raw length, at most COMPRESS_BLOCK, 0 if the frame is not
+ *         complete yet, or -1 if its header is corrupt. A corrupt frame is
+ *         thrown away by `decompress_finish`.
+ */
+int decompress_ready(const decompressor_t* d);
+
+/**
+ * Decodes the complete frame the decompressor holds and starts on the next.
+ *
+ * @param d The decompressor, `decompress_ready` not 0.
+ * @param dst Where to write the raw bytes, with room for
+ *            `decompress_ready(d)` bytes. Untouched if the header is corrupt.
+ *
+ * @return The number of bytes written, or -1 if the frame is corrupt.
+ */
+int decompress_finish(decompressor_t* d, uint8_t* dst);
+
+/**
+ * Frees what the decompressor holds.
+ */
+void decompress_free(decompressor_t* d);
+
+#endif  // PROJECT_2_15_441_INC_COMPRESS_H_
@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines CRC32C (Castagnoli), the end-to-end checksum CMU-TCP
+ * carries in the header extension on top of the UDP checksum.
+ *
+ * On x86-64 CPUs with SSE4.2 it runs on the `crc32` instruction, three
+ * streams at a time; elsewhere on slicing-by-8 tables. The implementation is
+ * picked once, on first use.
+ */
+
+#ifndef PROJECT_2_15_441_INC_CRC32C_H_
+#define PROJECT_2_15_441_INC_CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Turns the CRC32C option on or off for sockets created from now on.
+ *
+ * It is on by default, and only used when the peer turns it on too. The
+ * `CMU_CRC32C` environment variable sets the same default when the first
+ * socket is created, e.g. `CMU_CRC32C=0`.
+ *
+ * @param enabled 1 to offer checksums on the handshake, 0 to never send any.
+ */
+void cmu_set_crc32c(int enabled);
+
+/**
+ * Tells if sockets created now offer checksums.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+int crc32c_enabled(void);
+
+/**
+ * Computes the CRC32C of a buffer.
+ *
+ * @param crc The CRC of the data before `buf`, or 0 to start.
+ * @param buf The data.
+ * @param len The length of the data.
+ *
+ * @return The CRC of everything so far.
+ */
+uint32_t crc32c(uint32_t crc, const void* buf, size_t len);
+
+/**
+ * Computes the CRC32C of a buffer with the portable table implementation,
+ * whatever the CPU supports. For tests and benchmarks.
+ */
+uint32_t crc32c_sw(uint32_t crc, const void* buf, size_t len);
+
+/**
+ * Gets the name of the implementation `crc32c` uses, e.g. "sse4.2".
+ */
+const char* crc32c_impl(void);
+
+#endif  // PROJECT_2_15_441_INC_CRC32C_H_
@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines explicit congestion notification, which both ends of a
+ * connection can agree on during the handshake.
+ *
+ * Once they have, every datagram goes out ECN-capable, ECT(0) in its IP
+ * header, and a router whose queue builds up marks it CE instead of dropping
+ * it. The receiver counts the payload bytes that arrived marked and echoes the
+ * running count on every ACK, so a lost ACK loses no marks. When the count
+ * grows, the sender shrinks its congestion window at most once per window of
+ * data: by half, as RFC 3168 does on loss, or in proportion to the share of
+ * bytes marked lately, as DCTCP (RFC 8257) does, which keeps queues short
+ * without giving up throughput. Either way the window grows back like after
+ * a loss.
+ */
+
+#ifndef PROJECT_2_15_441_INC_ECN_H_
+#define PROJECT_2_15_441_INC_ECN_H_
+
+#include <stdint.h>
+
+// The ECN field of the IP TOS byte.
+#define ECN_MASK 0x03
+#define ECN_ECT0 0x02
+#define ECN_CE 0x03
+
+// The DCTCP estimate of the share of bytes marked, in fixed point.
+#define ECN_ALPHA_ONE 1024
+
+// The weight of each window's share in the estimate is 1/2^ECN_DCTCP_SHIFT,
+// g in RFC 8257.
+#define ECN_DCTCP_SHIFT 4
+
+/**
+ * How the sender reacts to marks.
+ */
+typedef enum {
+  ECN_MODE_OFF = 0,      // no ECN
+  ECN_MODE_CLASSIC = 1,  // halve the window, like on a loss
+  ECN_MODE_DCTCP = 2,    // shrink it by half the share of bytes marked
+} ecn_mode_t;
+
+/**
+ * A connection's ECN state, used by the backend only.
+ */
+typedef struct {
+  ecn_mode_t mode;
+  uint32_t ce_bytes;    // payload bytes received marked, as echoed
+  uint32_t echoed;      // the peer's count as of its last ACK
+  uint32_t acked;       // bytes acknowledged since `window_end` was set
+  uint32_t marked;      // of those, bytes the peer echoed as marked
+  uint32_t window_end;  // the end of the window the share is taken over
+  uint8_t measuring;    // `window_end` is set
+  uint32_t recover;     // no reduction until this is acknowledged
+  uint8_t reduced;      // `recover` is set
+  uint32_t alpha;       // the DCTCP estimate, out of ECN_ALPHA_ONE
+} ecn_t;
+
+/**
+ * Sets whether, and how, sockets created from now on offer ECN.
+ *
+ * It is off by default. The `CMU_ECN` environment variable sets the same
+ * default when the first socket is created: `CMU_ECN=1` for the classic
+ * response, `CMU_ECN=dctcp` for the proportional one.
+ *
+ * @param mode An `ecn_mode_t`.
+ */
+void cmu_set_ecn(int mode);
+
+/**
+ * Tells if, and how, sockets created now offer ECN.
+ *
+ * @return An `ecn_mode_t`.
+ */
+int ecn_mode(void);
+
+/**
+ * Initializes the ECN state of a new connection.
+ *
+ * @param e The state to initialize.
+ * @param mode How to react to marks.
+ */
+void ecn_init(ecn_t* e, int mode);
+
+/**
+ * Processes the peer's count of marked bytes on an ACK, and shrinks the
+ * congestion window if it grew and the window was not shrunk for the data
+ * in flight already.
+ *
+ * @param e The ECN state.
+ * @param ack The acknowledgement number of the ACK.
+ * @param acked The bytes it newly acknowledges.
+ * @param echoed The count it echoes.
+ * @param snd_nxt The sequence number of the next byte to send.
+ * @param cwnd The congestion window, updated if it shrinks.
+ * @param min_cwnd The smallest the window may get.
+ *
+ * @return 1 if the window shrank, 0 otherwise.
+ */
+int ecn_on_ack(ecn_t* e, uint32_t ack, uint32_t acked, uint32_t echoed,
+               uint32_t snd_nxt, uint32_t* cwnd, uint32_t min_cwnd);
+
+#endif  // PROJECT_2_15_441_INC_ECN_H_
@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines CMU-TCP fast open, modelled on TCP Fast Open (RFC 7413).
+ *
+ * A listener hands each client address a cookie derived from a per-process
+ * secret. A client that has a cookie for a listener sends it on its SYN
+ * together with the start of its first write, and a listener that recognises
+ * the cookie delivers that data before the handshake completes, saving a
+ * round trip on short connections.
+ */
+
+#ifndef PROJECT_2_15_441_INC_FASTOPEN_H_
+#define PROJECT_2_15_441_INC_FASTOPEN_H_
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include "cmu_options.h"
+
+/**
+ * Computes the cookie that a listener gives to a client.
+ *
+ * @param client The client's address. Only the IP address is used, so the
+ *               cookie survives the client changing ports.
+ * @param cookie Set to the cookie, OPT_FASTOPEN_COOKIE_LEN bytes.
+ */
+void fastopen_make_cookie(const struct sockaddr_in* client, uint8_t* cookie);
+
+/**
+ * Checks a cookie presented by a client.
+ *
+ * @param client The client's address.
+ * @param cookie The cookie from the client's SYN.
+ *
+ * @return 1 if the cookie is valid for this client, 0 otherwise.
+ */
+int fastopen_check_cookie(const struct sockaddr_in* client,
+                          const uint8_t* cookie);
+
+/**
+ * Looks up the cookie received from a listener.
+ *
+ * @param server The listener's address.
+ * @param cookie Set to the cookie if there is one.
+ *
+ * @return 1 if a cookie was found, 0 otherwise.
+ */
+int fastopen_cache_get(const struct sockaddr_in* server, uint8_t* cookie);
+
+/**
+ * Remembers the cookie received from a listener for later connections.
+ *
+ * @param server The listener's address.
+ * @param cookie The cookie from the listener's SYN-ACK.
+ */
+void fastopen_cache_put(const struct sockaddr_in* server,
+                        const uint8_t* cookie);
+
+#endif  // PROJECT_2_15_441_INC_FASTOPEN_H_
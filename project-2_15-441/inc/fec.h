@@ -0,0 +1,199 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines forward error correction with XOR parity, which both ends
+ * of a connection can agree on during the handshake.
+ *
+ * The sender puts the data packets it sends for the first time into groups,
+ * marks each with its group and follows every group with a repair packet: the
+ * XOR of the group's payloads, zero padded to the longest, along with the XOR
+ * of their sequence numbers, lengths and streams. The receiver XORs the
+ * marked packets it gets the same way, so when the repair finds exactly one of
+ * them missing, XORing the two gives back the missing packet whole, a round
+ * trip before its retransmission would.
+ *
+ * The group size is fixed, or adapts to the share of packets the sender had
+ * to resend lately: about one loss in four groups, so that groups with two
+ * losses, which XOR cannot repair, stay rare. Packets the receiver rebuilt
+ * are not resent, which makes the estimate low while repairs work; the
+ * estimate decays slowly enough for that not to matter much.
+ */
+
+#ifndef PROJECT_2_15_441_INC_FEC_H_
+#define PROJECT_2_15_441_INC_FEC_H_
+
+#include <stdint.h>
+
+// Largest number of data packets per repair packet.
+#define FEC_MAX_GROUP 32
+
+// Smallest group size the adaptive mode picks.
+#define FEC_MIN_GROUP 4
+
+// Group size meaning it follows the measured loss rate.
+#define FEC_ADAPTIVE (-1)
+
+// Groups the receiver collects at the same time. Repairs come right after
+// their group, so a few cover any reordering.
+#define FEC_DECODE_GROUPS 4
+
+// Packets sent before the loss estimate is halved, so it follows changes.
+#define FEC_LOSS_WINDOW 1024
+
+/**
+ * What a repair packet carries besides the parity, see `OPT_FEC_REPAIR`.
+ */
+typedef struct {
+  uint32_t group;   // the sequence number of the group's first packet
+  uint8_t count;    // the number of packets in the group
+  uint32_t seq;     // the XOR of their sequence numbers
+  uint16_t len;     // the XOR of their payload lengths
+  uint16_t stream;  // the XOR of their streams
+} fec_repair_t;
+
+/**
+ * The sending side: the group being built.
+ */
+typedef struct {
+  int group_size;       // fixed group size, or FEC_ADAPTIVE
+  uint32_t sent;        // packets sent for the first time, decayed
+  uint32_t resent;      // packets sent again, decayed
+  fec_repair_t repair;  // the group so far
+  uint16_t parity_len;
+  uint8_t* parity;      // allocated on first use
+} fec_encoder_t;
+
+/**
+ * A group the receiver is collecting.
+ */
+typedef struct {
+  fec_repair_t sum;  // what arrived of the group, `count` packets
+  uint32_t age;      // when the group was started, to pick one to evict
+  uint16_t parity_len;
+  uint8_t* parity;   // allocated on first use
+} fec_group_t;
+
+/**
+ * The receiving side: the groups being collected. A group whose `count` is 0
+ * is free.
+ */
+typedef struct {
+  fec_group_t groups[FEC_DECODE_GROUPS];
+  uint32_t clock;
+} fec_decoder_t;
+
+/**
+ * Sets the group size for sockets created from now on.
+ *
+ * It is 0, off, by default, and only used when the peer turns it on too. The
+ * `CMU_FEC` environment variable sets the same default when the first socket
+ * is created, e.g. `CMU_FEC=8` or `CMU_FEC=auto`.
+ *
+ * @param group_size Data packets per repair packet, at most FEC_MAX_GROUP,
+ *                   FEC_ADAPTIVE to follow the loss rate, or 0 not to offer
+ *                   forward error correction on the handshake.
+ */
+void cmu_set_fec(int group_size);
+
+/**
+ * Gets the group size sockets created now use.
+ *
+ * @return The size, FEC_ADAPTIVE, or 0 if it is off.
+ */
+int fec_group_size(void);
+
+/**
+ * Starts an encoder with no group.
+ */
+void fec_encoder_init(fec_encoder_t* e, int group_size);
+
+/**
+ * Adds a packet sent for the first time to the group being built.
+ *
+ * @param e The encoder.
+ * @param seq The packet's sequence number.
+ * @param stream The packet's stream.
+ * @param payload The packet's payload.
+ * @param len The length of the payload.
+ * @param group Set to the group to mark the packet with.
+ *
+ * @return 1 if the packet joined a group, 0 if no repairs are sent for now
+ *         or memory ran out.
+ */
+int fec_encode(fec_encoder_t* e, uint32_t seq, uint16_t stream,
+               const uint8_t* payload, uint16_t len, uint32_t* group);
+
+/**
+ * Counts packets sent again, for the adaptive group size.
+ */
+void fec_note_resent(fec_encoder_t* e, uint32_t packets);
+
+/**
+ * Tells if the group being built is complete and its repair due.
+ */
+int fec_repair_due(const fec_encoder_t* e);
+
+/**
+ * Takes the repair of the group being built, complete or not, and starts a
+ * new group.
+ *
+ * @param e The encoder.
+ * @param repair Set to the repair's header fields.
+ * @param len Set to the length of the parity.
+ *
+ * @return The parity, valid until the next call to `fec_encode`, or NULL if
+ *         the group is empty.
+ */
+const uint8_t* fec_take_repair(fec_encoder_t* e, fec_repair_t* repair,
+                               uint16_t* len);
+
+/**
+ * Frees what the encoder holds.
+ */
+void fec_encoder_free(fec_encoder_t* e);
+
+/**
+ * Adds a marked packet received for the first time to its group.
+ *
+ * @param d The decoder.
+ * @param group The group the packet is marked with.
+ * @param seq The packet's sequence number.
+ * @param stream The packet's stream.
+ * @param payload The packet's payload.
+ * @param len The length of the payload.
+ */
+void fec_decode(fec_decoder_t* d, uint32_t group, uint32_t seq,
+                uint16_t stream, const uint8_t* payload, uint16_t len);
+
+/**
+ * Rebuilds the missing packet of a group from its repair, if exactly one is
+ * missing. The group is forgotten either way.
+ *
+ * @param d The decoder.
+ * @param repair The repair's header fields.
+ * @param parity The repair's parity.
+ * @param len The length of the parity.
+ * @param seq Set to the rebuilt packet's sequence number.
+ * @param stream Set to the rebuilt packet's stream.
+ * @param payload Where to write the rebuilt payload, with room for `len`
+ *                bytes.
+ *
+ * @return The length of the rebuilt payload, or 0 if nothing was rebuilt.
+ */
+uint16_t fec_recover(fec_decoder_t* d, const fec_repair_t* repair,
+                     const uint8_t* parity, uint16_t len, uint32_t* seq,
+                     uint16_t* stream, uint8_t* payload);
+
+/**
+ * Frees what the decoder holds.
+ */
+void fec_decoder_free(fec_decoder_t* d);
+
+#endif  // PROJECT_2_15_441_INC_FEC_H_
@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines an inline codec for the CMU-TCP header, used on the
+ * receive path instead of the getters in cmu_packet.h.
+ *
+ * `hdr_decode` swaps every field into host order once, into a `cmu_hdr_t` the
+ * backend then reads as plain struct fields. `hdr_validate_batch` decodes and
+ * checks all the datagrams of one `recvmmsg` call together.
+ */
+
+#ifndef PROJECT_2_15_441_INC_HEADER_CODEC_H_
+#define PROJECT_2_15_441_INC_HEADER_CODEC_H_
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cmu_packet.h"
+
+/**
+ * A decoded header, all fields in host order.
+ */
+typedef struct {
+  uint32_t identifier;
+  uint16_t src;
+  uint16_t dst;
+  uint32_t seq;
+  uint32_t ack;
+  uint16_t hlen;
+  uint16_t plen;
+  uint8_t flags;
+  uint16_t adv_window;
+  uint16_t ext_len;
+  uint16_t payload_len;
+  uint8_t* pkt;      // the packet the header was decoded from
+  uint8_t* ext;      // its extension data
+  uint8_t* payload;  // its payload
+} cmu_hdr_t;
+
+/**
+ * Decodes the header at the start of a packet. The packet must have room for
+ * a whole header, even if the datagram was shorter; `hdr_valid` tells if the
+ * result means anything.
+ *
+ * @param pkt The packet.
+ * @param h The header to fill.
+ */
+static inline void hdr_decode(uint8_t* pkt, cmu_hdr_t* h) {
+  cmu_tcp_header_t raw;
+
+  memcpy(&raw, pkt, sizeof(raw));
+  h->identifier = ntohl(raw.identifier);
+  h->src = ntohs(raw.source_port);
+  h->dst = ntohs(raw.destination_port);
+  h->seq = ntohl(raw.seq_num);
+  h->ack = ntohl(raw.ack_num);
+  h->hlen = ntohs(raw.hlen);
+  h->plen = ntohs(raw.plen);
+  h->flags = raw.flags;
+  h->adv_window = ntohs(raw.advertised_window);
+  h->ext_len = ntohs(raw.extension_length);
+  h->payload_len = h->plen - h->hlen;
+  h->pkt = pkt;
+  h->ext = pkt + sizeof(cmu_tcp_header_t);
+  h->payload = pkt + sizeof(cmu_tcp_header_t) + h->ext_len;
+}
+
+/**
+ * Checks a decoded header against the datagram it came in.
+ *
+ * @param h The header.
+ * @param len The length of the datagram.
+ * @param port The local port, which the header must be addressed to.
+ *
+ * @return 1 if the identifier and destination port are right and the lengths
+ *         add up, 0 otherwise.
+ */
+static inline int hdr_valid(const cmu_hdr_t* h, uint32_t len, uint16_t port) {
+  // Evaluated without branches; a batch of good packets takes no mispredicts.
+  return (len >= sizeof(cmu_tcp_header_t)) & (h->identifier == IDENTIFIER) &
+         (h->dst == port) &
+         (h->hlen == sizeof(cmu_tcp_header_t) + h->ext_len) &
+         (h->plen >= h->hlen) & (h->plen <= len);
+}
+
+/**
+ * Decodes and checks the headers of a batch of datagrams.
+ *
+ * @param pkts The datagrams, each with room for a whole header.
+ * @param lens Their lengths.
+ * @param n The number of datagrams.
+ * @param port The local port.
+ * @param hdrs The decoded headers, one per datagram.
+ * @param valid Set to 1 for each datagram that passes `hdr_valid`, else 0.
+ *
+ * @return The number of valid datagrams.
+ */
+int hdr_validate_batch(uint8_t* const* pkts, const uint32_t* lens, int n,
+                       uint16_t port, cmu_hdr_t* hdrs, uint8_t* valid);
+
+#endif  // PROJECT_2_15_441_INC_HEADER_CODEC_H_
@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines an in-process link emulator that sits under the backend's
+ * `sendto`. It impairs outgoing datagrams with seeded loss, duplication,
+ * reordering, delay, jitter, a bandwidth cap and a path MTU, so that recovery,
+ * congestion control and path MTU discovery can be tested deterministically
+ * without tc/netem. Like a router doing ECN, it can also mark ECN-capable
+ * datagrams CE when the bandwidth cap makes them queue.
+ *
+ * Impairments apply to the datagrams a socket sends. To impair both
+ * directions, enable the emulator on both ends.
+ */
+
+#ifndef PROJECT_2_15_441_INC_LINK_H_
+#define PROJECT_2_15_441_INC_LINK_H_
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Link impairments. A zeroed config is a perfect link.
+ */
+typedef struct {
+  double loss;          // probability that a datagram is dropped
+  double duplicate;     // probability that a datagram is sent twice
+  double reorder;       // probability that a datagram is held back
+  uint64_t reorder_us;  // extra delay of a held back datagram, 0 for 5 ms
+  uint64_t delay_us;    // one-way delay added to every datagram
+  uint64_t jitter_us;   // uniform random extra delay, up to this much
+  uint64_t rate_bps;    // bandwidth cap in bits per second, 0 for none
+  uint32_t queue_limit; // datagrams queued before drop-tail, 0 for 1000
+  uint32_t mtu;         // longer DF datagrams are dropped, 0 for no limit
+  uint64_t mark_us;     // ECN-capable datagrams queued behind at least this
+                        // much are marked CE, 0 for never
+  uint64_t seed;        // seed for all random decisions
+} cmu_link_config_t;
+
+typedef struct cmu_link cmu_link_t;
+
+/**
+ * Sets the link config for sockets created from now on.
+ *
+ * The `CMU_LINK` environment variable sets the same default when the first
+ * socket is created, as a comma separated list of `key=value` pairs named
+ * like the fields above, e.g. `CMU_LINK=loss=0.01,delay_us=20000,seed=7`.
+ * A config set with this function takes precedence over the environment.
+ *
+ * @param cfg The config to use, or NULL to go back to a perfect link.
+ */
+void cmu_set_link_config(const cmu_link_config_t* cfg);
+
+/**
+ * Creates the emulator for a new socket from the current default config.
+ *
+ * @param salt Mixed into the seed, with the number of emulators created so
+ *             far, so that sockets sharing a config do not make identical
+ *             decisions.
+ *
+ * @return The emulator, or NULL if the link is perfect.
+ */
+cmu_link_t* link_create(uint64_t salt);
+
+/**
+ * Frees an emulator once every datagram still queued in it has been sent,
+ * sleeping until the last one is due.
+ */
+void link_destroy(cmu_link_t* link);
+
+/**
+ * Sends a datagram through the emulator, or straight to the socket if `link`
+ * is NULL.
+ *
+ * @param link The emulator.
+ * @param fd The UDP socket to send on.
+ * @param buf The datagram.
+ * @param len The length of the datagram.
+ * @param to The destination address.
+ */
+void link_send(cmu_link_t* link, int fd, const void* buf, size_t len,
+               const struct sockaddr_in* to);
+
+/**
+ * Sends every queued datagram whose time has come.
+ *
+ * @param link The emulator, may be NULL.
+ */
+void link_flush(cmu_link_t* link);
+
+/**
+ * Gets the time when the next queued datagram is due.
+ *
+ * @param link The emulator, may be NULL.
+ *
+ * @return The time in microseconds on the CMU-TCP clock, or 0 if nothing is
+ *         queued.
+ */
+uint64_t link_next_release(const cmu_link_t* link);
+
+#endif  // PROJECT_2_15_441_INC_LINK_H_
@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the CMU-TCP logging facility.
+ *
+ * Messages below `LOG_LEVEL` are compiled out entirely, arguments included,
+ * so they cost nothing in a release build. Per-packet events should use
+ * `LOG_TRACE` instead, which records into an in-memory ring without
+ * formatting or doing any I/O; the ring is printed with `log_trace_dump`.
+ */
+
+#ifndef PROJECT_2_15_441_INC_LOG_H_
+#define PROJECT_2_15_441_INC_LOG_H_
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_WARN
+#endif
+#endif
+
+// Set to 1 to record LOG_TRACE events. On by default in debug builds.
+#ifndef LOG_TRACE_RING
+#ifdef DEBUG
+#define LOG_TRACE_RING 1
+#else
+#define LOG_TRACE_RING 0
+#endif
+#endif
+
+// Number of events kept in the trace ring. Must be a power of two.
+#define LOG_TRACE_RING_SIZE 4096
+
+#define LOG_AT(level, ...)                                \
+  do {                                                    \
+    if (LOG_LEVEL >= (level)) {                           \
+      log_write((level), __FILE__, __LINE__, __VA_ARGS__); \
+    }                                                     \
+  } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+/**
+ * Records an event in the trace ring. `fmt` is only kept by pointer, so it
+ * must be a string literal consuming exactly three uint64_t values, printed
+ * with PRIu64 or PRIx64.
+ */
+#define LOG_TRACE(fmt, a, b, c)                                          \
+  do {                                                                   \
+    if (LOG_TRACE_RING) {                                                \
+      log_trace((fmt), (uint64_t)(a), (uint64_t)(b), (uint64_t)(c));     \
+    }                                                                    \
+  } while (0)
+
+/**
+ * Writes a formatted message to stderr. Use the LOG_* macros instead.
+ */
+void log_write(int level, const char* file, int line, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/**
+ * Records an event in the trace ring. Use LOG_TRACE instead.
+ *
+ * Safe to call from any number of threads at once; it never blocks.
+ */
+void log_trace(const char* fmt, uint64_t a, uint64_t b, uint64_t c);
+
+/**
+ * Prints the events currently in the trace ring, oldest first.
+ *
+ * Events overwritten while the dump runs are skipped.
+ *
+ * @param out The stream to print to.
+ */
+void log_trace_dump(FILE* out);
+
+#endif  // PROJECT_2_15_441_INC_LOG_H_
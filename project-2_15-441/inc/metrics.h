@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the metrics cache, which remembers what connections
+ * learned about each peer host, like the destination cache of TCP stacks.
+ *
+ * When a connection ends, its smoothed RTT, RTT variation, slow start
+ * threshold, congestion window and path MTU are stored under the peer's IP
+ * address. A new connection to the same host starts its retransmission
+ * timer from them instead of WINDOW_INITIAL_RTT, so a lost SYN or first
+ * segment costs a few round trips rather than seconds, and starts sending at
+ * the path MTU and window the last one ended with. Its first RTT sample still
+ * replaces the cached estimate altogether.
+ *
+ * Entries age: the older one is, the more its RTT variation is raised towards
+ * half the smoothed RTT, which is what a single fresh sample would give, and
+ * after METRICS_MAX_AGE_US it is not used at all. The cache can be backed by a
+ * file so that it outlives the process.
+ */
+
+#ifndef PROJECT_2_15_441_INC_METRICS_H_
+#define PROJECT_2_15_441_INC_METRICS_H_
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+// Number of peer hosts remembered. The least recently stored entry is
+// replaced when the cache is full.
+#define METRICS_CACHE_SIZE 64
+
+// Age after which an entry is ignored.
+#define METRICS_MAX_AGE_US (UINT64_C(3600) * 1000000)
+
+/**
+ * What a connection learned about its peer.
+ */
+typedef struct {
+  uint64_t srtt_us;    // smoothed RTT
+  uint64_t rttvar_us;  // RTT variation
+  uint32_t ssthresh;   // slow start threshold, in bytes
+  uint32_t cwnd;       // congestion window, in bytes
+  uint16_t pmtu;       // largest packet known to get through
+} cmu_metrics_t;
+
+/**
+ * Turns the metrics cache on or off for connections starting from now on.
+ *
+ * It is on by default. The `CMU_METRICS` environment variable sets the same
+ * default when the first connection starts, e.g. `CMU_METRICS=0`.
+ *
+ * @param enabled 1 to start connections from the cache and store what they
+ *                learned, 0 not to.
+ */
+void cmu_set_metrics_cache(int enabled);
+
+/**
+ * Backs the metrics cache with a file, read now and rewritten every time a
+ * connection stores its metrics.
+ *
+ * The cache lives in memory only by default. The `CMU_METRICS_FILE`
+ * environment variable names a file the same way when the first connection
+ * starts. Processes sharing the file each rewrite it with what they know, so
+ * the last one to store wins.
+ *
+ * @param path The file, or NULL to keep the cache in memory only.
+ */
+void cmu_set_metrics_file(const char* path);
+
+/**
+ * Looks up what earlier connections learned about a peer host.
+ *
+ * @param peer The peer's address. Only the IP address is used.
+ * @param m Set to the metrics, aged, if there are any.
+ *
+ * @return 1 if usable metrics were found, 0 if there are none, they are too
+ *         old or the cache is off.
+ */
+int metrics_get(const struct sockaddr_in* peer, cmu_metrics_t* m);
+
+/**
+ * Stores what a connection learned about its peer host, replacing what was
+ * known.
+ *
+ * @param peer The peer's address. Only the IP address is used.
+ * @param m The metrics.
+ */
+void metrics_put(const struct sockaddr_in* peer, const cmu_metrics_t* m);
+
+#endif  // PROJECT_2_15_441_INC_METRICS_H_
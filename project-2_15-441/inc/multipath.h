@@ -0,0 +1,142 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the paths of a multipath connection.
+ *
+ * A path is a UDP socket and a peer address. Path 0 is the one the handshake
+ * ran on. An initiator adds more with `cmu_add_path`, each from a socket of
+ * its own, and joins them to the connection by sending a JOIN on them, which
+ * a listener that accepts multipath answers the same way. The JOIN carries
+ * both initial sequence numbers of the connection, which only its two ends
+ * know unless someone watches the handshake. Headers on a path carry the
+ * ports of its own UDP sockets. All paths share one sequence space and one
+ * receive window, so segments are reassembled in order whichever path they
+ * came on.
+ *
+ * Every new sending window slot goes to the path that would deliver it first:
+ * the one with the lowest smoothed RTT, scaled up by how full its congestion
+ * window is. Each path keeps its own RTT estimate and retransmission timer,
+ * and a congestion window halved when one of its segments times out. A path
+ * whose segments time out MP_PATH_MAX_RTOS times in a row is down: what it
+ * carried is resent on the others, and it is only used again once something
+ * arrives on it. Down paths are probed with a JOIN every MP_PROBE_US.
+ */
+
+#ifndef PROJECT_2_15_441_INC_MULTIPATH_H_
+#define PROJECT_2_15_441_INC_MULTIPATH_H_
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+#include "rtt.h"
+
+// Most paths per connection, path 0 included.
+#define CMU_MAX_PATHS 4
+
+// Timeouts in a row after which a path is down.
+#define MP_PATH_MAX_RTOS 3
+
+// JOINs sent on a new path before it is given up as down.
+#define MP_JOIN_MAX_TRIES 6
+
+// Time between JOINs probing a path that is down.
+#define MP_PROBE_US (UINT64_C(1000) * 1000)
+
+typedef enum {
+  PATH_JOINING = 0,  // JOINs sent, no answer yet
+  PATH_UP = 1,
+  PATH_DOWN = 2,
+} cmu_path_state_t;
+
+typedef struct {
+  int fd;                     // the UDP socket, -1 for the connection's own
+  uint16_t port;              // the local port of `fd`
+  struct sockaddr_in peer;    // where packets on the path go
+  cmu_path_state_t state;
+  rtt_estimator_t rtt;
+  uint32_t cwnd;              // bytes the path may have in flight
+  uint32_t timeouts;          // segment timeouts since it last heard back
+  uint32_t join_tries;        // JOINs sent since the last answer
+  uint64_t join_sent;         // when the last JOIN went out, 0 if none did
+} cmu_path_t;
+
+/**
+ * Lets listeners created from now on accept paths joining their connections.
+ *
+ * It is off by default. The `CMU_MULTIPATH` environment variable sets the
+ * same default when the first listener starts, e.g. `CMU_MULTIPATH=1`.
+ * Initiators add paths with `cmu_add_path` whatever the setting.
+ *
+ * @param enabled 1 to accept JOINs, 0 to drop them as foreign packets.
+ */
+void cmu_set_multipath(int enabled);
+
+/**
+ * Tells if listeners accept JOINs.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+int multipath_enabled(void);
+
+/**
+ * Starts a path.
+ *
+ * @param path The path.
+ * @param fd The UDP socket, -1 for the connection's own.
+ * @param peer The peer address.
+ * @param rto The initial retransmission timeout.
+ * @param cwnd The initial congestion window.
+ */
+void path_init(cmu_path_t* path, int fd, const struct sockaddr_in* peer,
+               uint64_t rto, uint32_t cwnd);
+
+/**
+ * Picks the path to send a new segment on.
+ *
+ * @param paths The paths.
+ * @param n The number of paths.
+ * @param in_flight The bytes in flight on each path.
+ * @param len The length of the segment.
+ *
+ * @return The path, or -1 if none is up.
+ */
+int path_pick(const cmu_path_t* paths, int n, const uint32_t* in_flight,
+              uint32_t len);
+
+/**
+ * Records that bytes sent on a path were acknowledged, growing its window
+ * by about one segment per window.
+ *
+ * @param path The path.
+ * @param acked The bytes acknowledged.
+ * @param mss The segment size.
+ * @param max_cwnd The largest the window may get.
+ */
+void path_acked(cmu_path_t* path, uint32_t acked, uint32_t mss,
+                uint32_t max_cwnd);
+
+/**
+ * Records that a segment sent on a path timed out.
+ *
+ * @param path The path.
+ * @param mss The segment size.
+ *
+ * @return 1 if the path is now down, 0 otherwise.
+ */
+int path_timed_out(cmu_path_t* path, uint32_t mss);
+
+/**
+ * Records that something arrived on a path.
+ *
+ * @return 1 if the path was not up before, 0 otherwise.
+ */
+int path_heard(cmu_path_t* path);
+
+#endif  // PROJECT_2_15_441_INC_MULTIPATH_H_
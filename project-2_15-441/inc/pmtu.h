@@ -0,0 +1,166 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines packetization layer path MTU discovery, following the
+ * datagram variant of RFC 8899.
+ *
+ * Discovery is off by default, since the course's tests expect no packet to
+ * exceed MAX_LEN. When it is on, packets are sent with DF set and never
+ * fragmented. A connection starts out with MAX_LEN byte packets and probes
+ * for larger ones with padding-only packets the peer acknowledges. A probe
+ * that gets no answer after PMTU_MAX_PROBES tries is taken to be too large;
+ * losing a probe costs no data. Retransmission timeouts that keep coming
+ * without progress mean the path does not carry the current length, and
+ * send the connection down to the smaller PMTU_BASE_LEN, from where probes
+ * search again. Should even that get lost, the connection clears DF and lets
+ * the network fragment its packets. Lengths are UDP payload lengths, i.e. a
+ * packet's `plen`.
+ */
+
+#ifndef PROJECT_2_15_441_INC_PMTU_H_
+#define PROJECT_2_15_441_INC_PMTU_H_
+
+#include <stdint.h>
+
+#include "grading.h"
+
+// The packet length every path is assumed to carry, BASE_PLPMTU in RFC 8899,
+// which black-hole detection falls back to.
+#define PMTU_BASE_LEN 1200
+
+// The packet length a connection starts out at. The course's networks carry
+// it, but a path with tunnels on it may not.
+#define PMTU_START_LEN MAX_LEN
+
+// The largest packet length probed for: a 9000 byte jumbo frame less the IP
+// and UDP headers.
+#define PMTU_MAX_LEN 8972
+
+// A 1500 byte Ethernet frame less the IP and UDP headers, probed before
+// searching below a failed jumbo probe since it is by far the most common.
+#define PMTU_ETHERNET_LEN 1472
+
+// Times a probe is sent before its length is taken to be too large.
+#define PMTU_MAX_PROBES 3
+
+// The search stops once the largest working length and the smallest failing
+// one are this close.
+#define PMTU_SEARCH_STEP 16
+
+// Retransmission timeouts in a row, without any new data acknowledged, after
+// which packets of the current path MTU are taken to be black-holed.
+#define PMTU_BLACK_HOLE_RTOS 2
+
+// How long a finished search holds before probing for a larger path MTU
+// again, PMTU_RAISE_TIMER in RFC 8899.
+#define PMTU_RAISE_US (UINT64_C(600) * 1000000)
+
+typedef struct {
+  uint8_t enabled;      // probe at all, or stay at PMTU_START_LEN
+  uint8_t fragment;     // DF cleared, since even PMTU_BASE_LEN got lost
+  uint16_t plpmtu;      // the largest packet length known to get through
+  uint16_t ceiling;     // the smallest length assumed not to get through
+  uint16_t probe_size;  // the length being probed, 0 if none
+  uint8_t probe_count;  // times a probe of probe_size has been sent
+  uint64_t probe_time;  // when the last probe was sent
+  uint64_t raise_time;  // when a finished search starts over, 0 if running
+  uint32_t rtos;        // timeouts in a row since the last progress
+} pmtu_t;
+
+/**
+ * Turns path MTU discovery on or off for sockets created from now on.
+ *
+ * It is off by default. The `CMU_PMTUD` environment variable sets the same
+ * default when the first socket is created, e.g. `CMU_PMTUD=1`.
+ *
+ * @param enabled 1 to probe for packets longer than MAX_LEN, 0 to never send
+ *                any.
+ */
+void cmu_set_pmtu_discovery(int enabled);
+
+/**
+ * Tells if sockets created now discover the path MTU.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+int pmtu_discovery_enabled(void);
+
+/**
+ * Initializes the search of a new connection.
+ *
+ * @param pmtu The search state to initialize.
+ * @param enabled 1 to search, 0 to stay at PMTU_START_LEN.
+ */
+void pmtu_init(pmtu_t* pmtu, int enabled);
+
+/**
+ * Starts a new connection's search from a path MTU an earlier connection to
+ * the same host found, rather than from PMTU_START_LEN. Black-hole detection
+ * still sends it down to PMTU_BASE_LEN if the path no longer carries it.
+ *
+ * @param pmtu The search state, just initialized.
+ * @param plpmtu The path MTU found earlier.
+ */
+void pmtu_resume(pmtu_t* pmtu, uint16_t plpmtu);
+
+/**
+ * Tells if a probe is due and of what length. Gives up on the outstanding
+ * probe once it has been sent PMTU_MAX_PROBES times without an answer. Must
+ * be called again whenever the state changes, e.g. once a probe is answered.
+ *
+ * @param pmtu The search state.
+ * @param now The current time on the CMU-TCP clock.
+ * @param rto How long to wait for a probe to be acknowledged.
+ *
+ * @return The length of the probe to send now, 0 if none is due.
+ */
+uint16_t pmtu_next_probe(pmtu_t* pmtu, uint64_t now, uint64_t rto);
+
+/**
+ * Records that the peer received a probe.
+ *
+ * @param pmtu The search state.
+ * @param size The length of the probe.
+ *
+ * @return 1 if the path MTU grew, 0 otherwise.
+ */
+int pmtu_probe_acked(pmtu_t* pmtu, uint16_t size);
+
+/**
+ * Records that new data was acknowledged.
+ *
+ * @param pmtu The search state.
+ */
+void pmtu_progress(pmtu_t* pmtu);
+
+/**
+ * Records a retransmission timeout. After PMTU_BLACK_HOLE_RTOS of them in a
+ * row, falls back to PMTU_BASE_LEN and searches again below the length that
+ * stopped getting through. If packets of PMTU_BASE_LEN got lost as well, sets
+ * `fragment` and stops searching; the caller then has to clear DF.
+ *
+ * @param pmtu The search state.
+ *
+ * @return 1 if the path MTU dropped or `fragment` got set, 0 otherwise.
+ */
+int pmtu_timeout(pmtu_t* pmtu);
+
+/**
+ * Gets when `pmtu_next_probe` has something to do next, provided it was
+ * called since the state last changed.
+ *
+ * @param pmtu The search state.
+ * @param rto How long to wait for a probe to be acknowledged.
+ *
+ * @return The time on the CMU-TCP clock, or 0 if nothing is scheduled.
+ */
+uint64_t pmtu_deadline(const pmtu_t* pmtu, uint64_t rto);
+
+#endif  // PROJECT_2_15_441_INC_PMTU_H_
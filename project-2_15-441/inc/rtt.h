@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the round-trip time estimator used to compute the
+ * retransmission timeout, following RFC 6298. All times are in microseconds
+ * and all arithmetic is done on integers.
+ */
+
+#ifndef PROJECT_2_15_441_INC_RTT_H_
+#define PROJECT_2_15_441_INC_RTT_H_
+
+#include <stdint.h>
+
+// Bounds for the retransmission timeout. The lower bound is well below the
+// 1 s of RFC 6298 so that timeouts stay tight on fast networks.
+#ifndef RTT_MIN_RTO_US
+#define RTT_MIN_RTO_US UINT64_C(200000)  // 200 ms
+#endif
+#define RTT_MAX_RTO_US UINT64_C(60000000)  // 60 s
+
+typedef struct {
+  uint64_t srtt;     // smoothed RTT, 0 until the first sample
+  uint64_t rttvar;   // RTT variation
+  uint64_t latest;   // the most recent sample
+  uint64_t min_rtt;  // the smallest sample seen, 0 until the first sample
+  uint64_t rto;      // retransmission timeout, including any backoff
+  uint32_t backoff;  // number of times the timeout has been doubled
+} rtt_estimator_t;
+
+/**
+ * Initializes an estimator that has not seen any samples yet.
+ *
+ * @param rtt The estimator to initialize.
+ * @param initial_rto The timeout to use until the first sample arrives.
+ */
+void rtt_init(rtt_estimator_t* rtt, uint64_t initial_rto);
+
+/**
+ * Feeds a new RTT measurement into the estimator and recomputes the timeout.
+ *
+ * Callers must only pass unambiguous samples: ones dated by an echoed
+ * timestamp or, following Karn's rule, ones taken from packets that were not
+ * retransmitted. A new sample also clears any backoff.
+ *
+ * @param rtt The estimator to update.
+ * @param sample The measured round-trip time.
+ */
+void rtt_sample(rtt_estimator_t* rtt, uint64_t sample);
+
+/**
+ * Doubles the retransmission timeout after it expires.
+ *
+ * @param rtt The estimator to update.
+ */
+void rtt_backoff(rtt_estimator_t* rtt);
+
+#endif  // PROJECT_2_15_441_INC_RTT_H_
@@ -0,0 +1,42 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines SipHash-2-4, the keyed hash CMU-TCP uses to derive values
+ * that a peer must not be able to predict or forge, such as fast open and SYN cookies.
+ */
+
+#ifndef PROJECT_2_15_441_INC_SIPHASH_H_
+#define PROJECT_2_15_441_INC_SIPHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIPHASH_KEY_LEN 16
+
+/**
+ * Computes SipHash-2-4 of a message.
+ *
+ * @param key The 16 byte secret key.
+ * @param data The message.
+ * @param len The length of the message.
+ *
+ * @return The 64 bit hash.
+ */
+uint64_t siphash24(const uint8_t key[SIPHASH_KEY_LEN], const void* data,
+                   size_t len);
+
+/**
+ * Picks a random key, for a secret that lasts as long as the process.
+ *
+ * @param key Where to store the 16 byte key.
+ */
+void siphash_random_key(uint8_t key[SIPHASH_KEY_LEN]);
+
+#endif  // PROJECT_2_15_441_INC_SIPHASH_H_
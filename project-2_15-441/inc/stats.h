@@ -0,0 +1,90 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the per-connection counters behind `cmu_get_stats`.
+ *
+ * Only the backend thread writes the counters, so an update is a relaxed load
+ * and store rather than a locked read-modify-write. Readers may run on any
+ * thread and see each value atomically.
+ */
+
+#ifndef PROJECT_2_15_441_INC_STATS_H_
+#define PROJECT_2_15_441_INC_STATS_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+typedef struct {
+  // Counters.
+  _Atomic uint64_t bytes_sent;             // payload bytes, retransmits too
+  _Atomic uint64_t segments_sent;          // data packets, retransmits too
+  _Atomic uint64_t bytes_retransmitted;
+  _Atomic uint64_t segments_retransmitted;
+  _Atomic uint64_t rto_expirations;
+  _Atomic uint64_t bytes_acked;
+  _Atomic uint64_t dup_acks;
+  _Atomic uint64_t bytes_received;         // payload bytes, duplicates too
+  _Atomic uint64_t segments_received;      // data packets, duplicates too
+  _Atomic uint64_t out_of_order;           // data packets ahead of a gap
+  _Atomic uint64_t dup_segments;           // data packets already delivered
+  _Atomic uint64_t window_limited_us;      // time with data but no window
+  _Atomic uint64_t syn_cookies_sent;       // stateless SYN-ACKs
+  _Atomic uint64_t syn_cookies_rejected;   // handshake ACKs with a bad cookie
+  _Atomic uint64_t foreign_packets;        // packets not from the peer
+  _Atomic uint64_t keepalive_probes;
+  _Atomic uint64_t pmtu_probes;            // path MTU probes, resends too
+  _Atomic uint64_t checksum_errors;        // packets with a bad CRC32C
+  _Atomic uint64_t malformed_packets;      // bad identifier, port or lengths
+  _Atomic uint64_t compress_raw_bytes;     // stream bytes before compression
+  _Atomic uint64_t compress_wire_bytes;    // and after, frame headers too
+  _Atomic uint64_t compress_stored_blocks;
+  _Atomic uint64_t fec_repairs_sent;
+  _Atomic uint64_t fec_recovered;          // data packets rebuilt from repairs
+  _Atomic uint64_t path_failovers;
+  _Atomic uint64_t ecn_ce_received;        // data packets marked CE
+  _Atomic uint64_t ecn_reductions;         // window cuts for echoed marks
+
+  // Gauges, published by the backend whenever they change.
+  _Atomic uint64_t srtt_us;
+  _Atomic uint64_t rttvar_us;
+  _Atomic uint64_t rto_us;
+  _Atomic uint64_t min_rtt_us;
+  _Atomic uint32_t cwnd;
+  _Atomic uint32_t ssthresh;
+  _Atomic uint32_t peer_window;
+  _Atomic uint32_t bytes_in_flight;
+  _Atomic uint32_t pmtu;
+  _Atomic uint32_t paths_up;
+} cmu_counters_t;
+
+/**
+ * Adds to a counter. Must only be called from the backend thread.
+ */
+#define STAT_ADD(counters, field, n)                                      \
+  atomic_store_explicit(                                                  \
+      &(counters)->field,                                                 \
+      atomic_load_explicit(&(counters)->field, memory_order_relaxed) + (n), \
+      memory_order_relaxed)
+
+#define STAT_INC(counters, field) STAT_ADD(counters, field, 1)
+
+/**
+ * Publishes the current value of a gauge.
+ */
+#define STAT_SET(counters, field, v) \
+  atomic_store_explicit(&(counters)->field, (v), memory_order_relaxed)
+
+/**
+ * Reads a counter or gauge from any thread.
+ */
+#define STAT_GET(counters, field) \
+  atomic_load_explicit(&(counters)->field, memory_order_relaxed)
+
+#endif  // PROJECT_2_15_441_INC_STATS_H_
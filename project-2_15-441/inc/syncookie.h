@@ -0,0 +1,83 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines SYN cookies, which let a listener answer a SYN without
+ * remembering anything about it.
+ *
+ * The SYN-ACK's sequence number is the cookie: the top 8 bits are a coarse
+ * time counter and the low 24 bits a keyed hash of the client's address and
+ * port, the listener's port, the client's initial sequence number and the
+ * counter. The final ACK acknowledges cookie + 1 and carries the client's
+ * initial sequence number + 1, so the listener can check it and only then
+ * commit to the connection. A flood of SYNs from forged addresses therefore
+ * costs the listener one SYN-ACK each and no state.
+ *
+ * Having no state, the listener cannot retransmit its SYN-ACK either. If the
+ * final ACK is lost, the connection only gets going once the client sends
+ * data or a FIN; a client waiting for the server to speak first waits for
+ * good. Cookies are therefore off unless asked for.
+ */
+
+#ifndef PROJECT_2_15_441_INC_SYNCOOKIE_H_
+#define PROJECT_2_15_441_INC_SYNCOOKIE_H_
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+// Seconds covered by one tick of the cookie's time counter. A cookie is
+// accepted during the tick it was made in and the next one.
+#define SYNCOOKIE_PERIOD_SEC 64
+
+/**
+ * Turns SYN cookies on or off for listeners created from now on.
+ *
+ * They are off by default. The `CMU_SYNCOOKIES` environment variable sets the
+ * same default when the first listener starts, e.g. `CMU_SYNCOOKIES=1`.
+ *
+ * @param enabled 1 to answer SYNs statelessly, 0 to keep per-SYN state and
+ *                retransmit SYN-ACKs.
+ */
+void cmu_set_syn_cookies(int enabled);
+
+/**
+ * Tells if listeners use SYN cookies.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+int syncookie_enabled(void);
+
+/**
+ * Computes the initial sequence number to answer a SYN with.
+ *
+ * @param client The client's address.
+ * @param local_port The listener's port.
+ * @param client_isn The sequence number of the client's SYN.
+ *
+ * @return The cookie.
+ */
+uint32_t syncookie_make(const struct sockaddr_in* client, uint16_t local_port,
+                        uint32_t client_isn);
+
+/**
+ * Checks the cookie acknowledged by what should be a handshake's final ACK.
+ *
+ * @param client The client's address.
+ * @param local_port The listener's port.
+ * @param client_isn The sequence number of the client's SYN, i.e. the ACK's
+ *                   sequence number - 1.
+ * @param cookie The cookie, i.e. the ACK's acknowledgement number - 1.
+ *
+ * @return 1 if the cookie is one we made recently for this client, 0
+ *         otherwise.
+ */
+int syncookie_check(const struct sockaddr_in* client, uint16_t local_port,
+                    uint32_t client_isn, uint32_t cookie);
+
+#endif  // PROJECT_2_15_441_INC_SYNCOOKIE_H_
@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file defines the per-connection binary event trace.
+ *
+ * When tracing is on, every connection records fixed-size events (sends,
+ * ACKs, retransmissions, RTT samples, window changes, ...) into a
+ * preallocated ring. A writer thread drains the ring to a file in the
+ * background, so recording an event never formats, allocates or blocks.
+ * `utils/trace_export` turns a trace file into CSV or JSON for plotting.
+ *
+ * A trace file is a `cmu_trace_header_t` followed by `cmu_trace_event_t`
+ * records, all in host byte order.
+ */
+
+#ifndef PROJECT_2_15_441_INC_TRACE_H_
+#define PROJECT_2_15_441_INC_TRACE_H_
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "CMUTRACE"
+#define TRACE_VERSION 1
+
+// Number of events buffered per connection. Must be a power of two. Events
+// recorded while the ring is full are dropped and counted.
+#define TRACE_RING_SIZE 16384
+
+// How often the writer thread drains the ring, in milliseconds.
+#define TRACE_FLUSH_MS 20
+
+typedef enum {
+  TRACE_SEND = 1,    // new data segment: seq, len
+  TRACE_RETRANSMIT,  // segment declared lost and resent: seq, len,
+                     // value = time since its last transmission in us
+  TRACE_ACK,         // new cumulative ACK: seq = ack, len = bytes acked
+  TRACE_DUP_ACK,     // duplicate ACK: seq = ack
+  TRACE_RECV,        // data segment received: seq, len, value = next expected
+  TRACE_RTO,         // retransmission timer expired: value = backed off RTO
+  TRACE_RTT,         // RTT sample: len = sample, value = SRTT, both in us
+  TRACE_CWND,        // congestion window set: value = ssthresh
+  TRACE_WINDOW,      // peer advertised a new window: value = window
+  TRACE_EVENT_MAX
+} cmu_trace_event_type_t;
+
+typedef struct {
+  char magic[8];        // TRACE_MAGIC, not NUL terminated
+  uint32_t version;     // TRACE_VERSION
+  uint32_t event_size;  // sizeof(cmu_trace_event_t)
+  uint16_t local_port;
+  uint16_t peer_port;
+  uint32_t role;        // TCP_INITIATOR or TCP_LISTENER
+  uint64_t start_us;    // CMU-TCP clock when the trace was opened
+} cmu_trace_header_t;
+
+typedef struct {
+  uint64_t time_us;     // CMU-TCP clock
+  uint32_t type;        // cmu_trace_event_type_t
+  uint32_t seq;
+  uint32_t len;
+  uint32_t cwnd;        // congestion window when the event was recorded
+  uint32_t in_flight;   // bytes in flight when the event was recorded
+  uint32_t value;       // depends on the type, see above
+} cmu_trace_event_t;
+
+typedef struct cmu_trace cmu_trace_t;
+
+/**
+ * Sets where connections opened from now on write their trace.
+ *
+ * Each connection writes to `<prefix>.<local port>.trace`. The `CMU_TRACE`
+ * environment variable sets the same prefix when the first connection is
+ * established, e.g. `CMU_TRACE=/tmp/run1`.
+ *
+ * @param prefix The path prefix, or NULL to turn tracing off.
+ */
+void cmu_set_trace_prefix(const char* prefix);
+
+/**
+ * Opens the trace of a newly established connection.
+ *
+ * @param local_port The local port, used in the file name.
+ * @param peer_port The peer's port.
+ * @param role TCP_INITIATOR or TCP_LISTENER.
+ *
+ * @return The trace, or NULL if tracing is off or the file cannot be opened.
+ */
+cmu_trace_t* trace_open(uint16_t local_port, uint16_t peer_port,
+                        uint32_t role);
+
+/**
+ * Writes out the events still in the ring, stops the writer thread and frees
+ * the trace.
+ *
+ * @param trace The trace, may be NULL.
+ */
+void trace_close(cmu_trace_t* trace);
+
+/**
+ * Records an event. Only one thread may record into a given trace.
+ *
+ * @param trace The trace.
+ * @param type The event type.
+ * @param seq The sequence or acknowledgement number.
+ * @param len The length.
+ * @param cwnd The current congestion window.
+ * @param in_flight The current number of bytes in flight.
+ * @param value The type dependent value.
+ */
+void trace_record(cmu_trace_t* trace, cmu_trace_event_type_t type, uint32_t seq,
+                  uint32_t len, uint32_t cwnd, uint32_t in_flight,
+                  uint32_t value);
+
+/**
+ * Gets the name of an event type, e.g. "send".
+ *
+ * @param type The event type.
+ *
+ * @return The name, or "unknown".
+ */
+const char* trace_event_name(uint32_t type);
+
+#endif  // PROJECT_2_15_441_INC_TRACE_H_
@@ -15,30 +15,128 @@
  * in this file.
  */
 
+#define _GNU_SOURCE  // recvmmsg
+
 #include "backend.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <sys/random.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include "clock.h"
+#include "cmu_options.h"
 #include "cmu_packet.h"
 #include "cmu_tcp.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "ecn.h"
+#include "fastopen.h"
+#include "fec.h"
+#include "header_codec.h"
+#include "link.h"
+#include "log.h"
+#include "metrics.h"
+#include "multipath.h"
+#include "pmtu.h"
+#include "rtt.h"
+#include "stats.h"
+#include "syncookie.h"
+#include "trace.h"
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define FALSE 0
 #define TRUE 1
 
-//use for RTT
-#define ALPHA 0.125
-#define BETA 0.25
+// The largest payload a packet can arrive with.
+#define MAX_PAYLOAD_LEN (PMTU_MAX_LEN - sizeof(cmu_tcp_header_t))
+
+// Datagrams read with one `recvmmsg` call.
+#define RECV_BATCH 16
+
+// Free segments kept around for reuse instead of going back to malloc.
+#define SEGMENT_POOL_MAX 64
+
+// Times our FIN is resent before the connection is given up on.
+#define FIN_MAX_RETRIES 8
+
+// Times a SYN or SYN-ACK is resent before the handshake is given up on.
+#define SYN_MAX_RETRIES 6
+
+// Times in a row the retransmission timer of data may expire before the
+// connection is given up on. Like Linux's tcp_retries2, with the backoff this
+// is many minutes; once the application closed the socket, FIN_MAX_RETRIES
+// is the limit instead.
+#define DATA_MAX_RETRIES 15
+
+// TIME_WAIT lasts this many RTOs, enough to answer the peer's retransmitted
+// FIN if our last ACK is lost.
+#define TIME_WAIT_RTOS 2
+
+// How long a closed socket waits for the peer's FIN before giving up.
+#define FIN_WAIT_2_TIMEOUT_US (10 * USEC_PER_SEC)
 
-//time out 
-#define TIMEOUT_MILLSEC 3000
+cmu_segment_t *segment_get(cmu_socket_t *sock) {
+  cmu_segment_t *seg = sock->segment_pool;
+  if (seg != NULL) {
+    sock->segment_pool = seg->next;
+    sock->segment_pool_len--;
+  } else {
+    seg = malloc(sizeof(cmu_segment_t) + MSS);
+    if (seg == NULL) {
+      return NULL;
+    }
+    seg->size = MSS;
+  }
+  seg->next = NULL;
+  seg->len = 0;
+  seg->off = 0;
+  return seg;
+}
+
+void segment_put(cmu_socket_t *sock, cmu_segment_t *seg) {
+  if (sock->segment_pool_len >= SEGMENT_POOL_MAX) {
+    free(seg);
+    return;
+  }
+  seg->next = sock->segment_pool;
+  sock->segment_pool = seg;
+  sock->segment_pool_len++;
+}
+
+/**
+ * Makes sure a segment has room for `len` bytes, as packets grow past MSS
+ * once a larger path MTU is found. Must be called with `recv_lock` held.
+ *
+ * @param sock The socket owning the pool.
+ * @param seg The segment, or NULL to take one from the pool.
+ * @param len The number of bytes it must hold.
+ *
+ * @return The segment, possibly moved, or NULL on failure.
+ */
+static cmu_segment_t *segment_fit(cmu_socket_t *sock, cmu_segment_t *seg,
+                                  uint32_t len) {
+  if (seg == NULL) {
+    seg = segment_get(sock);
+  }
+  if (seg != NULL && seg->size < len) {
+    cmu_segment_t *bigger = realloc(seg, sizeof(cmu_segment_t) + len);
+    if (bigger == NULL) {
+      free(seg);
+      return NULL;
+    }
+    bigger->size = len;
+    seg = bigger;
+  }
+  return seg;
+}
 
 /**
  * Tells if a given sequence number has been acknowledged by the socket.
@@ -58,476 +156,2631 @@ int has_been_acked(cmu_socket_t *sock, uint32_t seq) {
 }
 
 /**
- * get the window index for seq
+ * Finds the receive window slot holding the segment that starts at seq.
+ * Segments of different streams differ in size, so slots are looked up by
+ * sequence number rather than computed from it.
+ *
+ * @return The slot index, or -1 if that segment has not arrived.
  */
-int get_window_index(uint32_t seq) {
+int find_window_slot(cmu_socket_t *sock, uint32_t seq) {
   uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
-  return seq / MSS % window_size;
+  for (uint32_t i = 0; i < window_size; i++) {
+    receiving_window *slot = &sock->window.received_windows[i];
+    if (slot->payload_len > 0 && slot->seq == seq) {
+      return i;
+    }
+  }
+  return -1;
 }
 
 /**
- * search next_expected_seq = the max seq,
- * and ensure all previous packets are received.
+ * Finds a receive window slot for the segment that starts at seq: one that
+ * holds nothing still to be delivered or, failing that, the one holding the
+ * segment furthest ahead, if seq comes before it. Retransmissions cut for a
+ * smaller path MTU can outnumber the slots, and the segment the receiver
+ * waits for must always find room.
+ *
+ * @return The slot index, or -1 if every slot holds an earlier segment.
  */
-uint32_t get_next_expected_seq(cmu_socket_t *sock) {
-  uint32_t next_expected_seq = sock->window.next_seq_expected;
+int find_free_window_slot(cmu_socket_t *sock, uint32_t seq) {
   uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
-  while (1) {
-    int index = get_window_index(next_expected_seq);
-    if (sock->window.received_windows[index].seq == 0 || sock->window.received_windows[index].seq != next_expected_seq) {
-      break;
+  int furthest = -1;
+  for (uint32_t i = 0; i < window_size; i++) {
+    receiving_window *slot = &sock->window.received_windows[i];
+    if (slot->payload_len == 0 ||
+        !after(slot->seq + slot->payload_len, sock->window.next_seq_expected)) {
+      return i;
+    }
+    if (furthest < 0 ||
+        after(slot->seq, sock->window.received_windows[furthest].seq)) {
+      furthest = i;
     }
+  }
+  if (furthest >= 0 &&
+      after(sock->window.received_windows[furthest].seq, seq)) {
+    sock->window.received_windows[furthest].payload_len = 0;
+    return furthest;
+  }
+  return -1;
+}
+
+uint32_t get_next_expected_seq(cmu_socket_t *sock) {
+  uint32_t next_expected_seq = sock->window.next_seq_expected;
+  int index;
+  while ((index = find_window_slot(sock, next_expected_seq)) >= 0) {
     next_expected_seq += sock->window.received_windows[index].payload_len;
   }
   return next_expected_seq;
 }
 
 /**
- * Updates the socket information to represent the newly received packet.
- *
- * In the current stop-and-wait implementation, this function also sends an
- * acknowledgement for the packet.
- *
- * @param sock The socket used for handling packets received.
- * @param pkt The packet data received by the socket.
+ * Appends an in-order segment to the receive queue of its stream. Must be
+ * called with `recv_lock` held.
  */
-void handle_message(cmu_socket_t *sock, uint8_t *pkt) {
-  cmu_tcp_header_t *hdr = (cmu_tcp_header_t *)pkt;
-  uint8_t flags = get_flags(hdr);
+void queue_segment(cmu_socket_t *sock, uint16_t id, cmu_segment_t *seg) {
+  cmu_stream_t *stream;
 
-  switch (flags) {
-    case ACK_FLAG_MASK: {
-      uint32_t ack = get_ack(hdr);
-      uint32_t seq = get_seq(hdr);
-      if (after(ack, sock->window.last_ack_received)) {
-        
-        sock->window.last_ack_received = ack;
-      }
-      if (sock->state == SYN_RCVD) {
-        sock->state = ESTABLISHED;  // 服务器收到ACK，握手完成
-      }
+  if (id >= CMU_MAX_STREAMS) {
+    LOG_WARN("dropping %u bytes for unknown stream %u", seg->len, id);
+    segment_put(sock, seg);
+    return;
+  }
+  stream = &sock->streams[id];
+  seg->off = 0;
+  seg->next = NULL;
+  if (stream->received_tail != NULL) {
+    stream->received_tail->next = seg;
+  } else {
+    stream->received_head = seg;
+  }
+  stream->received_tail = seg;
+  stream->received_len += seg->len;
+  sock->received_len += seg->len;
+}
+
+/**
+ * Hands an in-order segment to its stream. On a compressed connection the
+ * segment holds frames, or parts of them, and what is queued is the bytes of
+ * each frame it completes. Must be called with `recv_lock` held.
+ */
+void deliver_segment(cmu_socket_t *sock, uint16_t id, cmu_segment_t *seg) {
+  decompressor_t *d;
+  uint32_t off = 0;
+
+  if (sock->compress != COMPRESS_ON || id >= CMU_MAX_STREAMS) {
+    queue_segment(sock, id, seg);
+    return;
+  }
+  d = &sock->streams[id].decompressor;
+  while (off < seg->len) {
+    int taken = decompress_take(d, seg->data + off, seg->len - off);
+    int raw_len;
+    cmu_segment_t *out;
+
+    if (taken < 0) {
+      LOG_ERROR("out of memory, dropping %u bytes of stream %u",
+                seg->len - off, id);
       break;
     }
-    // 服务器端收到SYN，状态切换到SYN_RCVD
-    case SYN_FLAG_MASK: {
-      // FIX: sock->window.last_ack_received = get_ack(hdr);
-      // should be as follow
-      sock->window.next_seq_expected = get_seq(hdr) + 1;
-      sock->state = SYN_RCVD;
-      break;
+    off += taken;
+    raw_len = decompress_ready(d);
+    if (raw_len == 0) {
+      continue;
     }
-    //服务端响应后客户端状态更新
-    case ACK_FLAG_MASK | SYN_FLAG_MASK:
-      sock->window.last_ack_received = get_ack(hdr);
-      sock->window.next_seq_expected = get_seq(hdr) + 1;
-      sock->state = ESTABLISHED;
-      //第三次握手
-      uint8_t *msg = create_packet(
-          sock->my_port, sock->conn.sin_port, sock->window.last_ack_received,
-          sock->window.next_seq_expected, sizeof(cmu_tcp_header_t),
-          sizeof(cmu_tcp_header_t), ACK_FLAG_MASK, 1, 0, NULL, NULL, 0);
-      sendto(sock->socket, msg, sizeof(cmu_tcp_header_t), 0,
-             (struct sockaddr *)&(sock->conn), sizeof(sock->conn));
-      printf("client 第san次握手\n");
-      free(msg);
-      break;
-    default: {
-      // if not established, then ignore data packet
-      if (sock->state != ESTABLISHED) {
-        break;
+    out = raw_len > 0 ? segment_fit(sock, NULL, raw_len) : NULL;
+    if (out == NULL || decompress_finish(d, out->data) < 0) {
+      LOG_ERROR("dropping a frame of stream %u that does not decode", id);
+      decompress_free(d);
+      if (out != NULL) {
+        segment_put(sock, out);
       }
-      socklen_t conn_len = sizeof(sock->conn);
+      continue;
+    }
+    out->len = raw_len;
+    queue_segment(sock, id, out);
+  }
+  segment_put(sock, seg);
+}
 
-      // No payload.
-      uint8_t *payload = get_payload(pkt);
-      uint16_t payload_len = get_payload_len(pkt);
+int store_segment(cmu_socket_t *sock, uint32_t seq, const uint8_t *payload,
+                  uint16_t payload_len, uint16_t stream) {
+  receiving_window *slot;
+  int index;
 
-      // No extension.
-      uint16_t ext_len = 0;
-      uint8_t *ext_data = NULL;
-
-      uint16_t src = sock->my_port;
-      uint16_t dst = ntohs(sock->conn.sin_port);
-      uint32_t seq = get_seq(hdr);
-      uint32_t new_seq = seq + payload_len;
-
-      int index = get_window_index(seq);
-    
-      adjust_sock_rtt(sock,index);
-
-      // copy the packet data receive windows
-      sock->window.received_windows[index].seq = seq;
-      sock->window.received_windows[index].payload_len = payload_len;
-      //realloc(sock->window.received_windows[index].payload,payload);
-      memcpy(sock->window.received_windows[index].payload, payload,
-             payload_len);
-
-      // get the new next expected seq thru received_infos.
-      uint32_t next_expected_seq = get_next_expected_seq(sock);
-      int next_index = get_window_index(next_expected_seq);
-      // the new ACK seq
-
-      uint16_t hlen = sizeof(cmu_tcp_header_t);
-      uint16_t plen = hlen + payload_len;
-      uint8_t flags = ACK_FLAG_MASK;
-      uint16_t adv_window = 1;
-
-      // update the check logic received_buf.
-      // DONE: copy all ready payload to received_buf.
-      uint32_t curr_expected_seq = sock->window.next_seq_expected;
-      uint32_t new_ack = curr_expected_seq;
-    
-      if (curr_expected_seq < next_expected_seq) {
-        new_ack = next_expected_seq +
-                  sock->window.received_windows[next_index].payload_len;
-        // Copy all data between data [curr_expected_seq, next_expected_seq) to
-        // received_buf
-        while (curr_expected_seq < next_expected_seq) {
-          int curr_index = get_window_index(curr_expected_seq);
-          
-          uint32_t payload_len =
-              sock->window.received_windows[curr_index].payload_len;
-          // Make sure there is enough space in the buffer to store the payload.
-          sock->received_buf =
-              realloc(sock->received_buf, sock->received_len + payload_len);
-          memcpy(sock->received_buf + sock->received_len, sock->window.received_windows[curr_index].payload, payload_len);
-          sock->received_len += payload_len;
-          curr_expected_seq += sock->window.received_windows[curr_index].payload_len;
-        }
-      }
+  // Only buffer segments inside the receive window, so that an old
+  // duplicate cannot take a slot a future segment needs.
+  if (payload_len > MAX_PAYLOAD_LEN ||
+      !between(seq, sock->window.next_seq_expected,
+               sock->window.next_seq_expected +
+                   WINDOW_INITIAL_WINDOW_SIZE / MSS * MAX_PAYLOAD_LEN - 1) ||
+      find_window_slot(sock, seq) >= 0 ||
+      (index = find_free_window_slot(sock, seq)) < 0) {
+    return 0;
+  }
+  slot = &sock->window.received_windows[index];
+  slot->segment = segment_fit(sock, slot->segment, payload_len);
+  if (slot->segment == NULL) {
+    return 0;
+  }
+  // copy the packet data receive windows
+  slot->seq = seq;
+  slot->payload_len = payload_len;
+  slot->stream = stream;
+  memcpy(slot->segment->data, payload, payload_len);
+  return 1;
+}
 
-      uint8_t *response_packet =
-          create_packet(src, dst, seq, new_ack, hlen, plen, flags, adv_window,
-                        ext_len, ext_data, payload, payload_len);
-      sendto(sock->socket, response_packet, plen, 0,
-             (struct sockaddr *)&(sock->conn), conn_len);
-      free(response_packet);
-      sock->window.next_seq_expected = next_expected_seq;
-    }
+uint32_t deliver_window(cmu_socket_t *sock) {
+  // get the new next expected seq thru received_infos.
+  uint32_t next_expected_seq = get_next_expected_seq(sock);
+  uint32_t curr_expected_seq = sock->window.next_seq_expected;
+
+  while (before(curr_expected_seq, next_expected_seq)) {
+    receiving_window *ready = &sock->window.received_windows[find_window_slot(
+        sock, curr_expected_seq)];
+    cmu_segment_t *seg = ready->segment;
+    seg->len = ready->payload_len;
+    curr_expected_seq += ready->payload_len;
+    deliver_segment(sock, ready->stream, seg);
+    ready->payload_len = 0;
+    ready->segment = segment_get(sock);
   }
+  return next_expected_seq;
 }
 
 /**
- * Checks if the socket received any data.
- *
- * It first peeks at the header to figure out the length of the packet and then
- * reads the entire packet.
+ * Writes the CRC32C of a packet into its CRC32C option, which must be the last
+ * option and hold 0 so far.
  *
- * @param sock The socket used for receiving data on the connection.
- * @param flags Flags that determine how the socket should wait for data. Check
- *             `cmu_read_mode_t` for more information.
+ * @param msg The packet.
+ * @param hlen The length of its header, extension included.
+ * @param plen The length of the packet.
  */
-void check_for_data(cmu_socket_t *sock, cmu_read_mode_t flags) {
-  cmu_tcp_header_t hdr;
-  uint8_t *pkt;
-  socklen_t conn_len = sizeof(sock->conn);
-  ssize_t len = 0;
-  uint32_t plen = 0, buf_size = 0, n = 0;
+void stamp_crc32c(uint8_t *msg, uint16_t hlen, uint16_t plen) {
+  uint32_t crc = htonl(crc32c(0, msg, plen));
+  memcpy(msg + hlen - sizeof(crc), &crc, sizeof(crc));
+}
 
-  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+/**
+ * Gets the UDP socket a path sends from.
+ */
+int path_fd(cmu_socket_t *sock, int path) {
+  return path == 0 || sock->paths[path].fd < 0 ? sock->socket
+                                               : sock->paths[path].fd;
+}
+
+/**
+ * Gets the local port of the UDP socket a path sends from.
+ */
+uint16_t path_port(cmu_socket_t *sock, int path) {
+  return path == 0 || sock->paths[path].fd < 0 ? sock->my_port
+                                               : sock->paths[path].port;
+}
+
+/**
+ * Gets the address a path sends to.
+ */
+const struct sockaddr_in *path_peer(cmu_socket_t *sock, int path) {
+  return path == 0 ? &sock->conn : &sock->paths[path].peer;
+}
+
+/**
+ * Gets the path packets that do not belong to one go on: the one the last
+ * packet came on if it is up, since it works both ways, or else the first
+ * that is up, or path 0 if none is.
+ */
+int default_path(cmu_socket_t *sock) {
+  int n = sock->npaths;
+  if (sock->paths[sock->rx_path].state == PATH_UP) {
+    return sock->rx_path;
   }
-  switch (flags) {
-    case NO_FLAG:
-      len = recvfrom(sock->socket, &hdr, sizeof(cmu_tcp_header_t), MSG_PEEK,
-                     (struct sockaddr *)&(sock->conn), &conn_len);
-      break;
-    case TIMEOUT: {
-      // Using `poll` here so that we can specify a timeout.
-      struct pollfd ack_fd;
-      ack_fd.fd = sock->socket;
-      ack_fd.events = POLLIN;
-      // Timeout after 3 seconds.
-      if (poll(&ack_fd, 1, 3000) <= 0) {
-        break;
-      }
+  for (int p = 0; p < n; p++) {
+    if (sock->paths[p].state == PATH_UP) {
+      return p;
     }
-    // Fall through.
-    case NO_WAIT:
-      len = recvfrom(sock->socket, &hdr, sizeof(cmu_tcp_header_t),
-                     MSG_DONTWAIT | MSG_PEEK, (struct sockaddr *)&(sock->conn),
-                     &conn_len);
-      break;
-    default:
-      perror("ERROR unknown flag");
   }
-  
-  if (len >= (ssize_t)sizeof(cmu_tcp_header_t)) {
-    plen = get_plen(&hdr);
-    pkt = malloc(plen);
-    while (buf_size < plen) {
-      n = recvfrom(sock->socket, pkt + buf_size, plen - buf_size, 0,
-                   (struct sockaddr *)&(sock->conn), &conn_len);
-      buf_size = buf_size + n;
-    }
-    handle_message(sock, pkt);
-    free(pkt);
+  return 0;
+}
+
+/**
+ * Publishes the number of paths that are up to the connection statistics.
+ */
+void publish_paths(cmu_socket_t *sock) {
+  int n = sock->npaths;
+  uint32_t up = 0;
+  for (int p = 0; p < n; p++) {
+    up += sock->paths[p].state == PATH_UP;
   }
-  pthread_mutex_unlock(&(sock->recv_lock));
+  STAT_SET(&sock->stats, paths_up, up);
 }
 
 /**
- * Get current milliseconds
- * 
+ * Builds a packet on the stack and sends it to the peer on the current path.
+ *
+ * Unlike `create_packet`, this leaves room for the extension data and does not
+ * allocate.
+ *
+ * @param sock The socket to send from.
+ * @param seq The sequence number.
+ * @param ack The acknowledgement number.
+ * @param flags The flags.
+ * @param ext_data The header extension data.
+ * @param ext_len The header extension length.
+ * @param payload The payload.
+ * @param payload_len The length of the payload.
  */
-uint64_t get_curr_milliseconds() {
-  struct timeval time_now = {0};
-  long time_sec = 0;
-  long time_mil = 0;
+void send_packet(cmu_socket_t *sock, uint32_t seq, uint32_t ack, uint8_t flags,
+                 uint8_t *ext_data, uint16_t ext_len, uint8_t *payload,
+                 uint16_t payload_len) {
+  uint8_t msg[PMTU_MAX_LEN];
+  uint8_t ext[OPT_MAX_LEN + OPT_ECN_ECHO_LEN + OPT_CRC32C_LEN];
+  uint16_t hlen, plen;
+  uint16_t adv_window = 1;
+  // Every ACK echoes the marks so far, so losing some loses none.
+  int echo = sock->ecn == ECN_ON && (flags & ACK_FLAG_MASK);
 
-  gettimeofday(&time_now,NULL);
-  time_sec = time_now.tv_sec;
-  time_mil = time_sec * 1000 + time_now.tv_usec/1000;
-  return time_mil;
+  if (sock->crc32c != CRC32C_OFF || echo) {
+    if (ext_len > 0) {
+      memcpy(ext, ext_data, ext_len);
+    }
+    if (echo) {
+      ext_len += opt_put_ecn_echo(ext + ext_len, sock->ecn_cc.ce_bytes);
+    }
+    if (sock->crc32c != CRC32C_OFF) {
+      ext_len += opt_put_crc32c(ext + ext_len, 0);
+    }
+    ext_data = ext;
+  }
+  hlen = sizeof(cmu_tcp_header_t) + ext_len;
+  plen = hlen + payload_len;
+  if (plen > PMTU_MAX_LEN) {
+    return;
+  }
+  set_header((cmu_tcp_header_t *)msg, sock->my_port,
+             ntohs(path_peer(sock, sock->cur_path)->sin_port), seq, ack, hlen,
+             plen, flags, adv_window, ext_len, ext_data);
+  set_payload(msg, payload, payload_len);
+  if (sock->crc32c != CRC32C_OFF) {
+    stamp_crc32c(msg, hlen, plen);
+  }
+  link_send(sock->link, path_fd(sock, sock->cur_path), msg, plen,
+            path_peer(sock, sock->cur_path));
 }
 
-
 /**
- * Calculate the RTT for current sock
- * TODO: fix me
+ * Records an event in the connection's trace, if it is being traced.
+ *
+ * @param sock The socket the event happened on.
+ * @param type The event type.
+ * @param seq The sequence or acknowledgement number.
+ * @param len The length.
+ * @param value The type dependent value, see `cmu_trace_event_type_t`.
  */
-uint64_t adjust_sock_rtt(cmu_socket_t* sock,int index) { 
-  uint64_t nowTime;
-  nowTime = get_curr_milliseconds();
-  uint64_t sampleRtt = nowTime - sock->window.sending_windows[index].send_time;
-  sock->estRtt = (long)(((float)(1-ALPHA))*sock->estRtt + ALPHA*sampleRtt);
-  sock->devRtt = (long)((1-BETA)*sock->devRtt + BETA*abs(sampleRtt-sock->estRtt));
-  sock->estRto = sock->estRtt + 4*sock->devRtt;
-  printf("sock->estRTO %ld\n",sock->estRto);
-  return sock->estRto; 
+void trace_sock_event(cmu_socket_t *sock, cmu_trace_event_type_t type,
+                      uint32_t seq, uint32_t len, uint32_t value) {
+  if (sock->trace != NULL) {
+    trace_record(sock->trace, type, seq, len, sock->window.cwnd,
+                 STAT_GET(&sock->stats, bytes_in_flight), value);
   }
+}
 
 /**
- * send single packet for special seq and payload
+ * Publishes the estimator's state to the connection statistics.
  */
-void single_send_for_seq(cmu_socket_t *sock, uint8_t *payload,
-                         uint16_t payload_len, uint32_t seq) {
-  uint16_t src = sock->my_port;
-  uint16_t dst = ntohs(sock->conn.sin_port);
-  // uint32_t seq = seq;
-  uint32_t ack = sock->window.next_seq_expected;
-  uint16_t hlen = sizeof(cmu_tcp_header_t);
-  uint16_t plen = hlen + payload_len;
-  uint8_t flags = 0;
-  uint16_t adv_window = 1;
-  uint16_t ext_len = 0;
-  uint8_t *ext_data = NULL;
-  // uint8_t *payload = payload;
-  size_t conn_len = sizeof(sock->conn);
-  uint8_t *msg =
-      create_packet(src, dst, seq, ack, hlen, plen, flags, adv_window, ext_len,
-                    ext_data, payload, payload_len);
-  sendto(sock->socket, msg, plen, 0, (struct sockaddr *)&(sock->conn),
-         conn_len);
-  free(msg);
+void publish_rtt_stats(cmu_socket_t *sock) {
+  LOG_TRACE("rtt srtt=%" PRIu64 " rttvar=%" PRIu64 " rto=%" PRIu64,
+            sock->rtt.srtt, sock->rtt.rttvar, sock->rtt.rto);
+  STAT_SET(&sock->stats, srtt_us, sock->rtt.srtt);
+  STAT_SET(&sock->stats, rttvar_us, sock->rtt.rttvar);
+  STAT_SET(&sock->stats, rto_us, sock->rtt.rto);
+  STAT_SET(&sock->stats, min_rtt_us, sock->rtt.min_rtt);
+}
+
+/**
+ * Feeds an RTT sample to the estimator and publishes the result.
+ */
+void take_rtt_sample(cmu_socket_t *sock, uint64_t sample) {
+  rtt_sample(&sock->rtt, sample);
+  publish_rtt_stats(sock);
+  trace_sock_event(sock, TRACE_RTT, sock->window.last_ack_received,
+                   (uint32_t)sample, (uint32_t)sock->rtt.srtt);
 }
 
 /**
- * Breaks up the data into packets and sends a single packet at a time.
+ * Takes an RTT sample from the packet that a new cumulative ACK completes.
  *
- * You should most certainly update this function in your implementation.
+ * This is only used for ACKs without a timestamp option. Packets that were
+ * retransmitted are skipped, following Karn's rule, since the ACK could belong
+ * to any of their transmissions.
  *
- * @param sock The socket to use for sending data.
- * @param data The data to be sent.
- * @param buf_len The length of the data being sent.
+ * @param sock The socket that received the ACK.
+ * @param ack The acknowledgement number of the ACK.
  */
-void single_send(cmu_socket_t *sock, uint8_t *data, int buf_len) {
-  uint8_t *msg;
-  uint8_t *data_offset = data;
-  size_t conn_len = sizeof(sock->conn);
-
-  int sockfd = sock->socket;
-  if (buf_len > 0) {
-    uint32_t windows_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
-    int32_t i = 1;
-    // the beginning/start, end/finish seq for data.
-    uint32_t seq = sock->window.last_ack_received;
-    uint32_t buf_end_seq = sock->window.last_ack_received + buf_len;
-    // the max seq has been sent
-    uint32_t max_seq_sent = sock->window.last_ack_received;
-    // loop until all sent buf received ACK
-    while (sock->window.last_ack_received < buf_end_seq) {
-      // if have new buf could be sent, and has data not sent
-      if (sock->window.last_ack_received + WINDOW_INITIAL_WINDOW_SIZE >
-              max_seq_sent &&
-          max_seq_sent < buf_end_seq) {
-           
-        uint16_t payload_len =
-            MIN((uint16_t)(buf_len - i * MSS), (uint16_t)MSS);
-        uint16_t src = sock->my_port;
-        uint16_t dst = ntohs(sock->conn.sin_port);
-        // seq += payload_len;
-
-        uint32_t ack = sock->window.next_seq_expected;
-        uint16_t hlen = sizeof(cmu_tcp_header_t);
-        uint16_t plen = hlen + payload_len;
-        uint8_t flags = 0;
-        uint16_t adv_window = 1;
-        uint16_t ext_len = 0;
-        uint8_t *ext_data = NULL;
-        uint8_t *payload = data_offset;
-        single_send_for_seq(sock, payload, payload_len, seq);
-        
-        int j = i % windows_size;
-        sock->window.sending_windows[j].send_time = get_curr_milliseconds();
-        sock->window.sending_windows[j].payload = payload;
-        sock->window.sending_windows[j].payload_len = payload_len;
-        sock->window.sending_windows[j].seq = seq;
+void adjust_sock_rtt(cmu_socket_t *sock, uint32_t ack) {
+  uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+  for (uint32_t i = 0; i < window_size; i++) {
+    sending_window *slot = &sock->window.sending_windows[i];
+    if (slot->send_time > 0 && !slot->retransmitted &&
+        slot->seq + slot->payload_len == ack) {
+      take_rtt_sample(sock, get_curr_micros() - slot->send_time);
+      return;
+    }
+  }
+}
 
-        seq += payload_len;
-        data_offset += payload_len;
-        max_seq_sent += payload_len;
+int data_mss(cmu_socket_t *sock, uint16_t stream);
 
-        i++;
-      }
-      // check data without waiting..
-        check_for_data(sock, NO_WAIT);
+/**
+ * Grows the congestion windows of the paths that carried bytes a new
+ * cumulative ACK covers.
+ *
+ * @param sock The socket that received the ACK.
+ * @param from The previous acknowledgement number.
+ * @param to The new one.
+ */
+void credit_paths(cmu_socket_t *sock, uint32_t from, uint32_t to) {
+  uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+  int mss = data_mss(sock, 0);
 
-      // try to resend all timeout with more than 3 RTT or timeout after 3 seconds
-      for (int j = 0; j < windows_size; j++) {
-        if (sock->window.sending_windows[j].send_time > 0 &&
-            sock->window.sending_windows[j].seq >
-                sock->window.last_ack_received && (
-            get_curr_milliseconds() >
-                3 * sock->estRto + sock->window.sending_windows[j].send_time ||
-            get_curr_milliseconds() > TIMEOUT_MILLSEC + sock->window.sending_windows[j].send_time)) {
-          // resend packet j...
-          single_send_for_seq(sock, sock->window.sending_windows[j].payload,
-                              sock->window.sending_windows[j].payload_len,
-                              sock->window.sending_windows[j].seq);
-          sock->window.sending_windows[j].send_time = get_curr_milliseconds();
-        }
-      }
+  for (uint32_t i = 0; i < window_size; i++) {
+    sending_window *slot = &sock->window.sending_windows[i];
+    uint32_t end = slot->seq + slot->payload_len;
+    uint32_t lo = after(from, slot->seq) ? from : slot->seq;
+    uint32_t hi = before(to, end) ? to : end;
+    if (slot->send_time > 0 && after(hi, lo)) {
+      path_acked(&sock->paths[slot->path], hi - lo, mss, sock->window.cwnd);
     }
   }
 }
 
-void client_handshake(cmu_socket_t *sock) {
-  sock->state = CLOSED;
-  srand(time(0));
-  int seq = rand()%100 +1;
-  uint8_t *msg;
-  while (1) {
-    if (sock->state == CLOSED) {
-      msg = create_packet(sock->my_port, sock->conn.sin_port, seq, 0,
-                          sizeof(cmu_tcp_header_t), sizeof(cmu_tcp_header_t),
-                          SYN_FLAG_MASK, 1, 0, NULL, NULL, 0);
-      sendto(sock->socket, msg, sizeof(cmu_tcp_header_t), 0,
-             (struct sockaddr *)&(sock->conn), sizeof(sock->conn));
-      sock->state = SYN_SENT;
-      printf("client 第一次握手 seq:%d, ack:%d\n",seq,0);
-      free(msg);
-    } else if (sock->state == SYN_SENT) {
-      check_for_data(sock, TIMEOUT);
-      if (sock->state == SYN_SENT) {
-        sock->state = CLOSED;
-      } else {
-        break;
-      }
-    } else if (sock->state == ESTABLISHED) {
-      break;
-    }
+/**
+ * Adjusts the congestion window to an ACK of new data: shrinks it if the
+ * peer echoes new ECN marks, or else grows it back towards what the sending
+ * window holds, by slow start below the slow start threshold and by about a
+ * segment per window above it. Nothing else shrinks the window for now.
+ *
+ * @param sock The socket that received the ACK.
+ * @param hdr The header of the ACK.
+ * @param acked The bytes it newly acknowledges.
+ * @param snd_nxt The sequence number of the next byte to send.
+ */
+void adjust_cwnd(cmu_socket_t *sock, const cmu_hdr_t *hdr, uint32_t acked,
+                 uint32_t snd_nxt) {
+  uint32_t seg = sock->pmtu.plpmtu - sizeof(cmu_tcp_header_t);
+  uint32_t max_cwnd = WINDOW_INITIAL_WINDOW_SIZE / MSS * seg;
+  uint32_t cwnd = sock->window.cwnd;
+  uint32_t echoed;
+
+  if (sock->ecn == ECN_ON &&
+      opt_get_ecn_echo(hdr->ext, hdr->ext_len, &echoed) &&
+      ecn_on_ack(&sock->ecn_cc, hdr->ack, acked, echoed, snd_nxt,
+                 &sock->window.cwnd, 2 * seg)) {
+    sock->window.ssthresh = sock->window.cwnd;
+    STAT_SET(&sock->stats, ssthresh, sock->window.ssthresh);
+    STAT_INC(&sock->stats, ecn_reductions);
+  } else if (cwnd < max_cwnd && !sock->ecn_cc.reduced) {
+    uint32_t grow = cwnd < sock->window.ssthresh
+                        ? acked
+                        : (uint32_t)((uint64_t)acked * seg / cwnd);
+    sock->window.cwnd = MIN(cwnd + (grow > 0 ? grow : 1), max_cwnd);
+  }
+  if (sock->window.cwnd != cwnd) {
+    STAT_SET(&sock->stats, cwnd, sock->window.cwnd);
+    trace_sock_event(sock, TRACE_CWND, hdr->ack, 0, sock->window.ssthresh);
   }
 }
 
-/*
- * 检查SYN是否有效，如果无效，不应答
- * 发送SYNACK来应答SYN
+/**
+ * Processes the acknowledgement number, timestamp and window of a packet.
+ *
+ * @param sock The socket that received the packet.
+ * @param hdr The header of the packet.
  */
-
-void server_handshake(cmu_socket_t *sock) {
-  sock->state = LISTEN;
-  // int three_handshake_succ = FALSE;
-  srand(time(0));
-  int seq = rand()%100 +1;  // 随机生成序号
-  uint8_t *msg;
-  while (1) {
-    if (sock->state == LISTEN) {
-      check_for_data(
-          sock, NO_WAIT);  // 监听SYN，read mode是NO_WAIT，如果没有数据立即返回
-      // printf("LISTEN");
-
-    } else if (sock->state ==
-               SYN_RCVD) {  // 如果收到SYN，应答SYNACK，等客户回复ACK
-      // printf("SYN_RCVD");
-
-      sock->window.last_ack_received = seq;
-      int ack = sock->window.next_seq_expected;
-      msg = create_packet(sock->my_port, sock->conn.sin_port, seq, ack,
-                          sizeof(cmu_tcp_header_t), sizeof(cmu_tcp_header_t),
-                          ACK_FLAG_MASK | SYN_FLAG_MASK, 1, 0, NULL, NULL, 0);
-      sendto(sock->socket, msg, sizeof(cmu_tcp_header_t), 0,
-             (struct sockaddr *)&(sock->conn), sizeof(sock->conn));
-      printf("server 第二次握手, seq:%d, ack:%d\n",seq,ack);
-      free(msg);
-      check_for_data(
-          sock,
-          TIMEOUT);  // TIMEOUT：阻塞，直到收到数据或超时。如果超时没收到ACK则重传SYNACK
-      if (sock->state == ESTABLISHED) {
-        //check_for_data(sock,NO_FLAG);
-        break;
+void handle_ack(cmu_socket_t *sock, const cmu_hdr_t *hdr) {
+  uint32_t ack = hdr->ack;
+  uint32_t tsval, tsecr;
+  // An echoed timestamp dates the exact transmission being acknowledged,
+  // so every ACK gives a sample, even for retransmitted packets.
+  if (opt_get_timestamp(hdr->ext, hdr->ext_len,
+                        &tsval, &tsecr)) {
+    uint32_t sample = (uint32_t)get_curr_micros() - tsecr;
+    if (sample < RTT_MAX_RTO_US) {
+      take_rtt_sample(sock, sample);
+      // The peer acknowledges on the path the data came on.
+      rtt_sample(&sock->paths[sock->cur_path].rtt, sample);
+    }
+  } else if (after(ack, sock->window.last_ack_received)) {
+    adjust_sock_rtt(sock, ack);
+  }
+  uint16_t adv_window = hdr->adv_window;
+  if (adv_window != STAT_GET(&sock->stats, peer_window)) {
+    STAT_SET(&sock->stats, peer_window, adv_window);
+    trace_sock_event(sock, TRACE_WINDOW, ack, 0, adv_window);
+  }
+  if (after(ack, sock->window.last_ack_received)) {
+    uint32_t acked = ack - sock->window.last_ack_received;
+    uint32_t in_flight = STAT_GET(&sock->stats, bytes_in_flight);
+    // Our FIN takes up a sequence number but is not data.
+    int fin_acked = sock->fin_send_time != 0 && after(ack, sock->fin_seq);
+    if (fin_acked) {
+      acked--;
+    }
+    STAT_ADD(&sock->stats, bytes_acked, acked);
+    STAT_SET(&sock->stats, bytes_in_flight,
+             in_flight > acked ? in_flight - acked : 0);
+    adjust_cwnd(sock, hdr, acked, sock->window.last_ack_received + in_flight);
+    if (sock->npaths > 1) {
+      credit_paths(sock, sock->window.last_ack_received, ack);
+    }
+    sock->window.last_ack_received = ack;
+    pmtu_progress(&sock->pmtu);
+    trace_sock_event(sock, TRACE_ACK, ack, acked, 0);
+    if (fin_acked) {
+      switch (sock->state) {
+        case FIN_WAIT_1:
+          sock->state = FIN_WAIT_2;
+          break;
+        case CLOSING:
+          sock->state = TIME_WAIT;
+          break;
+        case LAST_ACK:
+          sock->state = CLOSED;
+          break;
+        default:
+          break;
       }
+      LOG_DEBUG("FIN acknowledged, state:%d", sock->state);
     }
+  } else if (ack == sock->window.last_ack_received &&
+             sock->state == ESTABLISHED) {
+    STAT_INC(&sock->stats, dup_acks);
+    trace_sock_event(sock, TRACE_DUP_ACK, ack, 0, 0);
   }
 }
 
-void init_handshake(cmu_socket_t *sock) {
-  if (sock->type == TCP_INITIATOR) {
-    client_handshake(sock);
-  } else if (sock->type == TCP_LISTENER) {
-    server_handshake(sock);
+/**
+ * Appends the options offering compression, forward error correction and
+ * ECN, each if we offer it and, for the answer to a SYN, the peer did too.
+ *
+ * @param sock The socket.
+ * @param ext The extension data to append to.
+ * @param peer_compress Whether the peer offered compression, 1 if it has
+ *                      not had the chance.
+ * @param peer_fec Whether the peer offered forward error correction, 1 if it
+ *                 has not had the chance.
+ * @param peer_ecn Whether the peer offered ECN, 1 if it has not had the
+ *                 chance.
+ *
+ * @return The number of bytes written.
+ */
+uint16_t put_offers(cmu_socket_t *sock, uint8_t *ext, int peer_compress,
+                    int peer_fec, int peer_ecn) {
+  uint16_t len = 0;
+  if (sock->compress != COMPRESS_OFF && peer_compress) {
+    len += opt_put_compress(ext + len);
   }
+  if (sock->fec != FEC_OFF && peer_fec) {
+    len += opt_put_fec(ext + len);
+  }
+  if (sock->ecn != ECN_OFF && peer_ecn) {
+    len += opt_put_ecn(ext + len);
+  }
+  return len;
 }
 
-void *begin_backend(void *in) {
-  cmu_socket_t *sock = (cmu_socket_t *)in;
-  int death, buf_len, send_signal;
-  uint8_t *data;
-  // init
-  uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
-  sock->window.sending_windows =
-      (sending_window *)malloc(sizeof(sending_window) * window_size);
-  memset(sock->window.sending_windows, 0, sizeof(sending_window) * window_size);
-  sock->window.received_windows =
-      (receiving_window *)malloc(sizeof(receiving_window) * window_size);
-  memset(sock->window.received_windows, 0,
-         sizeof(receiving_window) * window_size);
-  for (int i = 0; i < window_size; i++) {
-    sock->window.received_windows[i].payload = NULL;
-    sock->window.received_windows[i].payload =
-        (uint8_t *)malloc(sizeof(uint8_t) * MSS*2);
+/**
+ * Gets the length of the offers a data packet starting at `seq` repeats. A
+ * listener answering with SYN cookies learns what the handshake agreed on
+ * from the packet completing it, which can be the first data packet if our
+ * ACK was lost.
+ */
+uint16_t offers_len(cmu_socket_t *sock, uint32_t seq) {
+  if (sock->type != TCP_INITIATOR || seq != sock->handshake.iss + 1) {
+    return 0;
   }
-  printf("start handshake\n");
-  init_handshake(sock);
-  printf("end handshake\n");
+  return (sock->compress == COMPRESS_ON ? OPT_COMPRESS_LEN : 0) +
+         (sock->fec == FEC_ON ? OPT_FEC_LEN : 0) +
+         (sock->ecn == ECN_ON ? OPT_ECN_LEN : 0);
+}
 
-  while (1) {
-    while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
-    }
-    death = sock->dying;
-    pthread_mutex_unlock(&(sock->death_lock));
+/**
+ * Marks the datagrams a UDP socket sends ECN-capable.
+ */
+void set_ect(int fd) {
+  int tos = ECN_ECT0;
+  if (setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0) {
+    LOG_WARN("cannot set IP_TOS on socket %d", fd);
+  }
+}
 
-    while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+/**
+ * Lets the network fragment the datagrams of every path of the connection,
+ * once not even packets of PMTU_BASE_LEN get through with DF set.
+ *
+ * @param sock The socket.
+ */
+void clear_df(cmu_socket_t *sock) {
+  int n = sock->npaths;
+  int off = IP_PMTUDISC_DONT;
+  for (int p = 0; p < n; p++) {
+    if (p == 0 || sock->paths[p].fd >= 0) {
+      int fd = path_fd(sock, p);
+      if (setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &off, sizeof(off)) < 0) {
+        LOG_WARN("cannot clear DF on socket %d", fd);
+      }
     }
-    buf_len = sock->sending_len;
+  }
+}
 
-    if (death && buf_len == 0) {
-      break;
+/**
+ * Settles ECN once the peer has shown whether it offers it too, and if both
+ * do, makes every datagram of the connection ECN-capable from now on.
+ *
+ * @param sock The socket.
+ * @param peer_ecn Whether the peer offered ECN.
+ */
+void settle_ecn(cmu_socket_t *sock, int peer_ecn) {
+  int n = sock->npaths;
+  if (sock->ecn == ECN_OFF) {
+    return;
+  }
+  sock->ecn = peer_ecn ? ECN_ON : ECN_OFF;
+  if (sock->ecn == ECN_ON) {
+    for (int p = 0; p < n; p++) {
+      if (p == 0 || sock->paths[p].fd >= 0) {
+        set_ect(path_fd(sock, p));
+      }
     }
+  }
+}
 
-    if (buf_len > 0) {
-      data = malloc(buf_len);
-      memcpy(data, sock->sending_buf, buf_len);
-      sock->sending_len = 0;
-      free(sock->sending_buf);
-      sock->sending_buf = NULL;
-      pthread_mutex_unlock(&(sock->send_lock));
-      single_send(sock, data, buf_len);
-      free(data);
-    } else {
-      pthread_mutex_unlock(&(sock->send_lock));
-    }
+/**
+ * Gets the payload room of a data packet of the given stream at the current
+ * path MTU.
+ */
+int data_mss(cmu_socket_t *sock, uint16_t stream) {
+  int mss = sock->pmtu.plpmtu - sizeof(cmu_tcp_header_t) - OPT_TIMESTAMP_LEN;
+  if (sock->crc32c != CRC32C_OFF) {
+    mss -= OPT_CRC32C_LEN;
+  }
+  if (sock->fec == FEC_ON) {
+    mss -= OPT_FEC_GROUP_LEN;
+  }
+  mss -= offers_len(sock, sock->window.last_ack_received);
+  return stream == 0 ? mss : mss - OPT_STREAM_LEN;
+}
 
-    check_for_data(sock, NO_WAIT);
+/**
+ * Resizes the congestion window after the path MTU changed, so that it
+ * still holds as many packets.
+ */
+void set_pmtu_cwnd(cmu_socket_t *sock) {
+  sock->window.cwnd = WINDOW_INITIAL_WINDOW_SIZE / MSS *
+                      (sock->pmtu.plpmtu - sizeof(cmu_tcp_header_t));
+  STAT_SET(&sock->stats, cwnd, sock->window.cwnd);
+  STAT_SET(&sock->stats, pmtu, sock->pmtu.plpmtu);
+  trace_sock_event(sock, TRACE_CWND, sock->window.last_ack_received, 0,
+                   sock->window.ssthresh);
+}
+
+/**
+ * Processes the peer's answer to a path MTU probe.
+ *
+ * @param sock The socket that received the answer.
+ * @param size The length of the probe that arrived.
+ */
+void handle_pmtu_ack(cmu_socket_t *sock, uint16_t size) {
+  if (pmtu_probe_acked(&sock->pmtu, size)) {
+    set_pmtu_cwnd(sock);
+    LOG_DEBUG("path MTU is now %u", sock->pmtu.plpmtu);
+  }
+}
+
+/**
+ * Starts a new connection from what earlier ones learned about its peer
+ * host, if the metrics cache has anything on it. Must be called before the
+ * first packet goes out, once `conn` holds the peer.
+ *
+ * @param sock The socket starting a connection.
+ */
+void load_metrics(cmu_socket_t *sock) {
+  cmu_metrics_t m;
+  uint32_t max_cwnd;
+
+  if (sock->rtt.srtt != 0 || !metrics_get(&(sock->conn), &m) ||
+      m.srtt_us == 0) {
+    return;
+  }
+  rtt_init(&sock->rtt, m.srtt_us + 4 * m.rttvar_us);
+  rtt_init(&sock->paths[0].rtt, sock->rtt.rto);
+  publish_rtt_stats(sock);
+  if (m.ssthresh != 0) {
+    sock->window.ssthresh = m.ssthresh;
+    STAT_SET(&sock->stats, ssthresh, sock->window.ssthresh);
+  }
+  pmtu_resume(&sock->pmtu, m.pmtu);
+  set_pmtu_cwnd(sock);
+  // The window never holds more than its slots, nor less than two segments.
+  max_cwnd = sock->window.cwnd;
+  sock->window.cwnd = MIN(m.cwnd, max_cwnd);
+  if (sock->window.cwnd < 2 * MSS) {
+    sock->window.cwnd = 2 * MSS;
+  }
+  sock->paths[0].cwnd = sock->window.cwnd;
+  STAT_SET(&sock->stats, cwnd, sock->window.cwnd);
+  LOG_DEBUG("metrics for %s: rto=%" PRIu64 " cwnd=%u pmtu=%u",
+            inet_ntoa(sock->conn.sin_addr), sock->rtt.rto, sock->window.cwnd,
+            sock->pmtu.plpmtu);
+}
+
+/**
+ * Stores what a connection learned about its peer host for the next ones.
+ * Only connections that measured the RTT have anything worth keeping.
+ *
+ * @param sock The socket whose connection ended.
+ */
+void save_metrics(cmu_socket_t *sock) {
+  cmu_metrics_t m;
+
+  if (sock->rtt.srtt == 0) {
+    return;
+  }
+  m.srtt_us = sock->rtt.srtt;
+  m.rttvar_us = sock->rtt.rttvar;
+  m.ssthresh = sock->window.ssthresh;
+  m.cwnd = sock->window.cwnd;
+  m.pmtu = sock->pmtu.plpmtu;
+  metrics_put(&(sock->conn), &m);
+}
+
+/**
+ * Sends a path MTU probe if one is due: a data packet of the probed length
+ * that carries only padding, so losing it costs no data.
+ *
+ * @param sock The socket to probe the path of.
+ */
+void run_pmtu_probe(cmu_socket_t *sock) {
+  static const uint8_t padding[PMTU_MAX_LEN];
+  uint8_t ext[OPT_PMTU_LEN];
+  uint16_t ext_len, size;
+
+  if (sock->state != ESTABLISHED && sock->state != CLOSE_WAIT) {
+    return;
+  }
+  size = pmtu_next_probe(&sock->pmtu, get_curr_micros(), sock->rtt.rto);
+  if (size == 0) {
+    return;
+  }
+  ext_len = opt_put_pmtu(ext, size);
+  if (sock->crc32c != CRC32C_OFF) {
+    size -= OPT_CRC32C_LEN;
+  }
+  send_packet(sock, sock->window.last_ack_received,
+              sock->window.next_seq_expected, 0, ext, ext_len,
+              (uint8_t *)padding,
+              size - sizeof(cmu_tcp_header_t) - ext_len);
+  STAT_INC(&sock->stats, pmtu_probes);
+}
+
+/**
+ * Establishes a listener's connection from a packet that acknowledges one of
+ * its SYN cookies.
+ *
+ * @param sock The listening socket. `conn` holds the packet's source.
+ * @param hdr The header of the packet.
+ *
+ * @return 1 if the cookie was valid and the connection is now established, 0
+ *         if the packet was dropped.
+ */
+int accept_syn_cookie(cmu_socket_t *sock, const cmu_hdr_t *hdr) {
+  uint32_t seq = hdr->seq;
+  uint32_t ack = hdr->ack;
+
+  if (!syncookie_enabled() ||
+      !syncookie_check(&(sock->conn), sock->my_port, seq - 1, ack - 1)) {
+    STAT_INC(&sock->stats, syn_cookies_rejected);
+    return 0;
+  }
+  sock->handshake.iss = ack - 1;
+  sock->handshake.peer_iss = seq - 1;
+  sock->window.last_ack_received = ack;
+  sock->window.next_seq_expected = seq;
+  // Our SYN-ACK offered what the SYN did and we do.
+  if (sock->compress != COMPRESS_OFF) {
+    sock->compress = opt_get_compress(hdr->ext, hdr->ext_len) ? COMPRESS_ON
+                                                               : COMPRESS_OFF;
+  }
+  if (sock->fec != FEC_OFF) {
+    sock->fec = opt_get_fec(hdr->ext, hdr->ext_len) ? FEC_ON : FEC_OFF;
+  }
+  settle_ecn(sock, opt_get_ecn(hdr->ext, hdr->ext_len));
+  load_metrics(sock);
+  alloc_windows(sock);
+  sock->state = ESTABLISHED;
+  LOG_DEBUG("server accepted SYN cookie %u from %s:%u", ack - 1,
+            inet_ntoa(sock->conn.sin_addr), ntohs(sock->conn.sin_port));
+  return 1;
+}
+
+void handle_message(cmu_socket_t *sock, const cmu_hdr_t *hdr);
+
+/**
+ * Rebuilds the data packet an FEC repair finds missing from its group, and
+ * handles it as if it had arrived.
+ *
+ * @param sock The socket that received the repair.
+ * @param hdr The header of the repair packet.
+ * @param repair The repair option of the packet.
+ */
+void handle_fec_repair(cmu_socket_t *sock, const cmu_hdr_t *hdr,
+                       const fec_repair_t *repair) {
+  uint8_t payload[MAX_PAYLOAD_LEN];
+  uint8_t ext[OPT_STREAM_LEN];
+  cmu_hdr_t rebuilt = *hdr;
+  uint32_t seq;
+  uint16_t stream;
+  uint16_t len = fec_recover(&sock->fec_rx, repair, hdr->payload,
+                             hdr->payload_len, &seq, &stream, payload);
+
+  // The retransmission may have beaten the repair.
+  if (len == 0 || before(seq, sock->window.next_seq_expected) ||
+      find_window_slot(sock, seq) >= 0) {
+    return;
+  }
+  rebuilt.seq = seq;
+  rebuilt.flags = 0;
+  rebuilt.ext = ext;
+  rebuilt.ext_len = stream != 0 ? opt_put_stream(ext, stream) : 0;
+  rebuilt.payload = payload;
+  rebuilt.payload_len = len;
+  rebuilt.hlen = sizeof(cmu_tcp_header_t) + rebuilt.ext_len;
+  rebuilt.plen = rebuilt.hlen + len;
+  STAT_INC(&sock->stats, fec_recovered);
+  LOG_TRACE("rebuilt seq=%" PRIu64 " len=%" PRIu64 " stream=%" PRIu64, seq,
+            len, stream);
+  handle_message(sock, &rebuilt);
+}
+
+/**
+ * Updates the socket information to represent the newly received packet.
+ *
+ * In the current stop-and-wait implementation, this function also sends an
+ * acknowledgement for the packet.
+ *
+ * @param sock The socket used for handling packets received.
+ * @param hdr The decoded header of the packet received by the socket.
+ */
+void handle_message(cmu_socket_t *sock, const cmu_hdr_t *hdr) {
+  uint8_t flags = hdr->flags;
+
+  // A listener answering with SYN cookies remembers nothing until a packet
+  // completing the handshake comes back. That is usually the final ACK, but
+  // if it was lost the client's first data or FIN does just as well.
+  if (sock->state == LISTEN && !(flags & SYN_FLAG_MASK)) {
+    if (!accept_syn_cookie(sock, hdr) || flags == ACK_FLAG_MASK) {
+      return;
+    }
+  }
+
+  switch (flags) {
+    case ACK_FLAG_MASK: {
+      if (sock->state == SYN_RCVD) {
+        // 服务器收到ACK，握手完成
+        if (hdr->ack == sock->handshake.iss + 1) {
+          sock->window.last_ack_received = hdr->ack;
+          if (sock->compress != COMPRESS_OFF) {
+            sock->compress =
+                sock->handshake.peer_compress ? COMPRESS_ON : COMPRESS_OFF;
+          }
+          if (sock->fec != FEC_OFF) {
+            sock->fec = sock->handshake.peer_fec ? FEC_ON : FEC_OFF;
+          }
+          settle_ecn(sock, sock->handshake.peer_ecn);
+          sock->state = ESTABLISHED;
+        }
+        break;
+      }
+      uint16_t probed =
+          opt_get_pmtu(hdr->ext, hdr->ext_len);
+      if (probed != 0) {
+        // Not a duplicate ACK, just the answer to a path MTU probe.
+        handle_pmtu_ack(sock, probed);
+        if (!after(hdr->ack, sock->window.last_ack_received)) {
+          break;
+        }
+      }
+      handle_ack(sock, hdr);
+      break;
+    }
+    case FIN_FLAG_MASK:
+    case FIN_FLAG_MASK | ACK_FLAG_MASK: {
+      uint32_t seq = hdr->seq;
+      if ((flags & ACK_FLAG_MASK) &&
+          after(hdr->ack, sock->window.last_ack_received)) {
+        handle_ack(sock, hdr);
+      }
+      // Only a FIN right after the data delivered so far ends the stream. An
+      // early one is dropped and comes back once the peer retransmits it.
+      if (!sock->received_fin && seq == sock->window.next_seq_expected &&
+          sock->state != SYN_RCVD) {
+        sock->received_fin = TRUE;
+        sock->window.next_seq_expected = seq + 1;
+        pthread_cond_broadcast(&(sock->wait_cond));
+        switch (sock->state) {
+          case ESTABLISHED:
+            sock->state = CLOSE_WAIT;
+            break;
+          case FIN_WAIT_1:
+            sock->state = CLOSING;
+            break;
+          case FIN_WAIT_2:
+            sock->state = TIME_WAIT;
+            break;
+          default:
+            break;
+        }
+        LOG_DEBUG("received FIN, seq:%u, state:%d", seq, sock->state);
+      }
+      // Acknowledge retransmitted FINs too, in case our ACK was lost.
+      send_packet(sock, sock->window.last_ack_received,
+                  sock->window.next_seq_expected, ACK_FLAG_MASK, NULL, 0, NULL,
+                  0);
+      break;
+    }
+    // 服务器端收到SYN，状态切换到SYN_RCVD
+    case SYN_FLAG_MASK: {
+      if (sock->state == SYN_RCVD) {
+        // Our SYN-ACK was probably lost.
+        sock->handshake.resend = TRUE;
+        break;
+      }
+      if (sock->state != LISTEN) {
+        break;
+      }
+      uint32_t seq = hdr->seq;
+      uint16_t payload_len = hdr->payload_len;
+      uint8_t cookie[OPT_FASTOPEN_COOKIE_LEN];
+      int fastopen = opt_get_fastopen(hdr->ext, hdr->ext_len, cookie);
+      int peer_compress = opt_get_compress(hdr->ext, hdr->ext_len);
+      int peer_fec = opt_get_fec(hdr->ext, hdr->ext_len);
+      int peer_ecn = opt_get_ecn(hdr->ext, hdr->ext_len);
+      int accept_data = fastopen == 1 && payload_len > 0 &&
+                        hdr->hlen + payload_len <= MAX_LEN &&
+                        fastopen_check_cookie(&(sock->conn), cookie);
+
+      if (!accept_data && syncookie_enabled()) {
+        // Answer without leaving LISTEN. Data on the SYN is dropped and sent
+        // again once the handshake completes.
+        uint8_t ext[OPT_MAX_LEN];
+        uint16_t ext_len = 0;
+        uint32_t isn = syncookie_make(&(sock->conn), sock->my_port, seq);
+        if (fastopen >= 0) {
+          fastopen_make_cookie(&(sock->conn), cookie);
+          ext_len = opt_put_fastopen(ext, cookie);
+        }
+        ext_len += put_offers(sock, ext + ext_len, peer_compress, peer_fec,
+                              peer_ecn);
+        send_packet(sock, isn, seq + 1, SYN_FLAG_MASK | ACK_FLAG_MASK, ext,
+                    ext_len, NULL, 0);
+        STAT_INC(&sock->stats, syn_cookies_sent);
+        LOG_DEBUG("server sent SYN cookie %u to %s:%u", isn,
+                  inet_ntoa(sock->conn.sin_addr), ntohs(sock->conn.sin_port));
+        break;
+      }
+      sock->window.next_seq_expected = seq + 1;
+      sock->handshake.peer_iss = seq;
+      sock->handshake.send_cookie = fastopen >= 0 && !accept_data;
+      sock->handshake.peer_compress = peer_compress;
+      sock->handshake.peer_fec = peer_fec;
+      sock->handshake.peer_ecn = peer_ecn;
+      if (accept_data) {
+        // Data on a SYN with a valid cookie is readable straight away; the
+        // SYN-ACK acknowledges it.
+        cmu_segment_t *seg = segment_get(sock);
+        if (seg != NULL) {
+          memcpy(seg->data, hdr->payload, payload_len);
+          seg->len = payload_len;
+          // Sent before compression was agreed on, so never compressed.
+          queue_segment(sock, 0, seg);
+          sock->window.next_seq_expected += payload_len;
+          STAT_INC(&sock->stats, segments_received);
+          STAT_ADD(&sock->stats, bytes_received, payload_len);
+          pthread_cond_broadcast(&(sock->wait_cond));
+        }
+      }
+      LOG_DEBUG("server got SYN, seq:%u, fast open data:%u", seq,
+                accept_data ? payload_len : 0);
+      load_metrics(sock);
+      alloc_windows(sock);
+      sock->state = SYN_RCVD;
+      break;
+    }
+    //服务端响应后客户端状态更新
+    case ACK_FLAG_MASK | SYN_FLAG_MASK: {
+      uint32_t ack = hdr->ack;
+      if (sock->state == SYN_SENT) {
+        // The SYN-ACK may acknowledge the data sent on our SYN too.
+        if (!after(ack, sock->handshake.iss) ||
+            after(ack,
+                  sock->handshake.iss + 1 + sock->handshake.syn_data_len)) {
+          break;
+        }
+        uint8_t cookie[OPT_FASTOPEN_COOKIE_LEN];
+        if (sock->fastopen &&
+            opt_get_fastopen(hdr->ext, hdr->ext_len, cookie) == 1) {
+          fastopen_cache_put(&(sock->conn), cookie);
+        }
+        if (sock->compress != COMPRESS_OFF) {
+          sock->compress = opt_get_compress(hdr->ext, hdr->ext_len)
+                               ? COMPRESS_ON
+                               : COMPRESS_OFF;
+        }
+        if (sock->fec != FEC_OFF) {
+          sock->fec = opt_get_fec(hdr->ext, hdr->ext_len) ? FEC_ON : FEC_OFF;
+        }
+        settle_ecn(sock, opt_get_ecn(hdr->ext, hdr->ext_len));
+        sock->window.last_ack_received = ack;
+        sock->window.next_seq_expected = hdr->seq + 1;
+        sock->handshake.peer_iss = hdr->seq;
+        sock->state = ESTABLISHED;
+      }
+      // 第三次握手. A SYN-ACK after that means the ACK was lost, so send it
+      // again. It tells a listener using SYN cookies what was agreed on.
+      uint8_t ext[OPT_COMPRESS_LEN + OPT_FEC_LEN + OPT_ECN_LEN];
+      uint16_t ext_len = put_offers(sock, ext, TRUE, TRUE, TRUE);
+      send_packet(sock, sock->window.last_ack_received,
+                  sock->window.next_seq_expected, ACK_FLAG_MASK, ext, ext_len,
+                  NULL, 0);
+      LOG_DEBUG("client sent handshake ACK, seq:%u, ack:%u",
+                sock->window.last_ack_received, sock->window.next_seq_expected);
+      break;
+    }
+    default: {
+      // Ignore data before the connection is established and after the
+      // peer's FIN.
+      if ((sock->state != ESTABLISHED && sock->state != FIN_WAIT_1 &&
+           sock->state != FIN_WAIT_2) ||
+          sock->received_fin) {
+        break;
+      }
+      uint8_t *payload = hdr->payload;
+      uint16_t payload_len = hdr->payload_len;
+      uint32_t seq = hdr->seq;
+      uint32_t tsval, tsecr;
+      uint16_t probed =
+          opt_get_pmtu(hdr->ext, hdr->ext_len);
+      fec_repair_t repair;
+      uint32_t group;
+
+      if (opt_get_fec_repair(hdr->ext, hdr->ext_len, &repair)) {
+        if (sock->fec == FEC_ON) {
+          handle_fec_repair(sock, hdr, &repair);
+        }
+        break;
+      }
+      if (probed != 0) {
+        // A path MTU probe: only padding. Tell the peer how much arrived.
+        uint8_t ext[OPT_PMTU_LEN];
+        uint16_t ext_len = opt_put_pmtu(ext, hdr->plen);
+        send_packet(sock, sock->window.last_ack_received,
+                    sock->window.next_seq_expected, ACK_FLAG_MASK, ext, ext_len,
+                    NULL, 0);
+        break;
+      }
+      if (payload_len == 0) {
+        // A keepalive probe, only there to get an ACK back.
+        send_packet(sock, sock->window.last_ack_received,
+                    sock->window.next_seq_expected, ACK_FLAG_MASK, NULL, 0,
+                    NULL, 0);
+        break;
+      }
+      sock->last_data = get_curr_micros();
+
+      // Remember the peer's timestamp so the ACK can echo it.
+      int has_ts = opt_get_timestamp(hdr->ext, hdr->ext_len, &tsval, &tsecr);
+      if (has_ts) {
+        sock->ts_recent = tsval;
+      }
+
+      STAT_INC(&sock->stats, segments_received);
+      if (sock->rx_ce && sock->ecn == ECN_ON) {
+        sock->ecn_cc.ce_bytes += payload_len;
+        STAT_INC(&sock->stats, ecn_ce_received);
+      }
+      LOG_TRACE("recv seq=%" PRIu64 " len=%" PRIu64 " expected=%" PRIu64, seq,
+                payload_len, sock->window.next_seq_expected);
+      STAT_ADD(&sock->stats, bytes_received, payload_len);
+      if (before(seq, sock->window.next_seq_expected)) {
+        STAT_INC(&sock->stats, dup_segments);
+      } else if (after(seq, sock->window.next_seq_expected)) {
+        STAT_INC(&sock->stats, out_of_order);
+      }
+
+      // Marked packets arriving for the first time count towards their FEC
+      // group, whether or not there is room to keep them.
+      if (sock->fec == FEC_ON && !before(seq, sock->window.next_seq_expected) &&
+          find_window_slot(sock, seq) < 0 &&
+          opt_get_fec_group(hdr->ext, hdr->ext_len, &group)) {
+        fec_decode(&sock->fec_rx, group, seq,
+                   opt_get_stream(hdr->ext, hdr->ext_len), payload,
+                   payload_len);
+      }
+
+      store_segment(sock, seq, payload, payload_len,
+                    opt_get_stream(hdr->ext, hdr->ext_len));
+      uint32_t next_expected_seq = deliver_window(sock);
+
+      // The ACK carries no payload, only the echoed timestamp.
+      uint8_t ext_data[OPT_TIMESTAMP_LEN];
+      uint16_t ext_len = 0;
+      if (has_ts) {
+        ext_len =
+            opt_put_timestamp(ext_data, (uint32_t)get_curr_micros(), tsval);
+      }
+      send_packet(sock, seq, next_expected_seq, ACK_FLAG_MASK, ext_data,
+                  ext_len, NULL, 0);
+      sock->window.next_seq_expected = next_expected_seq;
+      trace_sock_event(sock, TRACE_RECV, seq, payload_len, next_expected_seq);
+    }
+  }
+}
+
+/**
+ * Sleeps until a datagram arrives, the application wakes the backend up or
+ * the deadline passes, sending whatever the link emulator releases meanwhile.
+ *
+ * @param sock The socket to wait on.
+ * @param deadline When to stop waiting, on the CMU-TCP clock, or 0 to wait
+ *                 until something happens.
+ *
+ * @return 1 if a datagram is ready to be read, 0 otherwise.
+ */
+int wait_for_packet(cmu_socket_t *sock, uint64_t deadline) {
+  struct pollfd fds[2 + CMU_MAX_PATHS] = {{sock->socket, POLLIN, 0},
+                                          {sock->wake_fd, POLLIN, 0}};
+  int nfds = 2;
+  int n = sock->npaths;
+
+  // The paths an initiator added have sockets of their own.
+  for (int p = 1; p < n; p++) {
+    if (sock->paths[p].fd >= 0) {
+      fds[nfds].fd = sock->paths[p].fd;
+      fds[nfds++].events = POLLIN;
+    }
+  }
+
+  while (1) {
+    uint64_t now = get_curr_micros();
+    uint64_t until = deadline;
+    uint64_t release = link_next_release(sock->link);
+    int timeout = -1;
+    int ready;
+
+    if (release != 0 && (until == 0 || release < until)) {
+      until = release;
+    }
+    if (until != 0) {
+      timeout = until > now ? (int)((until - now + 999) / 1000) : 0;
+    }
+    ready = poll(fds, nfds, timeout);
+    link_flush(sock->link);
+    if (ready > 0) {
+      if (fds[1].revents & POLLIN) {
+        uint64_t count;
+        if (read(sock->wake_fd, &count, sizeof(count)) < 0) {
+          // Another wait already consumed the wake-up.
+        }
+        sock->wake_pending = TRUE;
+      }
+      for (int f = 0; f < nfds; f++) {
+        if (f != 1 && (fds[f].revents & POLLIN)) {
+          return 1;
+        }
+      }
+      return 0;
+    }
+    if (deadline != 0 && get_curr_micros() >= deadline) {
+      return 0;
+    }
+  }
+}
+
+/**
+ * Checks the CRC32C option of a received packet.
+ *
+ * @param hdr The packet's header, already validated. The CRC32C value in the
+ *            packet is zeroed on the way.
+ *
+ * @return 1 if the packet carries a valid CRC32C, 0 if it carries none, -1 if
+ *         its CRC32C does not match.
+ */
+int check_crc32c(const cmu_hdr_t *hdr) {
+  uint8_t opt_len;
+  uint8_t *val;
+  uint32_t crc;
+
+  val = (uint8_t *)opt_find(hdr->ext, hdr->ext_len, OPT_CRC32C, &opt_len);
+  if (val == NULL) {
+    return 0;
+  }
+  if (opt_len != sizeof(crc)) {
+    return -1;
+  }
+  memcpy(&crc, val, sizeof(crc));
+  memset(val, 0, sizeof(crc));
+  return ntohl(crc) == crc32c(0, hdr->pkt, hdr->plen) ? 1 : -1;
+}
+
+/**
+ * Finds the path a datagram came on.
+ *
+ * @param sock The socket.
+ * @param fd The UDP socket it was read from.
+ * @param from The address it came from.
+ *
+ * @return The path, or -1 if it came from no peer of the connection.
+ */
+int find_path(cmu_socket_t *sock, int fd, const struct sockaddr_in *from) {
+  int n = sock->npaths;
+  for (int p = 0; p < n; p++) {
+    const struct sockaddr_in *peer = path_peer(sock, p);
+    if (path_fd(sock, p) == fd &&
+        from->sin_addr.s_addr == peer->sin_addr.s_addr &&
+        from->sin_port == peer->sin_port) {
+      return p;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Tells if the handshake is over and paths can join the connection.
+ */
+int paths_joinable(cmu_socket_t *sock) {
+  return sock->state != LISTEN && sock->state != SYN_SENT &&
+         sock->state != SYN_RCVD && sock->state != CLOSED;
+}
+
+/**
+ * Sends a JOIN on a path: the initiator's to join it, the listener's to
+ * answer.
+ *
+ * @param sock The socket.
+ * @param path The path.
+ */
+void send_join(cmu_socket_t *sock, int path) {
+  uint8_t ext[OPT_MP_JOIN_LEN];
+  int cur_path = sock->cur_path;
+  uint32_t initiator_iss = sock->type == TCP_INITIATOR
+                               ? sock->handshake.iss
+                               : sock->handshake.peer_iss;
+  uint32_t listener_iss = sock->type == TCP_INITIATOR
+                              ? sock->handshake.peer_iss
+                              : sock->handshake.iss;
+
+  // The first JOIN is the first datagram on a socket of its own.
+  if (sock->ecn == ECN_ON && sock->paths[path].fd >= 0 &&
+      sock->paths[path].join_sent == 0) {
+    set_ect(sock->paths[path].fd);
+  }
+  sock->cur_path = path;
+  send_packet(sock, sock->window.last_ack_received,
+              sock->window.next_seq_expected, ACK_FLAG_MASK, ext,
+              opt_put_mp_join(ext, initiator_iss, listener_iss), NULL, 0);
+  sock->cur_path = cur_path;
+}
+
+/**
+ * Handles a JOIN. A listener adds the path it came on, if it is new and the
+ * connection's sequence numbers match, and answers it; the initiator takes
+ * the answer as a sign the path is up.
+ *
+ * @param sock The socket.
+ * @param path The path the JOIN came on, -1 if it is new.
+ * @param from The address it came from.
+ * @param initiator_iss The initiator's initial sequence number it carries.
+ * @param listener_iss The listener's initial sequence number it carries.
+ */
+void handle_join(cmu_socket_t *sock, int path, const struct sockaddr_in *from,
+                 uint32_t initiator_iss, uint32_t listener_iss) {
+  int listener = sock->type == TCP_LISTENER;
+  uint32_t ours = sock->handshake.iss;
+  uint32_t theirs = sock->handshake.peer_iss;
+
+  if (!paths_joinable(sock) ||
+      initiator_iss != (listener ? theirs : ours) ||
+      listener_iss != (listener ? ours : theirs) || (!listener && path < 0)) {
+    STAT_INC(&sock->stats, foreign_packets);
+    return;
+  }
+  if (listener) {
+    if (path < 0) {
+      int n = sock->npaths;
+      if (!multipath_enabled() || n >= CMU_MAX_PATHS) {
+        STAT_INC(&sock->stats, foreign_packets);
+        return;
+      }
+      path_init(&sock->paths[n], -1, from, sock->rtt.rto, sock->window.cwnd);
+      sock->npaths = n + 1;
+      path = n;
+      LOG_DEBUG("path %d joined from %s:%u", path, inet_ntoa(from->sin_addr),
+                ntohs(from->sin_port));
+    }
+    send_join(sock, path);
+  } else if (sock->paths[path].join_tries == 1) {
+    // Only the answer to a single JOIN dates it, as in Karn's rule.
+    rtt_sample(&sock->paths[path].rtt,
+               get_curr_micros() - sock->paths[path].join_sent);
+  }
+  if (path_heard(&sock->paths[path])) {
+    LOG_DEBUG("path %d up", path);
+    publish_paths(sock);
+  }
+}
+
+/**
+ * Tells if a datagram arrived marked CE, from the TOS byte `IP_RECVTOS`
+ * hands over with it.
+ */
+int arrived_ce(struct msghdr *msg) {
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c != NULL;
+       c = CMSG_NXTHDR(msg, c)) {
+    if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_TOS) {
+      return (*CMSG_DATA(c) & ECN_MASK) == ECN_CE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * Reads up to RECV_BATCH datagrams from one UDP socket with one `recvmmsg`
+ * call and validates their headers together before handling them in order.
+ *
+ * @param sock The socket of the connection.
+ * @param fd The UDP socket to read.
+ * @param port Its local port, which packets must be addressed to.
+ * @param recv_flags The flags for `recvmmsg`.
+ */
+void receive_batch(cmu_socket_t *sock, int fd, uint16_t port,
+                   int recv_flags) {
+  struct mmsghdr msgs[RECV_BATCH];
+  struct iovec iov[RECV_BATCH];
+  struct sockaddr_in from[RECV_BATCH];
+  // Room for the TOS byte, when ECN asks for it.
+  uint8_t ctrl[RECV_BATCH][CMSG_SPACE(sizeof(int))];
+  uint8_t *pkts[RECV_BATCH];
+  uint32_t lens[RECV_BATCH];
+  cmu_hdr_t hdrs[RECV_BATCH];
+  uint8_t valid[RECV_BATCH];
+  int n;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < RECV_BATCH; i++) {
+    pkts[i] = sock->rx_bufs + i * PMTU_MAX_LEN;
+    iov[i].iov_base = pkts[i];
+    iov[i].iov_len = PMTU_MAX_LEN;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &from[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    if (sock->ecn != ECN_OFF) {
+      msgs[i].msg_hdr.msg_control = ctrl[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+    }
+  }
+  n = recvmmsg(fd, msgs, RECV_BATCH, recv_flags, NULL);
+
+  for (int i = 0; i < n; i++) {
+    // A datagram longer than the buffer is cut short and fails validation.
+    lens[i] = msgs[i].msg_len;
+  }
+  if (n > 0 && hdr_validate_batch(pkts, lens, n, port, hdrs, valid) < n) {
+    for (int i = 0; i < n; i++) {
+      if (!valid[i]) {
+        STAT_INC(&sock->stats, malformed_packets);
+      }
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    uint32_t initiator_iss, listener_iss;
+    int path, join;
+
+    if (!valid[i]) {
+      continue;
+    }
+    if (sock->state == LISTEN) {
+      sock->conn = from[i];
+    }
+    path = find_path(sock, fd, &from[i]);
+    join = opt_get_mp_join(hdrs[i].ext, hdrs[i].ext_len, &initiator_iss,
+                           &listener_iss);
+    if (path < 0 && !join) {
+      STAT_INC(&sock->stats, foreign_packets);
+      continue;
+    }
+    int crc = check_crc32c(&hdrs[i]);
+    // Only a bare SYN goes without a checksum once both sides send them.
+    int bare_syn = hdrs[i].flags == SYN_FLAG_MASK;
+    if (crc < 0 || (crc == 0 && sock->crc32c == CRC32C_ON && !bare_syn)) {
+      STAT_INC(&sock->stats, checksum_errors);
+      continue;
+    }
+    if (join) {
+      handle_join(sock, path, &from[i], initiator_iss, listener_iss);
+      continue;
+    }
+    sock->last_heard = get_curr_micros();
+    sock->probes_sent = 0;
+    if (path_heard(&sock->paths[path])) {
+      LOG_DEBUG("path %d up", path);
+      publish_paths(sock);
+    }
+    sock->rx_ce = sock->ecn != ECN_OFF && arrived_ce(&msgs[i].msg_hdr);
+    // Answers go back on the path the packet came on.
+    sock->rx_path = path;
+    sock->cur_path = path;
+    handle_message(sock, &hdrs[i]);
+    sock->cur_path = default_path(sock);
+    // A listener decides once a handshake has completed, which a packet
+    // can fail to do.
+    if (sock->crc32c == CRC32C_OFFERED && sock->state != LISTEN &&
+        !bare_syn) {
+      sock->crc32c = crc ? CRC32C_ON : CRC32C_OFF;
+    }
+  }
+}
+
+/**
+ * Checks if the socket received any data.
+ *
+ * Reads the connection's UDP socket, then those of the paths an initiator
+ * added, a batch at a time, see `receive_batch`. Once a listener has picked
+ * a peer, or an initiator has started connecting, packets from any other
+ * address are dropped, except for JOINs of new paths.
+ *
+ * @param sock The socket used for receiving data on the connection.
+ * @param flags Flags that determine how the socket should wait for data. Check
+ *             `cmu_read_mode_t` for more information.
+ */
+void check_for_data(cmu_socket_t *sock, cmu_read_mode_t flags) {
+  int received_len;
+
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+  received_len = sock->received_len;
+  link_flush(sock->link);
+  switch (flags) {
+    case NO_FLAG:
+      // Block for the first datagram only.
+      receive_batch(sock, sock->socket, sock->my_port, MSG_WAITFORONE);
+      break;
+    case TIMEOUT: {
+      // Timeout after 3 seconds.
+      if (!wait_for_packet(sock, get_curr_micros() + 3 * USEC_PER_SEC)) {
+        break;
+      }
+    }
+    // Fall through.
+    case NO_WAIT:
+      receive_batch(sock, sock->socket, sock->my_port, MSG_DONTWAIT);
+      break;
+    default:
+      LOG_ERROR("unknown read flag %d", flags);
+  }
+  for (int p = 1; p < sock->npaths; p++) {
+    if (sock->paths[p].fd >= 0) {
+      receive_batch(sock, sock->paths[p].fd, path_port(sock, p),
+                    MSG_DONTWAIT);
+    }
+  }
+  // A batch can hold data together with the end of the handshake, or come in
+  // while a send is under way, so wake readers up from here.
+  if (sock->received_len > received_len) {
+    pthread_cond_broadcast(&(sock->wait_cond));
+  }
+  pthread_mutex_unlock(&(sock->recv_lock));
+}
+
+/**
+ * Sends the repair packet of the FEC group being built, if it has any
+ * packets, and starts the next group.
+ *
+ * @param sock The socket to send on.
+ */
+void send_fec_repair(cmu_socket_t *sock) {
+  uint8_t ext[OPT_FEC_REPAIR_LEN];
+  fec_repair_t repair;
+  uint16_t len;
+  const uint8_t *parity = fec_take_repair(&sock->fec_tx, &repair, &len);
+
+  if (parity == NULL) {
+    return;
+  }
+  send_packet(sock, repair.group, sock->window.next_seq_expected, 0, ext,
+              opt_put_fec_repair(ext, &repair), (uint8_t *)parity, len);
+  STAT_INC(&sock->stats, fec_repairs_sent);
+}
+
+/**
+ * send single packet for special seq and payload, stamped with the current
+ * time and tagged with its stream. A packet sent for the first time joins the
+ * FEC group being built, if there is forward error correction.
+ */
+void single_send_for_seq(cmu_socket_t *sock, uint8_t *payload,
+                         uint16_t payload_len, uint32_t seq, uint16_t stream,
+                         int fresh) {
+  uint8_t ext_data[OPT_TIMESTAMP_LEN + OPT_STREAM_LEN + OPT_FEC_GROUP_LEN +
+                   OPT_COMPRESS_LEN + OPT_FEC_LEN + OPT_ECN_LEN];
+  uint16_t ext_len = opt_put_timestamp(ext_data, (uint32_t)get_curr_micros(),
+                                       sock->ts_recent);
+  uint32_t group;
+  int fec = fresh && sock->fec == FEC_ON;
+
+  if (stream != 0) {
+    ext_len += opt_put_stream(ext_data + ext_len, stream);
+  }
+  if (fec && fec_encode(&sock->fec_tx, seq, stream, payload, payload_len,
+                        &group)) {
+    ext_len += opt_put_fec_group(ext_data + ext_len, group);
+  }
+  if (offers_len(sock, seq) > 0) {
+    ext_len += put_offers(sock, ext_data + ext_len, TRUE, TRUE, TRUE);
+  }
+  send_packet(sock, seq, sock->window.next_seq_expected, 0, ext_data, ext_len,
+              payload, payload_len);
+  sock->last_data = get_curr_micros();
+  STAT_INC(&sock->stats, segments_sent);
+  STAT_ADD(&sock->stats, bytes_sent, payload_len);
+  if (fec && fec_repair_due(&sock->fec_tx)) {
+    send_fec_repair(sock);
+  }
+}
+
+/**
+ * Sends the data of a sending window slot from the given offset on, cut into
+ * packets that fit the current path MTU. The path MTU can have dropped since
+ * the slot was filled. Only the packets of a slot not yet `retransmitted`
+ * join FEC groups.
+ *
+ * @param sock The socket to send on.
+ * @param slot The slot to send.
+ * @param off The offset of the first byte to send.
+ *
+ * @return The number of bytes sent.
+ */
+uint32_t send_slot(cmu_socket_t *sock, sending_window *slot, uint32_t off) {
+  int mss = data_mss(sock, slot->stream);
+  uint32_t packets = 0;
+
+  for (uint32_t sent = off; sent < slot->payload_len; sent += mss) {
+    uint16_t len = MIN(slot->payload_len - sent, (uint32_t)mss);
+    single_send_for_seq(sock, slot->payload + sent, len, slot->seq + sent,
+                        slot->stream, !slot->retransmitted);
+    packets++;
+  }
+  if (slot->retransmitted && sock->fec == FEC_ON) {
+    fec_note_resent(&sock->fec_tx, packets);
+  }
+  return slot->payload_len - off;
+}
+
+/**
+ * Gets the retransmission timeout of a sending window slot: the one of the
+ * path it went on, when there are several.
+ */
+uint64_t slot_rto(cmu_socket_t *sock, const sending_window *slot) {
+  return sock->npaths > 1 ? sock->paths[slot->path].rtt.rto : sock->rtt.rto;
+}
+
+/**
+ * Gets when the first retransmission timer of an unacknowledged segment runs
+ * out.
+ *
+ * @param sock The socket.
+ *
+ * @return The time on the CMU-TCP clock, or one RTO from now if nothing is in
+ *         flight.
+ */
+uint64_t next_rto_deadline(cmu_socket_t *sock) {
+  uint32_t windows_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+  uint64_t deadline = 0;
+
+  for (uint32_t j = 0; j < windows_size; j++) {
+    sending_window *slot = &sock->window.sending_windows[j];
+    if (slot->send_time > 0 &&
+        after(slot->seq + slot->payload_len, sock->window.last_ack_received)) {
+      uint64_t t = slot->send_time + slot_rto(sock, slot);
+      if (deadline == 0 || t < deadline) {
+        deadline = t;
+      }
+    }
+  }
+  if (deadline == 0) {
+    deadline = get_curr_micros() + sock->rtt.rto;
+  }
+  return deadline;
+}
+
+/**
+ * Picks the path to send a segment on, see `path_pick`.
+ *
+ * @param sock The socket.
+ * @param len The length of the segment.
+ *
+ * @return The path.
+ */
+int pick_path(cmu_socket_t *sock, uint32_t len) {
+  uint32_t windows_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+  uint32_t in_flight[CMU_MAX_PATHS] = {0};
+  int n = sock->npaths;
+  int path;
+
+  if (n == 1) {
+    return 0;
+  }
+  for (uint32_t j = 0; j < windows_size; j++) {
+    sending_window *slot = &sock->window.sending_windows[j];
+    if (slot->send_time > 0 &&
+        after(slot->seq + slot->payload_len, sock->window.last_ack_received)) {
+      in_flight[slot->path] += slot->payload_len;
+    }
+  }
+  path = path_pick(sock->paths, n, in_flight, len);
+  return path >= 0 ? path : default_path(sock);
+}
+
+/**
+ * Gets when the next JOIN is due on a path of an initiator: right away on a
+ * new path, one RTO after the last on a joining one, MP_PROBE_US after it on
+ * one that is down.
+ *
+ * @return The time on the CMU-TCP clock, or 0 if none is.
+ */
+uint64_t join_deadline(cmu_socket_t *sock, int path) {
+  const cmu_path_t *p = &sock->paths[path];
+
+  switch (p->state) {
+    case PATH_JOINING:
+      return p->join_sent == 0 ? 1 : p->join_sent + p->rtt.rto;
+    case PATH_DOWN:
+      return p->join_sent + MP_PROBE_US;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Gets when the next JOIN is due on any path.
+ *
+ * @return The time on the CMU-TCP clock, or 0 if none is.
+ */
+uint64_t paths_deadline(cmu_socket_t *sock) {
+  uint64_t deadline = 0;
+  int n = sock->npaths;
+
+  if (sock->type != TCP_INITIATOR || !paths_joinable(sock)) {
+    return 0;
+  }
+  for (int p = 0; p < n; p++) {
+    uint64_t t = join_deadline(sock, p);
+    if (t != 0 && (deadline == 0 || t < deadline)) {
+      deadline = t;
+    }
+  }
+  return deadline;
+}
+
+/**
+ * Sends the JOINs that are due. A new path gets MP_JOIN_MAX_TRIES, backing
+ * off, before it is taken as down.
+ *
+ * @param sock The socket.
+ */
+void run_paths(cmu_socket_t *sock) {
+  uint64_t now = get_curr_micros();
+  int n = sock->npaths;
+
+  if (sock->type != TCP_INITIATOR || !paths_joinable(sock)) {
+    return;
+  }
+  for (int p = 0; p < n; p++) {
+    cmu_path_t *path = &sock->paths[p];
+    uint64_t due = join_deadline(sock, p);
+    if (due == 0 || now < due) {
+      continue;
+    }
+    if (path->state == PATH_JOINING && path->join_tries >= MP_JOIN_MAX_TRIES) {
+      LOG_DEBUG("path %d got no answer to %u JOINs", p, path->join_tries);
+      path->state = PATH_DOWN;
+      continue;
+    }
+    if (path->state == PATH_JOINING && path->join_tries > 0) {
+      rtt_backoff(&path->rtt);
+    }
+    send_join(sock, p);
+    path->join_tries++;
+    path->join_sent = now;
+  }
+}
+
+int take_send_batch(cmu_socket_t *sock, int flush, uint8_t **data,
+                    send_chunk_t **chunks, int *nchunks) {
+  int off[CMU_MAX_STREAMS] = {0};
+  int limit[CMU_MAX_STREAMS];
+  uint8_t *src[CMU_MAX_STREAMS];
+  int src_len[CMU_MAX_STREAMS];
+  uint8_t *frames = NULL;
+  int buf_len = 0, wire_len = 0, taken = 0, n = 0, count = 0;
+  int nagle, cork;
+  uint16_t last = sock->next_stream;
+
+  *data = NULL;
+  *chunks = NULL;
+  *nchunks = 0;
+  while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+  }
+  if (sock->sending_len == 0) {
+    sock->held_since = 0;
+    pthread_mutex_unlock(&(sock->send_lock));
+    return 0;
+  }
+  cork = !flush && sock->corked &&
+         (sock->held_since == 0 ||
+          get_curr_micros() - sock->held_since < CMU_CORK_MAX_US);
+  nagle = !flush && !sock->corked && !sock->nodelay;
+  for (int s = 0; s < CMU_MAX_STREAMS; s++) {
+    int len = sock->streams[s].sending_len;
+    int mss = data_mss(sock, s);
+    int full = len - len % mss;
+    limit[s] = cork || (nagle && full > 0) ? full : len;
+    buf_len += limit[s];
+    src[s] = sock->streams[s].sending_buf;
+    src_len[s] = limit[s];
+  }
+  if (sock->corked && buf_len < sock->sending_len) {
+    if (sock->held_since == 0) {
+      sock->held_since = get_curr_micros();
+    }
+  } else {
+    sock->held_since = 0;
+  }
+  if (buf_len == 0) {
+    pthread_mutex_unlock(&(sock->send_lock));
+    return 0;
+  }
+  if (sock->compress == COMPRESS_ON) {
+    uint64_t stored = 0;
+    // Each stream's last frame can be short, and costs a header of its own.
+    uint8_t *p = frames = malloc(compress_bound(buf_len) +
+                                 CMU_MAX_STREAMS * COMPRESS_FRAME_HDR_LEN);
+    for (int s = 0; s < CMU_MAX_STREAMS; s++) {
+      compressor_t *c = &sock->streams[s].compressor;
+      if (limit[s] > 0) {
+        src[s] = p;
+        src_len[s] = compress_frames(c, sock->streams[s].sending_buf,
+                                     limit[s], p);
+        p += src_len[s];
+      }
+      stored += c->stored_blocks;
+    }
+    STAT_ADD(&sock->stats, compress_raw_bytes, buf_len);
+    STAT_ADD(&sock->stats, compress_wire_bytes, p - frames);
+    STAT_SET(&sock->stats, compress_stored_blocks, stored);
+  }
+  for (int s = 0; s < CMU_MAX_STREAMS; s++) {
+    int mss = data_mss(sock, s);
+    wire_len += src_len[s];
+    count += (src_len[s] + mss - 1) / mss;
+  }
+  *data = malloc(wire_len);
+  *chunks = malloc(sizeof(send_chunk_t) * count);
+
+  while (taken < wire_len) {
+    for (int k = 0; k < CMU_MAX_STREAMS; k++) {
+      uint16_t s = (sock->next_stream + k) % CMU_MAX_STREAMS;
+      int len = MIN(src_len[s] - off[s], data_mss(sock, s));
+      if (len <= 0) {
+        continue;
+      }
+      memcpy(*data + taken, src[s] + off[s], len);
+      (*chunks)[n].len = len;
+      (*chunks)[n].stream = s;
+      off[s] += len;
+      taken += len;
+      n++;
+      last = s;
+    }
+  }
+  for (int s = 0; s < CMU_MAX_STREAMS; s++) {
+    cmu_stream_t *stream = &sock->streams[s];
+    stream->sending_len -= limit[s];
+    if (stream->sending_len == 0) {
+      free(stream->sending_buf);
+      stream->sending_buf = NULL;
+    } else if (limit[s] > 0) {
+      memmove(stream->sending_buf, stream->sending_buf + limit[s],
+              stream->sending_len);
+    }
+  }
+  sock->sending_len -= buf_len;
+  sock->next_stream = (last + 1) % CMU_MAX_STREAMS;
+  pthread_mutex_unlock(&(sock->send_lock));
+  free(frames);
+
+  *nchunks = n;
+  return buf_len;
+}
+
+int is_dying(cmu_socket_t *sock);
+void abort_connection(cmu_socket_t *sock);
+
+/**
+ * Tells if `abort_connection` dropped the connection.
+ */
+static int is_aborted(cmu_socket_t *sock) {
+  int aborted;
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  aborted = sock->aborted;
+  pthread_mutex_unlock(&(sock->death_lock));
+  return aborted;
+}
+
+/**
+ * Tells if the peer has been silent for longer than the liveness timers allow
+ * while data waits to be acknowledged: the idle timeout, or as long as the
+ * keepalive probes would take to give up on it.
+ *
+ * @param sock The socket.
+ * @param now The current time.
+ *
+ * @return 1 if the peer is taken as gone, 0 otherwise.
+ */
+static int peer_timed_out(cmu_socket_t *sock, uint64_t now) {
+  cmu_timers_t timers;
+  uint64_t silent = now - sock->last_heard;
+
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  timers = sock->timers;
+  pthread_mutex_unlock(&(sock->death_lock));
+  if (timers.idle_timeout_us > 0 && silent >= timers.idle_timeout_us) {
+    return 1;
+  }
+  return timers.keepalive_idle_us > 0 &&
+         silent >= timers.keepalive_idle_us +
+                       timers.keepalive_interval_us * timers.keepalive_probes;
+}
+
+/**
+ * Sends the data packet by packet as the window allows, and returns once all
+ * of it is acknowledged, or once the connection is aborted because the peer
+ * stopped acknowledging it.
+ *
+ * @param sock The socket to use for sending data.
+ * @param data The data to be sent.
+ * @param chunks The packets to cut the data into, see `take_send_batch`.
+ * @param nchunks The number of packets.
+ */
+void single_send(cmu_socket_t *sock, uint8_t *data, const send_chunk_t *chunks,
+                 int nchunks) {
+  uint8_t *data_offset = data;
+  int buf_len = 0;
+
+  for (int k = 0; k < nchunks; k++) {
+    buf_len += chunks[k].len;
+  }
+  if (buf_len > 0) {
+    uint32_t windows_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+    int32_t i = 1;
+    // the next chunk to send
+    int k = 0;
+    // the beginning/start, end/finish seq for data.
+    uint32_t seq = sock->window.last_ack_received;
+    uint32_t buf_end_seq = sock->window.last_ack_received + buf_len;
+    // the max seq has been sent
+    uint32_t max_seq_sent = sock->window.last_ack_received;
+    uint32_t window;
+    // when the sender started waiting on a full window, 0 if it is not
+    uint64_t blocked_since = 0;
+    // expiries of the retransmission timer since the ACK last moved
+    uint32_t retries = 0;
+    uint32_t progress = sock->window.last_ack_received;
+    // loop until all sent buf received ACK
+    while (before(sock->window.last_ack_received, buf_end_seq)) {
+      if (is_aborted(sock)) {
+        return;
+      }
+      // The window follows the path MTU as probes raise it.
+      window = MIN(sock->window.cwnd, windows_size * data_mss(sock, 0));
+      run_pmtu_probe(sock);
+      // Short packets of the other streams could fill every slot of the
+      // sending window before its bytes run out, so also wait for the next
+      // slot to be acknowledged.
+      sending_window *next = &sock->window.sending_windows[i % windows_size];
+      int can_send =
+          after(sock->window.last_ack_received + window, max_seq_sent) &&
+          (next->send_time == 0 ||
+           !after(next->seq + next->payload_len,
+                  sock->window.last_ack_received));
+      if (before(max_seq_sent, buf_end_seq)) {
+        if (!can_send && blocked_since == 0) {
+          blocked_since = get_curr_micros();
+        } else if (can_send && blocked_since != 0) {
+          STAT_ADD(&sock->stats, window_limited_us,
+                   get_curr_micros() - blocked_since);
+          blocked_since = 0;
+        }
+      }
+      // if have new buf could be sent, and has data not sent
+      if (can_send && before(max_seq_sent, buf_end_seq)) {
+        uint16_t stream = chunks[k].stream;
+        uint16_t payload_len = chunks[k++].len;
+        // The batch was cut for the path MTU of the time. Packets of the same
+        // stream that follow each other share a slot if it has grown since.
+        while (k < nchunks && chunks[k].stream == stream &&
+               payload_len + chunks[k].len <= data_mss(sock, stream)) {
+          payload_len += chunks[k++].len;
+        }
+
+        next->payload = data_offset;
+        next->payload_len = payload_len;
+        next->seq = seq;
+        next->retransmitted = FALSE;
+        next->stream = stream;
+        next->path = pick_path(sock, payload_len);
+        sock->cur_path = next->path;
+        send_slot(sock, next, 0);
+        sock->cur_path = default_path(sock);
+        next->send_time = get_curr_micros();
+
+        seq += payload_len;
+        data_offset += payload_len;
+        max_seq_sent += payload_len;
+        STAT_SET(&sock->stats, bytes_in_flight,
+                 max_seq_sent - sock->window.last_ack_received);
+        trace_sock_event(sock, TRACE_SEND, seq - payload_len, payload_len, 0);
+
+        i++;
+      }
+      // Keep sending while the window allows it. Otherwise sleep until an ACK
+      // arrives, the oldest segment's retransmission timer runs out or a path
+      // MTU probe is due.
+      run_paths(sock);
+      uint64_t deadline = next_rto_deadline(sock);
+      uint64_t probe_deadline = pmtu_deadline(&sock->pmtu, sock->rtt.rto);
+      uint64_t join_due = paths_deadline(sock);
+      if (probe_deadline != 0 && probe_deadline < deadline) {
+        deadline = probe_deadline;
+      }
+      if (join_due != 0 && join_due < deadline) {
+        deadline = join_due;
+      }
+      next = &sock->window.sending_windows[i % windows_size];
+      can_send = after(sock->window.last_ack_received + window, max_seq_sent) &&
+                 before(max_seq_sent, buf_end_seq) &&
+                 (next->send_time == 0 ||
+                  !after(next->seq + next->payload_len,
+                         sock->window.last_ack_received));
+      // Whatever is sent before a pause gets its repair now, not after it.
+      if (!can_send && sock->fec == FEC_ON) {
+        send_fec_repair(sock);
+      }
+      if (can_send || wait_for_packet(sock, deadline)) {
+        check_for_data(sock, NO_WAIT);
+      }
+      STAT_SET(&sock->stats, bytes_in_flight,
+               max_seq_sent - sock->window.last_ack_received);
+      if (after(sock->window.last_ack_received, progress)) {
+        progress = sock->window.last_ack_received;
+        retries = 0;
+      }
+
+      // Resend every unacknowledged packet whose timer expired. The timeout is
+      // backed off once per expiry, and resent packets are flagged so that the
+      // RTT fallback for ACKs without timestamps skips them (Karn's rule).
+      // With several paths, the packets go out again on whichever path is
+      // best now. Only the path of the first missing byte is to blame: the
+      // ACKs of those behind it wait for it, whichever path they took.
+      uint64_t now = get_curr_micros();
+      int expired = FALSE;
+      if (peer_timed_out(sock, now)) {
+        LOG_WARN("%s:%u silent for %lu us with data in flight, dropping it",
+                 inet_ntoa(sock->conn.sin_addr), ntohs(sock->conn.sin_port),
+                 (unsigned long)(now - sock->last_heard));
+        abort_connection(sock);
+        return;
+      }
+      for (uint32_t j = 0; j < windows_size; j++) {
+        sending_window *slot = &sock->window.sending_windows[j];
+        uint64_t rto = slot_rto(sock, slot);
+        if (slot->send_time > 0 &&
+            after(slot->seq + slot->payload_len,
+                  sock->window.last_ack_received) &&
+            now - slot->send_time >= rto) {
+          // Bytes at the front may be acknowledged if the slot went out as
+          // several packets.
+          uint32_t off = after(sock->window.last_ack_received, slot->seq)
+                             ? sock->window.last_ack_received - slot->seq
+                             : 0;
+          uint32_t resent;
+          if (sock->npaths > 1) {
+            if (!after(slot->seq, sock->window.last_ack_received)) {
+              if (path_timed_out(&sock->paths[slot->path],
+                                 data_mss(sock, 0))) {
+                LOG_INFO("path %d down, failing over", slot->path);
+                STAT_INC(&sock->stats, path_failovers);
+                publish_paths(sock);
+              }
+            }
+            slot->path = pick_path(sock, slot->payload_len - off);
+          }
+          slot->retransmitted = TRUE;
+          sock->cur_path = slot->path;
+          resent = send_slot(sock, slot, off);
+          sock->cur_path = default_path(sock);
+          trace_sock_event(sock, TRACE_RETRANSMIT, slot->seq, slot->payload_len,
+                           (uint32_t)(now - slot->send_time));
+          slot->send_time = now;
+          expired = TRUE;
+          STAT_INC(&sock->stats, segments_retransmitted);
+          LOG_TRACE("retransmit seq=%" PRIu64 " len=%" PRIu64 " rto=%" PRIu64,
+                    slot->seq, slot->payload_len, rto);
+          STAT_ADD(&sock->stats, bytes_retransmitted, resent);
+        }
+      }
+      if (expired &&
+          ++retries > (is_dying(sock) ? FIN_MAX_RETRIES : DATA_MAX_RETRIES)) {
+        LOG_WARN("peer did not acknowledge seq %u after %u retransmissions, "
+                 "giving up on port %u",
+                 sock->window.last_ack_received, retries - 1, sock->my_port);
+        abort_connection(sock);
+        return;
+      }
+      if (expired) {
+        rtt_backoff(&sock->rtt);
+        publish_rtt_stats(sock);
+        STAT_INC(&sock->stats, rto_expirations);
+        trace_sock_event(sock, TRACE_RTO, sock->window.last_ack_received, 0,
+                         (uint32_t)sock->rtt.rto);
+        // Timeouts that keep coming may mean a hop drops packets of the
+        // current path MTU without telling us. Fall back until probes find
+        // out what gets through, or fragment if not even the base does.
+        if (pmtu_timeout(&sock->pmtu)) {
+          if (sock->pmtu.fragment) {
+            clear_df(sock);
+            LOG_DEBUG("path MTU black hole at %u, fragmenting",
+                      sock->pmtu.plpmtu);
+          } else {
+            set_pmtu_cwnd(sock);
+            LOG_DEBUG("path MTU black hole, back to %u", sock->pmtu.plpmtu);
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Picks a random initial sequence number.
+ */
+uint32_t new_isn(void) {
+  uint32_t isn;
+  if (getrandom(&isn, sizeof(isn), 0) != (ssize_t)sizeof(isn)) {
+    isn = (uint32_t)rand() ^ (uint32_t)get_curr_micros();
+  }
+  return isn;
+}
+
+/**
+ * Tells if the application closed the socket.
+ */
+int is_dying(cmu_socket_t *sock) {
+  int death;
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  death = sock->dying;
+  pthread_mutex_unlock(&(sock->death_lock));
+  return death;
+}
+
+/**
+ * Tells if the application has written anything the backend has not sent.
+ */
+int has_pending_data(cmu_socket_t *sock) {
+  int pending;
+  while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+  }
+  pending = sock->sending_len > 0;
+  pthread_mutex_unlock(&(sock->send_lock));
+  return pending;
+}
+
+/**
+ * Connects to the listener. The SYN is resent every RTO, backing off
+ * exponentially, until the SYN-ACK arrives. The attempt is abandoned when the
+ * socket is closed with nothing left to send, or after SYN_MAX_RETRIES, in
+ * which case reads see the end of the stream.
+ *
+ * A fast open socket that has a cookie for the listener sends the start of the
+ * first write with the SYN. Whatever the SYN-ACK acknowledges of it is then
+ * dropped from the send buffer; the rest goes out as usual.
+ */
+void client_handshake(cmu_socket_t *sock) {
+  uint32_t isn = new_isn();
+  uint8_t ext[OPT_MAX_LEN];
+  uint16_t ext_len = 0;
+  uint8_t syn_data[MSS];
+  uint8_t cookie[OPT_FASTOPEN_COOKIE_LEN];
+  uint64_t sent_at = 0;
+  int retries = 0;
+  int have_cookie = FALSE;
+
+  sock->handshake.iss = isn;
+  sock->window.last_ack_received = isn;
+  sock->state = SYN_SENT;
+  load_metrics(sock);
+
+  if (sock->fastopen) {
+    have_cookie = fastopen_cache_get(&(sock->conn), cookie);
+    ext_len = opt_put_fastopen(ext, have_cookie ? cookie : NULL);
+  }
+  ext_len += put_offers(sock, ext + ext_len, TRUE, TRUE, TRUE);
+  if (have_cookie) {
+    // The data gets what the options leave of a MAX_LEN packet, the path MTU
+    // being unknown yet.
+    while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+    }
+    sock->handshake.syn_data_len =
+        MIN((uint32_t)sock->streams[0].sending_len,
+            (uint32_t)(MSS - ext_len - OPT_CRC32C_LEN));
+    memcpy(syn_data, sock->streams[0].sending_buf,
+           sock->handshake.syn_data_len);
+    pthread_mutex_unlock(&(sock->send_lock));
+  }
+
+  while (sock->state == SYN_SENT) {
+    uint64_t now = get_curr_micros();
+    if (is_dying(sock) && !has_pending_data(sock)) {
+      sock->state = CLOSED;
+      break;
+    }
+    if (sent_at == 0 || now - sent_at >= sock->rtt.rto) {
+      if (sent_at != 0) {
+        if (++retries > SYN_MAX_RETRIES) {
+          LOG_WARN("no answer from %s:%u, giving up",
+                   inet_ntoa(sock->conn.sin_addr), ntohs(sock->conn.sin_port));
+          sock->state = CLOSED;
+          break;
+        }
+        rtt_backoff(&sock->rtt);
+        publish_rtt_stats(sock);
+      }
+      send_packet(sock, isn, 0, SYN_FLAG_MASK, ext, ext_len, syn_data,
+                  sock->handshake.syn_data_len);
+      LOG_DEBUG("client sent SYN, seq:%u, data:%u", isn,
+                sock->handshake.syn_data_len);
+      sent_at = now;
+    }
+    if (wait_for_packet(sock, sent_at + sock->rtt.rto)) {
+      check_for_data(sock, NO_WAIT);
+    }
+  }
+  if (sock->state != ESTABLISHED) {
+    while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+    }
+    sock->received_fin = TRUE;
+    pthread_cond_broadcast(&(sock->wait_cond));
+    pthread_mutex_unlock(&(sock->recv_lock));
+    return;
+  }
+
+  // The SYN-ACK times a round trip, unless the SYN was resent (Karn's rule).
+  if (retries == 0) {
+    take_rtt_sample(sock, get_curr_micros() - sent_at);
+  }
+  uint32_t acked = sock->window.last_ack_received - (isn + 1);
+  if (acked > 0) {
+    while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+    }
+    cmu_stream_t *stream = &sock->streams[0];
+    memmove(stream->sending_buf, stream->sending_buf + acked,
+            stream->sending_len - acked);
+    stream->sending_len -= acked;
+    sock->sending_len -= acked;
+    pthread_mutex_unlock(&(sock->send_lock));
+    STAT_ADD(&sock->stats, bytes_acked, acked);
+  }
+}
+
+/**
+ * Waits for a SYN without spinning, then answers it with a SYN-ACK, resent
+ * every RTO with exponential backoff until the final ACK arrives. Closing the
+ * socket only stops it while no SYN has arrived; a client that stops
+ * answering for SYN_MAX_RETRIES is forgotten and the next SYN awaited.
+ */
+void server_handshake(cmu_socket_t *sock) {
+  uint32_t isn = new_isn();
+  uint64_t sent_at = 0;
+  int retries = 0;
+
+  sock->handshake.iss = isn;
+  sock->window.last_ack_received = isn;
+  sock->state = LISTEN;
+
+  while (sock->state != ESTABLISHED) {
+    if (sock->state == LISTEN) {
+      if (is_dying(sock)) {
+        break;
+      }
+      if (wait_for_packet(sock, 0)) {
+        check_for_data(sock, NO_WAIT);
+      }
+      continue;
+    }
+
+    uint64_t now = get_curr_micros();
+    if (sent_at != 0 && !sock->handshake.resend &&
+        now - sent_at >= sock->rtt.rto && retries >= SYN_MAX_RETRIES) {
+      LOG_WARN("no ACK from %s:%u, listening again",
+               inet_ntoa(sock->conn.sin_addr), ntohs(sock->conn.sin_port));
+      sock->state = LISTEN;
+      sent_at = 0;
+      retries = 0;
+      continue;
+    }
+    if (sent_at == 0 || sock->handshake.resend ||
+        now - sent_at >= sock->rtt.rto) {
+      uint8_t ext[OPT_MAX_LEN];
+      uint16_t ext_len = 0;
+      if (sock->handshake.send_cookie) {
+        uint8_t cookie[OPT_FASTOPEN_COOKIE_LEN];
+        fastopen_make_cookie(&(sock->conn), cookie);
+        ext_len = opt_put_fastopen(ext, cookie);
+      }
+      ext_len += put_offers(sock, ext + ext_len, sock->handshake.peer_compress,
+                            sock->handshake.peer_fec,
+                            sock->handshake.peer_ecn);
+      if (sent_at != 0 && !sock->handshake.resend) {
+        rtt_backoff(&sock->rtt);
+        publish_rtt_stats(sock);
+      }
+      if (sent_at != 0) {
+        retries++;
+      }
+      sock->handshake.resend = FALSE;
+      send_packet(sock, isn, sock->window.next_seq_expected,
+                  SYN_FLAG_MASK | ACK_FLAG_MASK, ext, ext_len, NULL, 0);
+      LOG_DEBUG("server sent SYN-ACK, seq:%u, ack:%u", isn,
+                sock->window.next_seq_expected);
+      sent_at = now;
+    }
+    if (wait_for_packet(sock, sent_at + sock->rtt.rto)) {
+      check_for_data(sock, NO_WAIT);
+    }
+  }
+  // A SYN cookie handshake leaves no send time to measure from.
+  if (sock->state == ESTABLISHED && sent_at != 0 && retries == 0) {
+    take_rtt_sample(sock, get_curr_micros() - sent_at);
+  }
+}
+
+void init_handshake(cmu_socket_t *sock) {
+  if (sock->type == TCP_INITIATOR) {
+    client_handshake(sock);
+  } else if (sock->type == TCP_LISTENER) {
+    server_handshake(sock);
+  }
+}
+
+/**
+ * Drops a connection whose peer stopped answering. Data already received can
+ * still be read, followed by the end of the stream. Unsent data is thrown away
+ * and writes fail from now on.
+ *
+ * @param sock The socket to drop the connection of.
+ */
+void abort_connection(cmu_socket_t *sock) {
+  sock->state = CLOSED;
+
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  sock->aborted = TRUE;
+  pthread_mutex_unlock(&(sock->death_lock));
+
+  while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+  }
+  for (int i = 0; i < CMU_MAX_STREAMS; i++) {
+    free(sock->streams[i].sending_buf);
+    sock->streams[i].sending_buf = NULL;
+    sock->streams[i].sending_len = 0;
+  }
+  sock->sending_len = 0;
+  pthread_mutex_unlock(&(sock->send_lock));
+
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+  sock->received_fin = TRUE;
+  pthread_cond_broadcast(&(sock->wait_cond));
+  pthread_mutex_unlock(&(sock->recv_lock));
+}
+
+/**
+ * Sends our FIN once the application is done writing, and resends it whenever
+ * the retransmission timer expires until the peer acknowledges it.
+ *
+ * @param sock The socket to close the sending half of.
+ */
+void send_or_resend_fin(cmu_socket_t *sock) {
+  uint64_t now = get_curr_micros();
+
+  if (sock->fin_send_time == 0) {
+    if (sock->state != ESTABLISHED && sock->state != CLOSE_WAIT) {
+      return;
+    }
+    sock->fin_seq = sock->window.last_ack_received;
+    sock->state = sock->state == ESTABLISHED ? FIN_WAIT_1 : LAST_ACK;
+    LOG_DEBUG("sending FIN, seq:%u", sock->fin_seq);
+  } else if ((sock->state != FIN_WAIT_1 && sock->state != CLOSING &&
+              sock->state != LAST_ACK) ||
+             now - sock->fin_send_time < sock->rtt.rto) {
+    return;
+  } else if (++sock->fin_retries > FIN_MAX_RETRIES) {
+    LOG_WARN("peer did not acknowledge FIN, giving up on port %u",
+             sock->my_port);
+    abort_connection(sock);
+    return;
+  } else {
+    rtt_backoff(&sock->rtt);
+    publish_rtt_stats(sock);
+  }
+  send_packet(sock, sock->fin_seq, sock->window.next_seq_expected,
+              FIN_FLAG_MASK | ACK_FLAG_MASK, NULL, 0, NULL, 0);
+  sock->fin_send_time = now;
+}
+
+/**
+ * What is left of a connection after `cmu_close` returns: enough to receive
+ * the peer's FIN and to acknowledge it again during TIME_WAIT.
+ */
+typedef struct {
+  int socket;
+  struct sockaddr_in conn;
+  uint16_t my_port;
+  uint32_t seq;  // our next sequence number, after the FIN
+  uint32_t ack;  // the next sequence number expected from the peer
+  server_state_t state;
+  uint64_t deadline;      // when the current state ends
+  uint64_t time_wait_us;  // how long TIME_WAIT lasts
+  int crc32c;             // whether ACKs carry the CRC32C option
+  cmu_link_t *link;
+} linger_t;
+
+static void linger_send_ack(linger_t *l) {
+  uint8_t msg[sizeof(cmu_tcp_header_t) + OPT_CRC32C_LEN];
+  uint8_t ext[OPT_CRC32C_LEN];
+  uint16_t ext_len = l->crc32c ? opt_put_crc32c(ext, 0) : 0;
+  uint16_t len = sizeof(cmu_tcp_header_t) + ext_len;
+
+  set_header((cmu_tcp_header_t *)msg, l->my_port, ntohs(l->conn.sin_port),
+             l->seq, l->ack, len, len, ACK_FLAG_MASK, 1, ext_len, ext);
+  if (l->crc32c) {
+    stamp_crc32c(msg, len, len);
+  }
+  link_send(l->link, l->socket, msg, len, &(l->conn));
+}
+
+/**
+ * Runs FIN_WAIT_2 and TIME_WAIT for a closed socket, then closes its UDP
+ * socket. Data the peer still sends is acknowledged and thrown away, since
+ * nobody is left to read it.
+ */
+static void *linger_thread(void *in) {
+  linger_t *l = in;
+  uint8_t buf[PMTU_MAX_LEN];
+  struct pollfd fd = {l->socket, POLLIN, 0};
+
+  while (1) {
+    uint64_t now = get_curr_micros();
+    uint64_t until = l->deadline;
+    uint64_t release = link_next_release(l->link);
+
+    if (now >= l->deadline) {
+      break;
+    }
+    if (release != 0 && release < until) {
+      until = release;
+    }
+    if (poll(&fd, 1, (int)((until - now + 999) / 1000)) > 0) {
+      ssize_t n = recv(l->socket, buf, sizeof(buf), MSG_DONTWAIT);
+      cmu_hdr_t hdr;
+      hdr_decode(buf, &hdr);
+      if (n > 0 && hdr_valid(&hdr, n, l->my_port) &&
+          check_crc32c(&hdr) >= (l->crc32c ? 1 : 0)) {
+        uint32_t seq = hdr.seq;
+        if (hdr.flags & FIN_FLAG_MASK) {
+          if (l->state == FIN_WAIT_2 && seq == l->ack) {
+            l->ack = seq + 1;
+            l->state = TIME_WAIT;
+            l->deadline = get_curr_micros() + l->time_wait_us;
+          }
+          linger_send_ack(l);
+        } else if (hdr.payload_len > 0) {
+          if (l->state == FIN_WAIT_2 && seq == l->ack) {
+            l->ack += hdr.payload_len;
+          }
+          linger_send_ack(l);
+        }
+      }
+    }
+    link_flush(l->link);
+  }
+
+  if (l->state == FIN_WAIT_2) {
+    LOG_INFO("no FIN from the peer of port %u, closing", l->my_port);
+  }
+  link_destroy(l->link);
+  close(l->socket);
+  free(l);
+  return NULL;
+}
+
+/**
+ * Hands the UDP socket of a connection waiting in FIN_WAIT_2 or TIME_WAIT over
+ * to a detached thread, so that `cmu_close` does not have to wait for it. On
+ * a multipath connection, that is the socket of the path last heard from,
+ * which the peer's FIN most likely takes too.
+ *
+ * The socket is connected to the peer first. A connected UDP socket is
+ * preferred for the peer's datagrams, so a new listener can bind the same port
+ * straight away and still get every other peer's SYN.
+ *
+ * @param sock The socket being closed. Its UDP socket and link are taken.
+ */
+void start_linger(cmu_socket_t *sock) {
+  linger_t *l = malloc(sizeof(linger_t));
+  pthread_t thread;
+  int path = default_path(sock);
+
+  if (l == NULL) {
+    return;
+  }
+  l->socket = path_fd(sock, path);
+  l->conn = *path_peer(sock, path);
+  l->my_port = path_port(sock, path);
+  l->seq = sock->fin_seq + 1;
+  l->ack = sock->window.next_seq_expected;
+  l->state = sock->state;
+  l->time_wait_us = TIME_WAIT_RTOS * sock->rtt.rto;
+  l->deadline = get_curr_micros() + (sock->state == TIME_WAIT
+                                         ? l->time_wait_us
+                                         : FIN_WAIT_2_TIMEOUT_US);
+  l->crc32c = sock->crc32c != CRC32C_OFF;
+  l->link = sock->link;
+  connect(l->socket, (struct sockaddr *)&(l->conn), sizeof(l->conn));
+
+  if (pthread_create(&thread, NULL, linger_thread, l) != 0) {
+    free(l);
+    return;
+  }
+  pthread_detach(thread);
+  if (l->socket == sock->socket) {
+    sock->socket = -1;
+  } else {
+    sock->paths[path].fd = -1;
+  }
+  sock->link = NULL;
+}
+
+/**
+ * Gets when the next keepalive probe is due, or when an unanswered probe
+ * means the peer is gone.
+ */
+static uint64_t keepalive_deadline(cmu_socket_t *sock,
+                                   const cmu_timers_t *timers) {
+  if (sock->probes_sent == 0) {
+    return sock->last_heard + timers->keepalive_idle_us;
+  }
+  return sock->probe_time + timers->keepalive_interval_us;
+}
+
+/**
+ * Gets when the next timer of a connection with nothing to send fires: a FIN
+ * retransmission, a keepalive probe, the idle timeout, the end of a cork or a
+ * JOIN.
+ *
+ * @param sock The socket.
+ * @param timers The liveness timers of the socket.
+ *
+ * @return The time on the CMU-TCP clock, or 0 if no timer is running.
+ */
+uint64_t next_timer_deadline(cmu_socket_t *sock, const cmu_timers_t *timers) {
+  uint64_t deadline = 0;
+
+  if (sock->fin_send_time != 0 &&
+      (sock->state == FIN_WAIT_1 || sock->state == CLOSING ||
+       sock->state == LAST_ACK)) {
+    deadline = sock->fin_send_time + sock->rtt.rto;
+  }
+  if (sock->state == ESTABLISHED || sock->state == CLOSE_WAIT) {
+    if (timers->keepalive_idle_us > 0) {
+      uint64_t t = keepalive_deadline(sock, timers);
+      if (deadline == 0 || t < deadline) {
+        deadline = t;
+      }
+    }
+    if (timers->idle_timeout_us > 0) {
+      uint64_t t = sock->last_data + timers->idle_timeout_us;
+      if (deadline == 0 || t < deadline) {
+        deadline = t;
+      }
+    }
+  }
+  if (sock->held_since != 0) {
+    uint64_t t = sock->held_since + CMU_CORK_MAX_US;
+    if (deadline == 0 || t < deadline) {
+      deadline = t;
+    }
+  }
+  if (paths_deadline(sock) != 0) {
+    uint64_t t = paths_deadline(sock);
+    if (deadline == 0 || t < deadline) {
+      deadline = t;
+    }
+  }
+  return deadline;
+}
+
+/**
+ * Acts on the liveness timers that have run out: closes an idle connection,
+ * sends a keepalive probe or drops a connection whose peer is gone.
+ *
+ * @param sock The socket.
+ * @param timers The liveness timers of the socket.
+ */
+void run_liveness_timers(cmu_socket_t *sock, const cmu_timers_t *timers) {
+  uint64_t now = get_curr_micros();
+
+  if (sock->state != ESTABLISHED && sock->state != CLOSE_WAIT) {
+    return;
+  }
+  if (timers->idle_timeout_us > 0 &&
+      now - sock->last_data >= timers->idle_timeout_us) {
+    LOG_INFO("connection on port %u idle for %lu us, closing", sock->my_port,
+             (unsigned long)(now - sock->last_data));
+    // Close our half as `cmu_shutdown` would; the FIN goes out right away.
+    while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+    }
+    sock->shutting_down = 1;
+    pthread_mutex_unlock(&(sock->death_lock));
+    sock->wake_pending = TRUE;
+    return;
+  }
+  if (timers->keepalive_idle_us > 0 && now >= keepalive_deadline(sock, timers)) {
+    if (sock->probes_sent >= timers->keepalive_probes) {
+      LOG_WARN("%s:%u did not answer %u keepalive probes, dropping it",
+               inet_ntoa(sock->conn.sin_addr), ntohs(sock->conn.sin_port),
+               sock->probes_sent);
+      abort_connection(sock);
+      return;
+    }
+    // An empty segment just below what the peer has acknowledged, which it
+    // answers with an ACK.
+    send_packet(sock, sock->window.last_ack_received - 1,
+                sock->window.next_seq_expected, 0, NULL, 0, NULL, 0);
+    sock->probes_sent++;
+    sock->probe_time = now;
+    STAT_INC(&sock->stats, keepalive_probes);
+  }
+}
+
+void alloc_windows(cmu_socket_t *sock) {
+  uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+  if (sock->window.sending_windows != NULL) {
+    return;
+  }
+  sock->window.sending_windows =
+      (sending_window *)malloc(sizeof(sending_window) * window_size);
+  memset(sock->window.sending_windows, 0, sizeof(sending_window) * window_size);
+  sock->window.received_windows =
+      (receiving_window *)malloc(sizeof(receiving_window) * window_size);
+  memset(sock->window.received_windows, 0,
+         sizeof(receiving_window) * window_size);
+  for (uint32_t i = 0; i < window_size; i++) {
+    sock->window.received_windows[i].segment = segment_get(sock);
+  }
+}
+
+/**
+ * Frees the send and receive windows and the segments in them.
+ */
+void free_windows(cmu_socket_t *sock) {
+  uint32_t window_size = WINDOW_INITIAL_WINDOW_SIZE / MSS;
+  if (sock->window.sending_windows != NULL) {
+    free(sock->window.sending_windows);
+    for (uint32_t i = 0; i < window_size; i++) {
+      free(sock->window.received_windows[i].segment);
+    }
+    free(sock->window.received_windows);
+    sock->window.sending_windows = NULL;
+    sock->window.received_windows = NULL;
+  }
+  fec_encoder_free(&sock->fec_tx);
+  fec_decoder_free(&sock->fec_rx);
+}
+
+void *begin_backend(void *in) {
+  cmu_socket_t *sock = (cmu_socket_t *)in;
+  int death, shutting_down, buf_len, send_signal, nchunks;
+  cmu_timers_t timers;
+  uint8_t *data;
+  send_chunk_t *chunks;
+  // init
+  sock->rx_bufs = malloc(RECV_BATCH * PMTU_MAX_LEN);
+  // A listener waits for a client to commit to a connection first.
+  if (sock->type == TCP_INITIATOR) {
+    while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+    }
+    alloc_windows(sock);
+    pthread_mutex_unlock(&(sock->recv_lock));
+  }
+  LOG_DEBUG("start handshake");
+  init_handshake(sock);
+  if (sock->state != ESTABLISHED) {
+    // Closed before the connection was established.
+    free_windows(sock);
+    free(sock->rx_bufs);
+    pthread_exit(NULL);
+    return NULL;
+  }
+  LOG_INFO("connection established on port %u", sock->my_port);
+  sock->trace =
+      trace_open(sock->my_port, ntohs(sock->conn.sin_port), sock->type);
+  trace_sock_event(sock, TRACE_CWND, sock->window.last_ack_received, 0,
+                   sock->window.ssthresh);
+  sock->last_heard = get_curr_micros();
+  sock->last_data = sock->last_heard;
+
+  while (1) {
+    // Cleared before looking at what the application asked for, so that a
+    // wake-up consumed from here on is noticed below.
+    sock->wake_pending = FALSE;
+    while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+    }
+    death = sock->dying;
+    shutting_down = sock->shutting_down;
+    timers = sock->timers;
+    pthread_mutex_unlock(&(sock->death_lock));
+
+    buf_len = take_send_batch(sock, death || shutting_down, &data, &chunks,
+                              &nchunks);
+    if (buf_len > 0) {
+      single_send(sock, data, chunks, nchunks);
+      free(data);
+      free(chunks);
+    }
+
+    // single_send only returns once everything is acknowledged, so the FIN
+    // goes out right after the last data.
+    if ((death || shutting_down) && buf_len == 0) {
+      send_or_resend_fin(sock);
+    }
+    run_liveness_timers(sock, &timers);
+    run_paths(sock);
+    // A closed connection needs nothing more from the backend, whether both
+    // FINs went through or the peer is gone.
+    if (sock->state == CLOSED ||
+        (death && (sock->state == FIN_WAIT_2 || sock->state == TIME_WAIT))) {
+      break;
+    }
+
+    // Sleep until a packet arrives, the application wakes us up or a timer
+    // fires, so an idle connection costs no CPU. After sending, go round once
+    // more first: a FIN may be due now that the data is out.
+    if (buf_len > 0 || sock->wake_pending ||
+        wait_for_packet(sock, next_timer_deadline(sock, &timers))) {
+      check_for_data(sock, NO_WAIT);
+    }
 
     while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
     }
@@ -536,17 +2789,21 @@ void *begin_backend(void *in) {
 
     pthread_mutex_unlock(&(sock->recv_lock));
 
+    // Readers of different streams share the condition variable.
     if (send_signal) {
-      pthread_cond_signal(&(sock->wait_cond));
+      pthread_cond_broadcast(&(sock->wait_cond));
     }
   }
 
-  free(sock->window.sending_windows);
-  for (int i = 0; i < window_size; i++) {
-    free(sock->window.received_windows[i].payload);
+  trace_close(sock->trace);
+  sock->trace = NULL;
+  save_metrics(sock);
+  if (sock->state == FIN_WAIT_2 || sock->state == TIME_WAIT) {
+    start_linger(sock);
   }
-  free(sock->window.received_windows);
 
+  free_windows(sock);
+  free(sock->rx_bufs);
   pthread_exit(NULL);
   return NULL;
 }
\ No newline at end of file
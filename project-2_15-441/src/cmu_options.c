@@ -0,0 +1,273 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements helpers to write and parse header extension options.
+ */
+
+#include "cmu_options.h"
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint8_t* opt_find(const uint8_t* ext, uint16_t ext_len, uint8_t kind,
+                        uint8_t* len) {
+  uint16_t off = 0;
+  while (off + OPT_HDR_LEN <= ext_len) {
+    uint8_t opt_kind = ext[off];
+    uint8_t opt_len = ext[off + 1];
+    if (opt_len < OPT_HDR_LEN || off + opt_len > ext_len) {
+      return NULL;
+    }
+    if (opt_kind == kind) {
+      *len = opt_len - OPT_HDR_LEN;
+      return ext + off + OPT_HDR_LEN;
+    }
+    off += opt_len;
+  }
+  return NULL;
+}
+
+uint16_t opt_put_timestamp(uint8_t* ext, uint32_t tsval, uint32_t tsecr) {
+  uint32_t val = htonl(tsval);
+  uint32_t ecr = htonl(tsecr);
+  ext[0] = OPT_TIMESTAMP;
+  ext[1] = OPT_TIMESTAMP_LEN;
+  memcpy(ext + OPT_HDR_LEN, &val, sizeof(val));
+  memcpy(ext + OPT_HDR_LEN + sizeof(val), &ecr, sizeof(ecr));
+  return OPT_TIMESTAMP_LEN;
+}
+
+int opt_get_timestamp(const uint8_t* ext, uint16_t ext_len, uint32_t* tsval,
+                      uint32_t* tsecr) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_TIMESTAMP, &len);
+  uint32_t v;
+  if (val == NULL || len != OPT_TIMESTAMP_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&v, val, sizeof(v));
+  *tsval = ntohl(v);
+  memcpy(&v, val + sizeof(v), sizeof(v));
+  *tsecr = ntohl(v);
+  return 1;
+}
+
+uint16_t opt_put_fastopen(uint8_t* ext, const uint8_t* cookie) {
+  ext[0] = OPT_FASTOPEN;
+  if (cookie == NULL) {
+    ext[1] = OPT_HDR_LEN;
+    return OPT_HDR_LEN;
+  }
+  ext[1] = OPT_HDR_LEN + OPT_FASTOPEN_COOKIE_LEN;
+  memcpy(ext + OPT_HDR_LEN, cookie, OPT_FASTOPEN_COOKIE_LEN);
+  return OPT_HDR_LEN + OPT_FASTOPEN_COOKIE_LEN;
+}
+
+int opt_get_fastopen(const uint8_t* ext, uint16_t ext_len, uint8_t* cookie) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_FASTOPEN, &len);
+  if (val == NULL) {
+    return -1;
+  }
+  if (len == 0) {
+    return 0;
+  }
+  if (len != OPT_FASTOPEN_COOKIE_LEN) {
+    return -1;
+  }
+  memcpy(cookie, val, OPT_FASTOPEN_COOKIE_LEN);
+  return 1;
+}
+
+uint16_t opt_put_stream(uint8_t* ext, uint16_t stream) {
+  uint16_t id = htons(stream);
+  ext[0] = OPT_STREAM;
+  ext[1] = OPT_STREAM_LEN;
+  memcpy(ext + OPT_HDR_LEN, &id, sizeof(id));
+  return OPT_STREAM_LEN;
+}
+
+uint16_t opt_get_stream(const uint8_t* ext, uint16_t ext_len) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_STREAM, &len);
+  uint16_t id;
+  if (val == NULL || len != OPT_STREAM_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&id, val, sizeof(id));
+  return ntohs(id);
+}
+
+uint16_t opt_put_pmtu(uint8_t* ext, uint16_t size) {
+  uint16_t val = htons(size);
+  ext[0] = OPT_PMTU;
+  ext[1] = OPT_PMTU_LEN;
+  memcpy(ext + OPT_HDR_LEN, &val, sizeof(val));
+  return OPT_PMTU_LEN;
+}
+
+uint16_t opt_get_pmtu(const uint8_t* ext, uint16_t ext_len) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_PMTU, &len);
+  uint16_t size;
+  if (val == NULL || len != OPT_PMTU_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&size, val, sizeof(size));
+  return ntohs(size);
+}
+
+uint16_t opt_put_crc32c(uint8_t* ext, uint32_t crc) {
+  uint32_t val = htonl(crc);
+  ext[0] = OPT_CRC32C;
+  ext[1] = OPT_CRC32C_LEN;
+  memcpy(ext + OPT_HDR_LEN, &val, sizeof(val));
+  return OPT_CRC32C_LEN;
+}
+
+uint16_t opt_put_compress(uint8_t* ext) {
+  ext[0] = OPT_COMPRESS;
+  ext[1] = OPT_COMPRESS_LEN;
+  return OPT_COMPRESS_LEN;
+}
+
+int opt_get_compress(const uint8_t* ext, uint16_t ext_len) {
+  uint8_t len;
+  return opt_find(ext, ext_len, OPT_COMPRESS, &len) != NULL &&
+         len == OPT_COMPRESS_LEN - OPT_HDR_LEN;
+}
+
+uint16_t opt_put_fec(uint8_t* ext) {
+  ext[0] = OPT_FEC;
+  ext[1] = OPT_FEC_LEN;
+  return OPT_FEC_LEN;
+}
+
+int opt_get_fec(const uint8_t* ext, uint16_t ext_len) {
+  uint8_t len;
+  return opt_find(ext, ext_len, OPT_FEC, &len) != NULL &&
+         len == OPT_FEC_LEN - OPT_HDR_LEN;
+}
+
+uint16_t opt_put_fec_group(uint8_t* ext, uint32_t group) {
+  uint32_t val = htonl(group);
+  ext[0] = OPT_FEC_GROUP;
+  ext[1] = OPT_FEC_GROUP_LEN;
+  memcpy(ext + OPT_HDR_LEN, &val, sizeof(val));
+  return OPT_FEC_GROUP_LEN;
+}
+
+int opt_get_fec_group(const uint8_t* ext, uint16_t ext_len, uint32_t* group) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_FEC_GROUP, &len);
+  uint32_t v;
+  if (val == NULL || len != OPT_FEC_GROUP_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&v, val, sizeof(v));
+  *group = ntohl(v);
+  return 1;
+}
+
+uint16_t opt_put_fec_repair(uint8_t* ext, const fec_repair_t* repair) {
+  uint32_t group = htonl(repair->group);
+  uint32_t seq = htonl(repair->seq);
+  uint16_t len = htons(repair->len);
+  uint16_t stream = htons(repair->stream);
+  ext[0] = OPT_FEC_REPAIR;
+  ext[1] = OPT_FEC_REPAIR_LEN;
+  memcpy(ext + 2, &group, sizeof(group));
+  ext[6] = repair->count;
+  memcpy(ext + 7, &seq, sizeof(seq));
+  memcpy(ext + 11, &len, sizeof(len));
+  memcpy(ext + 13, &stream, sizeof(stream));
+  return OPT_FEC_REPAIR_LEN;
+}
+
+int opt_get_fec_repair(const uint8_t* ext, uint16_t ext_len,
+                       fec_repair_t* repair) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_FEC_REPAIR, &len);
+  uint32_t group, seq;
+  uint16_t payload_len, stream;
+  if (val == NULL || len != OPT_FEC_REPAIR_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&group, val, sizeof(group));
+  memcpy(&seq, val + 5, sizeof(seq));
+  memcpy(&payload_len, val + 9, sizeof(payload_len));
+  memcpy(&stream, val + 11, sizeof(stream));
+  repair->group = ntohl(group);
+  repair->count = val[4];
+  repair->seq = ntohl(seq);
+  repair->len = ntohs(payload_len);
+  repair->stream = ntohs(stream);
+  return 1;
+}
+
+uint16_t opt_put_mp_join(uint8_t* ext, uint32_t initiator_iss,
+                         uint32_t listener_iss) {
+  uint32_t a = htonl(initiator_iss);
+  uint32_t b = htonl(listener_iss);
+  ext[0] = OPT_MP_JOIN;
+  ext[1] = OPT_MP_JOIN_LEN;
+  memcpy(ext + OPT_HDR_LEN, &a, sizeof(a));
+  memcpy(ext + OPT_HDR_LEN + 4, &b, sizeof(b));
+  return OPT_MP_JOIN_LEN;
+}
+
+int opt_get_mp_join(const uint8_t* ext, uint16_t ext_len,
+                    uint32_t* initiator_iss, uint32_t* listener_iss) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_MP_JOIN, &len);
+  uint32_t a, b;
+  if (val == NULL || len != OPT_MP_JOIN_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&a, val, sizeof(a));
+  memcpy(&b, val + 4, sizeof(b));
+  *initiator_iss = ntohl(a);
+  *listener_iss = ntohl(b);
+  return 1;
+}
+
+uint16_t opt_put_ecn(uint8_t* ext) {
+  ext[0] = OPT_ECN;
+  ext[1] = OPT_ECN_LEN;
+  return OPT_ECN_LEN;
+}
+
+int opt_get_ecn(const uint8_t* ext, uint16_t ext_len) {
+  uint8_t len;
+  return opt_find(ext, ext_len, OPT_ECN, &len) != NULL &&
+         len == OPT_ECN_LEN - OPT_HDR_LEN;
+}
+
+uint16_t opt_put_ecn_echo(uint8_t* ext, uint32_t ce_bytes) {
+  uint32_t val = htonl(ce_bytes);
+  ext[0] = OPT_ECN_ECHO;
+  ext[1] = OPT_ECN_ECHO_LEN;
+  memcpy(ext + OPT_HDR_LEN, &val, sizeof(val));
+  return OPT_ECN_ECHO_LEN;
+}
+
+int opt_get_ecn_echo(const uint8_t* ext, uint16_t ext_len,
+                     uint32_t* ce_bytes) {
+  uint8_t len;
+  const uint8_t* val = opt_find(ext, ext_len, OPT_ECN_ECHO, &len);
+  uint32_t v;
+  if (val == NULL || len != OPT_ECN_ECHO_LEN - OPT_HDR_LEN) {
+    return 0;
+  }
+  memcpy(&v, val, sizeof(v));
+  *ce_bytes = ntohl(v);
+  return 1;
+}
@@ -18,14 +18,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include "backend.h"
+#include "clock.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "ecn.h"
+#include "fec.h"
 
-int cmu_socket(cmu_socket_t *sock, const cmu_socket_type_t socket_type,
-               const int port, const char *server_ip) {
-  int sockfd, optval;
+// Bytes of the length prefix in front of each message, see `cmu_send_msg`.
+#define MSG_PREFIX_LEN 4
+
+/**
+ * Sets up everything but the backend thread. See `cmu_socket`.
+ */
+static int socket_init(cmu_socket_t *sock, const cmu_socket_type_t socket_type,
+                       const int port, const char *server_ip) {
+  int sockfd, optval, pmtu_on, ecn_on;
   socklen_t len;
   struct sockaddr_in conn, my_addr;
   len = sizeof(my_addr);
@@ -35,30 +47,108 @@ int cmu_socket(cmu_socket_t *sock, const cmu_socket_type_t socket_type,
     perror("ERROR opening socket");
     return EXIT_ERROR;
   }
+  pmtu_on = pmtu_discovery_enabled();
+  if (pmtu_on) {
+    // Set DF and never fragment: the backend finds the path MTU itself, see
+    // pmtu.h. PROBE also keeps the kernel from capping packets at a path MTU
+    // it learned from ICMP, which may be stale.
+    optval = IP_PMTUDISC_PROBE;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &optval,
+                   sizeof(optval)) < 0) {
+      perror("ERROR setting IP_MTU_DISCOVER");
+    }
+  }
+  ecn_on = ecn_mode();
+  if (ecn_on != ECN_MODE_OFF) {
+    // Hand the TOS byte of every datagram to `recvmmsg`, for its CE mark.
+    optval = 1;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_RECVTOS, &optval, sizeof(optval)) <
+        0) {
+      perror("ERROR setting IP_RECVTOS");
+    }
+  }
+  // Room for a few windows of the largest packets, which the default
+  // receive buffer of the kernel cannot hold. The peer may probe for them
+  // even if we do not.
+  optval = 4 * WINDOW_INITIAL_WINDOW_SIZE / MSS * PMTU_MAX_LEN;
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval)) <
+      0) {
+    perror("ERROR setting SO_RCVBUF");
+  }
 
   sock->socket = sockfd;
-  sock->received_buf = NULL;
+  memset(sock->streams, 0, sizeof(sock->streams));
   sock->received_len = 0;
+  sock->segment_pool = NULL;
+  sock->segment_pool_len = 0;
   pthread_mutex_init(&(sock->recv_lock), NULL);
 
-  sock->sending_buf = NULL;
   sock->sending_len = 0;
+  sock->next_stream = 0;
+  sock->nodelay = 0;
+  sock->corked = 0;
+  sock->held_since = 0;
   pthread_mutex_init(&(sock->send_lock), NULL);
 
   sock->type = socket_type;
   sock->dying = 0;
+  sock->shutting_down = 0;
   pthread_mutex_init(&(sock->death_lock), NULL);
+  sock->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sock->wake_fd < 0) {
+    perror("ERROR creating eventfd");
+    close(sockfd);
+    return EXIT_ERROR;
+  }
+  sock->wake_pending = 0;
+  sock->aborted = 0;
+  memset(&sock->timers, 0, sizeof(sock->timers));
+  sock->fastopen = 0;
+  memset(&sock->handshake, 0, sizeof(sock->handshake));
 
-  // FIXME: Sequence numbers should be randomly initialized. The next expected
-  // sequence number should be initialized according to the SYN packet from the
-  // other side of the connection.
+  // Both are set by the handshake: the initial sequence number is random and
+  // the next expected one comes from the peer's SYN.
   sock->window.last_ack_received = 0;
   sock->window.next_seq_expected = 0;
+  sock->window.sending_windows = NULL;
+  sock->window.received_windows = NULL;
+  sock->window.cwnd = WINDOW_INITIAL_WINDOW_SIZE;
+  sock->window.ssthresh = WINDOW_INITIAL_SSTHRESH;
   pthread_mutex_init(&(sock->window.ack_lock), NULL);
 
-  sock->estRtt = WINDOW_INITIAL_RTT;
-  sock->estRto = WINDOW_INITIAL_RTT;
-  sock->devRtt = 0;
+  rtt_init(&sock->rtt, WINDOW_INITIAL_RTT * USEC_PER_MSEC);
+  pmtu_init(&sock->pmtu, pmtu_on);
+  sock->crc32c = crc32c_enabled() ? CRC32C_OFFERED : CRC32C_OFF;
+  sock->compress = compression_enabled() ? COMPRESS_OFFERED : COMPRESS_OFF;
+  fec_encoder_init(&sock->fec_tx, fec_group_size());
+  memset(&sock->fec_rx, 0, sizeof(sock->fec_rx));
+  sock->fec = sock->fec_tx.group_size != 0 ? FEC_OFFERED : FEC_OFF;
+  ecn_init(&sock->ecn_cc, ecn_on);
+  sock->ecn = ecn_on != ECN_MODE_OFF ? ECN_OFFERED : ECN_OFF;
+  sock->rx_ce = 0;
+  // Path 0 goes by `socket` and `conn`, which the handshake may still change.
+  path_init(&sock->paths[0], -1, &sock->conn, sock->rtt.rto,
+            sock->window.cwnd);
+  sock->paths[0].state = PATH_UP;
+  sock->npaths = 1;
+  sock->cur_path = 0;
+  sock->rx_path = 0;
+  sock->ts_recent = 0;
+  sock->received_fin = 0;
+  sock->fin_seq = 0;
+  sock->fin_send_time = 0;
+  sock->fin_retries = 0;
+  sock->last_heard = 0;
+  sock->last_data = 0;
+  sock->probes_sent = 0;
+  sock->probe_time = 0;
+
+  memset(&sock->stats, 0, sizeof(sock->stats));
+  STAT_SET(&sock->stats, rto_us, sock->rtt.rto);
+  STAT_SET(&sock->stats, cwnd, sock->window.cwnd);
+  STAT_SET(&sock->stats, ssthresh, sock->window.ssthresh);
+  STAT_SET(&sock->stats, pmtu, sock->pmtu.plpmtu);
+  STAT_SET(&sock->stats, paths_up, 1);
 
   if (pthread_cond_init(&sock->wait_cond, NULL) != 0) {
     perror("ERROR condition variable not set\n");
@@ -109,89 +199,625 @@ int cmu_socket(cmu_socket_t *sock, const cmu_socket_type_t socket_type,
   }
   getsockname(sockfd, (struct sockaddr *)&my_addr, &len);
   sock->my_port = ntohs(my_addr.sin_port);
+  sock->link = link_create(socket_type);
+  sock->trace = NULL;
+  return EXIT_SUCCESS;
+}
+
+int cmu_socket(cmu_socket_t *sock, const cmu_socket_type_t socket_type,
+               const int port, const char *server_ip) {
+  if (socket_init(sock, socket_type, port, server_ip) < 0) {
+    return EXIT_ERROR;
+  }
+  pthread_create(&(sock->thread_id), NULL, begin_backend, (void *)sock);
+  return EXIT_SUCCESS;
+}
 
+int cmu_socket_fastopen(cmu_socket_t *sock, const int port,
+                        const char *server_ip, const void *buf, int length) {
+  if (socket_init(sock, TCP_INITIATOR, port, server_ip) < 0) {
+    return EXIT_ERROR;
+  }
+  sock->fastopen = 1;
+  // Queued before the backend starts, so the handshake can take it.
+  if (length > 0 && cmu_write(sock, buf, length) < 0) {
+    return EXIT_ERROR;
+  }
   pthread_create(&(sock->thread_id), NULL, begin_backend, (void *)sock);
   return EXIT_SUCCESS;
 }
 
+/**
+ * Wakes the backend up if it is sleeping, so it notices a state change.
+ */
+static void wake_backend(cmu_socket_t *sock) {
+  uint64_t one = 1;
+  if (write(sock->wake_fd, &one, sizeof(one)) < 0) {
+    // The counter is already non-zero, so the backend will wake up anyway.
+  }
+}
+
 int cmu_close(cmu_socket_t *sock) {
+  int aborted;
+
   while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
   }
   sock->dying = 1;
   pthread_mutex_unlock(&(sock->death_lock));
+  wake_backend(sock);
   pthread_join(sock->thread_id, NULL);
+  // The backend has exited, so nothing else touches the flag any more.
+  aborted = sock->aborted;
   if (sock != NULL) {
-    if (sock->received_buf != NULL) {
-      free(sock->received_buf);
+    close(sock->wake_fd);
+    link_destroy(sock->link);
+    sock->link = NULL;
+    for (int i = 0; i < CMU_MAX_STREAMS; i++) {
+      cmu_stream_t *stream = &sock->streams[i];
+      while (stream->received_head != NULL) {
+        cmu_segment_t *seg = stream->received_head;
+        stream->received_head = seg->next;
+        free(seg);
+      }
+      free(stream->sending_buf);
+      decompress_free(&stream->decompressor);
+    }
+    while (sock->segment_pool != NULL) {
+      cmu_segment_t *seg = sock->segment_pool;
+      sock->segment_pool = seg->next;
+      free(seg);
     }
-    if (sock->sending_buf != NULL) {
-      free(sock->sending_buf);
+    for (int i = 1; i < sock->npaths; i++) {
+      if (sock->paths[i].fd >= 0) {
+        close(sock->paths[i].fd);
+      }
     }
   } else {
     perror("ERROR null socket\n");
     return EXIT_ERROR;
   }
-  return close(sock->socket);
+  // The backend hands the UDP socket over to a background thread when the
+  // connection still has to wait for the peer's FIN or sit in TIME_WAIT.
+  if (sock->socket >= 0 && close(sock->socket) < 0) {
+    return EXIT_ERROR;
+  }
+  if (aborted) {
+    perror("ERROR connection aborted");
+    return EXIT_ERROR;
+  }
+  return EXIT_SUCCESS;
 }
 
-int cmu_read(cmu_socket_t *sock, void *buf, int length, cmu_read_mode_t flags) {
-  uint8_t *new_buf;
-  int read_len = 0;
+int cmu_add_path(cmu_socket_t *sock, const char *local_ip,
+                 const char *server_ip, const int port) {
+  struct sockaddr_in local, peer;
+  socklen_t len;
+  int n = sock->npaths;
+  int sockfd, optval;
 
-  if (length < 0) {
-    perror("ERROR negative length");
+  if (sock->type != TCP_INITIATOR || n >= CMU_MAX_PATHS) {
     return EXIT_ERROR;
   }
+  memset(&peer, 0, sizeof(peer));
+  peer.sin_family = AF_INET;
+  peer.sin_addr.s_addr = inet_addr(server_ip);
+  peer.sin_port = htons(port);
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr =
+      local_ip != NULL ? inet_addr(local_ip) : htonl(INADDR_ANY);
+  local.sin_port = 0;
 
-  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sockfd < 0) {
+    perror("ERROR opening socket");
+    return EXIT_ERROR;
+  }
+  // Set up like the connection's own socket, the path MTU being shared.
+  if (sock->pmtu.enabled && !sock->pmtu.fragment) {
+    optval = IP_PMTUDISC_PROBE;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &optval,
+                   sizeof(optval)) < 0) {
+      perror("ERROR setting IP_MTU_DISCOVER");
+    }
+  }
+  if (sock->ecn != ECN_OFF) {
+    optval = 1;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_RECVTOS, &optval, sizeof(optval)) <
+        0) {
+      perror("ERROR setting IP_RECVTOS");
+    }
+  }
+  optval = 4 * WINDOW_INITIAL_WINDOW_SIZE / MSS * PMTU_MAX_LEN;
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval)) <
+      0) {
+    perror("ERROR setting SO_RCVBUF");
+  }
+  if (bind(sockfd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+    perror("ERROR on binding");
+    close(sockfd);
+    return EXIT_ERROR;
+  }
+  path_init(&sock->paths[n], sockfd, &peer,
+            WINDOW_INITIAL_RTT * USEC_PER_MSEC, WINDOW_INITIAL_WINDOW_SIZE);
+  len = sizeof(local);
+  getsockname(sockfd, (struct sockaddr *)&local, &len);
+  sock->paths[n].port = ntohs(local.sin_port);
+  // The backend only looks at the path once it is counted.
+  sock->npaths = n + 1;
+  wake_backend(sock);
+  return n;
+}
+
+int cmu_shutdown(cmu_socket_t *sock) {
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
   }
+  sock->shutting_down = 1;
+  pthread_mutex_unlock(&(sock->death_lock));
+  wake_backend(sock);
+  return EXIT_SUCCESS;
+}
 
+int cmu_set_keepalive(cmu_socket_t *sock, uint64_t idle_us,
+                      uint64_t interval_us, uint32_t probes) {
+  if (sock == NULL) {
+    perror("ERROR null socket\n");
+    return EXIT_ERROR;
+  }
+  if (idle_us > 0 && (interval_us == 0 || probes == 0)) {
+    perror("ERROR keepalive needs an interval and a probe count\n");
+    return EXIT_ERROR;
+  }
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  sock->timers.keepalive_idle_us = idle_us;
+  sock->timers.keepalive_interval_us = interval_us;
+  sock->timers.keepalive_probes = probes;
+  pthread_mutex_unlock(&(sock->death_lock));
+  // The backend may be asleep until a deadline computed from the old values.
+  wake_backend(sock);
+  return EXIT_SUCCESS;
+}
+
+int cmu_set_idle_timeout(cmu_socket_t *sock, uint64_t timeout_us) {
+  if (sock == NULL) {
+    perror("ERROR null socket\n");
+    return EXIT_ERROR;
+  }
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  sock->timers.idle_timeout_us = timeout_us;
+  pthread_mutex_unlock(&(sock->death_lock));
+  wake_backend(sock);
+  return EXIT_SUCCESS;
+}
+
+int cmu_set_nodelay(cmu_socket_t *sock, int nodelay) {
+  if (sock == NULL) {
+    perror("ERROR null socket\n");
+    return EXIT_ERROR;
+  }
+  while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+  }
+  sock->nodelay = nodelay != 0;
+  pthread_mutex_unlock(&(sock->send_lock));
+  wake_backend(sock);
+  return EXIT_SUCCESS;
+}
+
+int cmu_set_cork(cmu_socket_t *sock, int cork) {
+  if (sock == NULL) {
+    perror("ERROR null socket\n");
+    return EXIT_ERROR;
+  }
+  while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+  }
+  sock->corked = cork != 0;
+  pthread_mutex_unlock(&(sock->send_lock));
+  // Send what the cork held back.
+  wake_backend(sock);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * Waits until `stream` has data to read according to `flags`. Must be called
+ * with `recv_lock` held.
+ *
+ * @return 0 on success, -1 if the flag is not supported.
+ */
+static int wait_for_data(cmu_socket_t *sock, cmu_stream_t *stream,
+                         cmu_read_mode_t flags) {
   switch (flags) {
     case NO_FLAG:
-      while (sock->received_len == 0) {
+      while (stream->received_len == 0 && !sock->received_fin) {
         pthread_cond_wait(&(sock->wait_cond), &(sock->recv_lock));
       }
-    // Fall through.
+      return 0;
     case NO_WAIT:
-      if (sock->received_len > 0) {
-        if (sock->received_len > length)
-          read_len = length;
-        else
-          read_len = sock->received_len;
-
-        memcpy(buf, sock->received_buf, read_len);
-        if (read_len < sock->received_len) {
-          new_buf = malloc(sock->received_len - read_len);
-          memcpy(new_buf, sock->received_buf + read_len,
-                 sock->received_len - read_len);
-          free(sock->received_buf);
-          sock->received_len -= read_len;
-          sock->received_buf = new_buf;
-        } else {
-          free(sock->received_buf);
-          sock->received_buf = NULL;
-          sock->received_len = 0;
-        }
-      }
-      break;
+      return 0;
     default:
       perror("ERROR Unknown flag.\n");
-      read_len = EXIT_ERROR;
+      return EXIT_ERROR;
+  }
+}
+
+/**
+ * Removes the first segment from a stream's receive queue. Must be called with
+ * `recv_lock` held.
+ */
+static cmu_segment_t *pop_segment(cmu_stream_t *stream) {
+  cmu_segment_t *seg = stream->received_head;
+  stream->received_head = seg->next;
+  if (stream->received_head == NULL) {
+    stream->received_tail = NULL;
   }
+  seg->next = NULL;
+  return seg;
+}
+
+/**
+ * Copies up to `room` bytes straight out of a stream's queued segments. Fully
+ * read segments go back to the pool, a partially read one just advances its
+ * offset. Must be called with `recv_lock` held.
+ *
+ * @param sock The socket.
+ * @param stream The stream to read from.
+ * @param dst Where to copy to, or NULL to throw the bytes away.
+ * @param room The maximum number of bytes to take.
+ *
+ * @return The number of bytes taken.
+ */
+static size_t take_bytes(cmu_socket_t *sock, cmu_stream_t *stream,
+                         uint8_t *dst, size_t room) {
+  size_t taken = 0;
+
+  while (room > 0 && stream->received_head != NULL) {
+    cmu_segment_t *seg = stream->received_head;
+    uint32_t n = seg->len - seg->off;
+    if (n > room) {
+      n = room;
+    }
+    if (dst != NULL) {
+      memcpy(dst + taken, seg->data + seg->off, n);
+    }
+    seg->off += n;
+    room -= n;
+    taken += n;
+    if (seg->off == seg->len) {
+      segment_put(sock, pop_segment(stream));
+    }
+  }
+  stream->received_len -= taken;
+  sock->received_len -= taken;
+  return taken;
+}
+
+/**
+ * Reads from one stream into `iov`, see `cmu_readv`.
+ */
+static int stream_readv(cmu_socket_t *sock, uint16_t id,
+                        const struct iovec *iov, int iovcnt,
+                        cmu_read_mode_t flags) {
+  cmu_stream_t *stream;
+  int read_len = 0;
+
+  if (id >= CMU_MAX_STREAMS) {
+    perror("ERROR bad stream");
+    return EXIT_ERROR;
+  }
+  if (iovcnt < 0) {
+    perror("ERROR negative iovcnt");
+    return EXIT_ERROR;
+  }
+  stream = &sock->streams[id];
+
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+
+  if (wait_for_data(sock, stream, flags) < 0) {
+    pthread_mutex_unlock(&(sock->recv_lock));
+    return EXIT_ERROR;
+  }
+
+  for (int i = 0; i < iovcnt && stream->received_head != NULL; i++) {
+    read_len += take_bytes(sock, stream, iov[i].iov_base, iov[i].iov_len);
+  }
+
   pthread_mutex_unlock(&(sock->recv_lock));
   return read_len;
 }
 
-int cmu_write(cmu_socket_t *sock, const void *buf, int length) {
+int cmu_read(cmu_socket_t *sock, void *buf, int length, cmu_read_mode_t flags) {
+  struct iovec iov;
+
+  if (length < 0) {
+    perror("ERROR negative length");
+    return EXIT_ERROR;
+  }
+  iov.iov_base = buf;
+  iov.iov_len = length;
+  return cmu_readv(sock, &iov, 1, flags);
+}
+
+int cmu_stream_read(cmu_socket_t *sock, uint16_t stream, void *buf, int length,
+                    cmu_read_mode_t flags) {
+  struct iovec iov;
+
+  if (length < 0) {
+    perror("ERROR negative length");
+    return EXIT_ERROR;
+  }
+  iov.iov_base = buf;
+  iov.iov_len = length;
+  return stream_readv(sock, stream, &iov, 1, flags);
+}
+
+int cmu_readv(cmu_socket_t *sock, const struct iovec *iov, int iovcnt,
+              cmu_read_mode_t flags) {
+  return stream_readv(sock, 0, iov, iovcnt, flags);
+}
+
+/**
+ * Reads the length prefix of the next message without taking it off the
+ * queue. Must be called with `recv_lock` held.
+ *
+ * @return The message length, or -1 if the whole prefix has not arrived.
+ */
+static int64_t peek_msg_len(cmu_stream_t *stream) {
+  uint8_t prefix[MSG_PREFIX_LEN];
+  cmu_segment_t *seg = stream->received_head;
+  uint32_t off, len;
+  int n = 0;
+
+  if (stream->received_len < MSG_PREFIX_LEN) {
+    return -1;
+  }
+  off = seg->off;
+  while (n < MSG_PREFIX_LEN) {
+    if (off == seg->len) {
+      seg = seg->next;
+      off = 0;
+      continue;
+    }
+    prefix[n++] = seg->data[off++];
+  }
+  memcpy(&len, prefix, sizeof(len));
+  return ntohl(len);
+}
+
+int cmu_recv_msg(cmu_socket_t *sock, void *buf, int length,
+                 cmu_read_mode_t flags) {
+  cmu_stream_t *stream = &sock->streams[0];
+  int64_t msg_len;
+
+  if (length < 0) {
+    perror("ERROR negative length");
+    return EXIT_ERROR;
+  }
+  if (flags != NO_FLAG && flags != NO_WAIT) {
+    perror("ERROR Unknown flag.\n");
+    return EXIT_ERROR;
+  }
+
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+  // Only hand out whole messages. The backend wakes readers up whenever it
+  // has queued more data, so check again each time.
+  while (1) {
+    msg_len = peek_msg_len(stream);
+    if (msg_len == 0 || msg_len > CMU_MAX_MSG_LEN) {
+      pthread_mutex_unlock(&(sock->recv_lock));
+      perror("ERROR bad message length");
+      return EXIT_ERROR;
+    }
+    if (msg_len > 0 && stream->received_len >= MSG_PREFIX_LEN + msg_len) {
+      break;
+    }
+    if (sock->received_fin || flags == NO_WAIT) {
+      int partial = sock->received_fin && stream->received_len > 0;
+      pthread_mutex_unlock(&(sock->recv_lock));
+      if (partial) {
+        perror("ERROR connection closed in the middle of a message");
+        return EXIT_ERROR;
+      }
+      return 0;
+    }
+    pthread_cond_wait(&(sock->wait_cond), &(sock->recv_lock));
+  }
+
+  // Copy the message straight out of the queued segments. Whatever does not
+  // fit is dropped, like the rest of a datagram.
+  take_bytes(sock, stream, NULL, MSG_PREFIX_LEN);
+  if (msg_len > length) {
+    take_bytes(sock, stream, buf, length);
+    take_bytes(sock, stream, NULL, msg_len - length);
+  } else {
+    take_bytes(sock, stream, buf, msg_len);
+  }
+  pthread_mutex_unlock(&(sock->recv_lock));
+  return (int)msg_len;
+}
+
+int cmu_read_borrow(cmu_socket_t *sock, cmu_segment_t **seg, uint8_t **data,
+                    cmu_read_mode_t flags) {
+  cmu_stream_t *stream = &sock->streams[0];
+  int read_len = 0;
+
+  *seg = NULL;
+  *data = NULL;
+
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+
+  if (wait_for_data(sock, stream, flags) < 0) {
+    pthread_mutex_unlock(&(sock->recv_lock));
+    return EXIT_ERROR;
+  }
+
+  if (stream->received_head != NULL) {
+    *seg = pop_segment(stream);
+    *data = (*seg)->data + (*seg)->off;
+    read_len = (*seg)->len - (*seg)->off;
+    stream->received_len -= read_len;
+    sock->received_len -= read_len;
+  }
+
+  pthread_mutex_unlock(&(sock->recv_lock));
+  return read_len;
+}
+
+void cmu_read_release(cmu_socket_t *sock, cmu_segment_t *seg) {
+  if (seg == NULL) {
+    return;
+  }
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+  segment_put(sock, seg);
+  pthread_mutex_unlock(&(sock->recv_lock));
+}
+
+/**
+ * Appends `iov` to the send buffer of one stream in a single step, so that
+ * nothing written by another thread lands in between.
+ */
+static int stream_writev(cmu_socket_t *sock, uint16_t id,
+                         const struct iovec *iov, int iovcnt) {
+  cmu_stream_t *stream;
+  int closed, aborted, length = 0;
+
+  if (id >= CMU_MAX_STREAMS) {
+    perror("ERROR bad stream");
+    return EXIT_ERROR;
+  }
+  stream = &sock->streams[id];
+  for (int i = 0; i < iovcnt; i++) {
+    length += iov[i].iov_len;
+  }
+
+  while (pthread_mutex_lock(&(sock->death_lock)) != 0) {
+  }
+  closed = sock->dying || sock->shutting_down;
+  aborted = sock->aborted;
+  pthread_mutex_unlock(&(sock->death_lock));
+  if (aborted) {
+    perror("ERROR connection timed out");
+    return EXIT_ERROR;
+  }
+  if (closed) {
+    perror("ERROR write after shutdown");
+    return EXIT_ERROR;
+  }
+
   while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
   }
-  if (sock->sending_buf == NULL)
-    sock->sending_buf = malloc(length);
+  if (stream->sending_buf == NULL)
+    stream->sending_buf = malloc(length);
   else
-    sock->sending_buf = realloc(sock->sending_buf, length + sock->sending_len);
-  memcpy(sock->sending_buf + sock->sending_len, buf, length);
+    stream->sending_buf =
+        realloc(stream->sending_buf, length + stream->sending_len);
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(stream->sending_buf + stream->sending_len, iov[i].iov_base,
+           iov[i].iov_len);
+    stream->sending_len += iov[i].iov_len;
+  }
   sock->sending_len += length;
 
   pthread_mutex_unlock(&(sock->send_lock));
+  wake_backend(sock);
+  return EXIT_SUCCESS;
+}
+
+int cmu_write(cmu_socket_t *sock, const void *buf, int length) {
+  return cmu_stream_write(sock, 0, buf, length);
+}
+
+int cmu_stream_write(cmu_socket_t *sock, uint16_t stream, const void *buf,
+                     int length) {
+  struct iovec iov;
+
+  if (length < 0) {
+    perror("ERROR negative length");
+    return EXIT_ERROR;
+  }
+  iov.iov_base = (void *)buf;
+  iov.iov_len = length;
+  return stream_writev(sock, stream, &iov, 1);
+}
+
+int cmu_send_msg(cmu_socket_t *sock, const void *buf, int length) {
+  struct iovec iov[2];
+  uint32_t prefix;
+
+  if (length <= 0 || length > CMU_MAX_MSG_LEN) {
+    perror("ERROR bad message length");
+    return EXIT_ERROR;
+  }
+  // The prefix and the message are queued together, so they go out in the
+  // same packet along with whatever else is queued.
+  prefix = htonl((uint32_t)length);
+  iov[0].iov_base = &prefix;
+  iov[0].iov_len = MSG_PREFIX_LEN;
+  iov[1].iov_base = (void *)buf;
+  iov[1].iov_len = length;
+  return stream_writev(sock, 0, iov, 2);
+}
+
+int cmu_get_stats(cmu_socket_t *sock, cmu_stats_t *stats) {
+  cmu_counters_t *c;
+
+  if (sock == NULL || stats == NULL) {
+    perror("ERROR null socket or stats\n");
+    return EXIT_ERROR;
+  }
+  c = &sock->stats;
+
+  stats->bytes_sent = STAT_GET(c, bytes_sent);
+  stats->segments_sent = STAT_GET(c, segments_sent);
+  stats->bytes_retransmitted = STAT_GET(c, bytes_retransmitted);
+  stats->segments_retransmitted = STAT_GET(c, segments_retransmitted);
+  stats->rto_expirations = STAT_GET(c, rto_expirations);
+  stats->bytes_acked = STAT_GET(c, bytes_acked);
+  stats->dup_acks = STAT_GET(c, dup_acks);
+  stats->bytes_received = STAT_GET(c, bytes_received);
+  stats->segments_received = STAT_GET(c, segments_received);
+  stats->out_of_order = STAT_GET(c, out_of_order);
+  stats->dup_segments = STAT_GET(c, dup_segments);
+  stats->window_limited_us = STAT_GET(c, window_limited_us);
+  stats->syn_cookies_sent = STAT_GET(c, syn_cookies_sent);
+  stats->syn_cookies_rejected = STAT_GET(c, syn_cookies_rejected);
+  stats->foreign_packets = STAT_GET(c, foreign_packets);
+  stats->keepalive_probes = STAT_GET(c, keepalive_probes);
+  stats->pmtu_probes = STAT_GET(c, pmtu_probes);
+  stats->checksum_errors = STAT_GET(c, checksum_errors);
+  stats->malformed_packets = STAT_GET(c, malformed_packets);
+  stats->compress_raw_bytes = STAT_GET(c, compress_raw_bytes);
+  stats->compress_wire_bytes = STAT_GET(c, compress_wire_bytes);
+  stats->compress_stored_blocks = STAT_GET(c, compress_stored_blocks);
+  stats->fec_repairs_sent = STAT_GET(c, fec_repairs_sent);
+  stats->fec_recovered = STAT_GET(c, fec_recovered);
+  stats->path_failovers = STAT_GET(c, path_failovers);
+  stats->ecn_ce_received = STAT_GET(c, ecn_ce_received);
+  stats->ecn_reductions = STAT_GET(c, ecn_reductions);
+  stats->srtt_us = STAT_GET(c, srtt_us);
+  stats->rttvar_us = STAT_GET(c, rttvar_us);
+  stats->rto_us = STAT_GET(c, rto_us);
+  stats->min_rtt_us = STAT_GET(c, min_rtt_us);
+  stats->cwnd = STAT_GET(c, cwnd);
+  stats->ssthresh = STAT_GET(c, ssthresh);
+  stats->peer_window = STAT_GET(c, peer_window);
+  stats->bytes_in_flight = STAT_GET(c, bytes_in_flight);
+  stats->pmtu = STAT_GET(c, pmtu);
+  stats->paths_up = STAT_GET(c, paths_up);
+
+  while (pthread_mutex_lock(&(sock->recv_lock)) != 0) {
+  }
+  stats->recv_queue_bytes = sock->received_len;
+  pthread_mutex_unlock(&(sock->recv_lock));
+
+  while (pthread_mutex_lock(&(sock->send_lock)) != 0) {
+  }
+  stats->send_queue_bytes = sock->sending_len;
+  pthread_mutex_unlock(&(sock->send_lock));
+
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,386 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements payload compression.
+ *
+ * An encoded block is a series of sequences, each a token byte, literals, a
+ * match offset and a match length. The token's high nibble is the number of
+ * literals and its low nibble the match length minus LZ_MIN_MATCH; a nibble of
+ * 15 is followed by bytes adding to it, the last of them below 255. The offset
+ * takes 2 bytes, little endian. The last sequence has literals only and ends
+ * the block. The compressor finds matches through a hash table of the last
+ * position each 4 byte string was seen at.
+ */
+
+#include "compress.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+// Matches end this far from the end of a block, so the last sequence always
+// has literals and the compressor can read 4 bytes ahead without checks.
+#define LZ_LAST_LITERALS 5
+// Misses after which the compressor moves on faster, 1 byte more per step.
+#define LZ_SKIP_TRIGGER 6
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int compress_on = 0;
+static int config_loaded = 0;
+
+void cmu_set_compression(int enabled) {
+  pthread_mutex_lock(&config_lock);
+  compress_on = enabled != 0;
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int compression_enabled(void) {
+  int on;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_COMPRESS");
+    if (env != NULL && env[0] != '\0') {
+      compress_on = strcmp(env, "0") != 0;
+    }
+    config_loaded = 1;
+  }
+  on = compress_on;
+  pthread_mutex_unlock(&config_lock);
+  return on;
+}
+
+static uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/*
+ * Writes a length beyond what fits in a token nibble.
+ */
+static uint8_t* put_length(uint8_t* op, uint32_t len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+/*
+ * Writes one sequence. A `match_len` of 0 makes it the last one.
+ *
+ * @return The end of what was written, or NULL if it does not fit.
+ */
+static uint8_t* put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* lit,
+                             uint32_t lit_len, uint32_t offset,
+                             uint32_t match_len) {
+  uint32_t ml = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+  uint8_t* token = op++;
+
+  // Worst case: token, literal length bytes, literals, offset, match length
+  // bytes.
+  if ((uint64_t)(oend - token) <
+      1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1) {
+    return NULL;
+  }
+  *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+  if (lit_len >= 15) {
+    op = put_length(op, lit_len - 15);
+  }
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if (match_len == 0) {
+    return op;
+  }
+  *op++ = (uint8_t)offset;
+  *op++ = (uint8_t)(offset >> 8);
+  *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+  if (ml >= 15) {
+    op = put_length(op, ml - 15);
+  }
+  return op;
+}
+
+/*
+ * Compresses a block.
+ *
+ * @return The encoded length, or 0 if it would not fit in `cap` bytes.
+ */
+static uint32_t lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst,
+                            uint32_t cap) {
+  uint32_t table[1 << LZ_HASH_BITS];
+  const uint8_t* ip = src + 1;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + len;
+  const uint8_t* match_limit = end - LZ_LAST_LITERALS;
+  uint8_t* op = dst;
+  uint8_t* oend = dst + cap;
+  uint32_t misses = 0;
+
+  memset(table, 0, sizeof(table));
+  while (len > LZ_LAST_LITERALS + LZ_MIN_MATCH &&
+         ip + LZ_MIN_MATCH <= match_limit) {
+    uint32_t seq = read32(ip);
+    uint32_t h = hash4(seq);
+    const uint8_t* ref = src + table[h];
+    const uint8_t* mp;
+
+    table[h] = (uint32_t)(ip - src);
+    if (ip - ref > LZ_MAX_OFFSET || read32(ref) != seq) {
+      ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+      continue;
+    }
+    misses = 0;
+    while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+      ip--;
+      ref--;
+    }
+    mp = ip + LZ_MIN_MATCH;
+    while (mp < match_limit && *mp == ref[mp - ip]) {
+      mp++;
+    }
+    op = put_sequence(op, oend, anchor, (uint32_t)(ip - anchor),
+                      (uint32_t)(ip - ref), (uint32_t)(mp - ip));
+    if (op == NULL) {
+      return 0;
+    }
+    ip = mp;
+    anchor = ip;
+  }
+  op = put_sequence(op, oend, anchor, (uint32_t)(end - anchor), 0, 0);
+  return op == NULL ? 0 : (uint32_t)(op - dst);
+}
+
+/*
+ * Reads a length beyond what fits in a token nibble.
+ *
+ * @return The length, or -1 if the input ends first.
+ */
+static int64_t get_length(const uint8_t** ip, const uint8_t* iend) {
+  int64_t len = 0;
+  uint8_t b;
+  do {
+    if (*ip >= iend) {
+      return -1;
+    }
+    b = *(*ip)++;
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+/*
+ * Decompresses a block of exactly `len` raw bytes. The input comes from the
+ * network, so every length and offset is checked.
+ *
+ * @return 0 on success, -1 if the block is corrupt.
+ */
+static int lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst,
+                         uint32_t len) {
+  const uint8_t* ip = src;
+  const uint8_t* iend = src + src_len;
+  uint8_t* op = dst;
+  uint8_t* oend = dst + len;
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    int64_t lit_len = token >> 4;
+    int64_t match_len = token & 15;
+    uint32_t offset;
+
+    if (lit_len == 15) {
+      int64_t more = get_length(&ip, iend);
+      if (more < 0) {
+        return -1;
+      }
+      lit_len += more;
+    }
+    if (lit_len > iend - ip || lit_len > oend - op) {
+      return -1;
+    }
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return -1;
+    }
+    offset = ip[0] | (uint32_t)ip[1] << 8;
+    ip += 2;
+    if (match_len == 15) {
+      int64_t more = get_length(&ip, iend);
+      if (more < 0) {
+        return -1;
+      }
+      match_len += more;
+    }
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > op - dst || match_len > oend - op) {
+      return -1;
+    }
+    if (offset >= match_len) {
+      memcpy(op, op - offset, match_len);
+      op += match_len;
+    } else {
+      // The match overlaps what it writes, e.g. a run of one byte.
+      for (int64_t i = 0; i < match_len; i++, op++) {
+        *op = *(op - offset);
+      }
+    }
+  }
+  return op == oend ? 0 : -1;
+}
+
+uint32_t compress_bound(uint32_t len) {
+  return len + (len + COMPRESS_BLOCK - 1) / COMPRESS_BLOCK *
+                   COMPRESS_FRAME_HDR_LEN;
+}
+
+uint32_t compress_frames(compressor_t* c, const uint8_t* src, uint32_t len,
+                         uint8_t* dst) {
+  uint8_t* op = dst;
+
+  for (uint32_t off = 0; off < len; off += COMPRESS_BLOCK) {
+    uint32_t raw_len = len - off < COMPRESS_BLOCK ? len - off : COMPRESS_BLOCK;
+    uint32_t enc_len = 0;
+
+    if (c->skip > 0) {
+      c->skip--;
+    } else if (raw_len >= COMPRESS_MIN_LEN) {
+      // Anything that does not fit is not worth sending compressed.
+      enc_len = lz_compress(src + off, raw_len, op + COMPRESS_FRAME_HDR_LEN,
+                            raw_len - raw_len / COMPRESS_MIN_SAVING);
+      if (enc_len > 0) {
+        c->backoff = 0;
+      } else {
+        c->backoff = c->backoff == 0 ? 1 : c->backoff * 2;
+        if (c->backoff > COMPRESS_MAX_BACKOFF) {
+          c->backoff = COMPRESS_MAX_BACKOFF;
+        }
+        c->skip = c->backoff;
+      }
+    }
+    op[0] = (uint8_t)(raw_len >> 8);
+    op[1] = (uint8_t)raw_len;
+    op[2] = (uint8_t)(enc_len >> 8);
+    op[3] = (uint8_t)enc_len;
+    op += COMPRESS_FRAME_HDR_LEN;
+    if (enc_len == 0) {
+      memcpy(op, src + off, raw_len);
+      op += raw_len;
+      c->stored_blocks++;
+    } else {
+      op += enc_len;
+    }
+  }
+  return (uint32_t)(op - dst);
+}
+
+static uint32_t frame_raw_len(const decompressor_t* d) {
+  return (uint32_t)d->frame[0] << 8 | d->frame[1];
+}
+
+static uint32_t frame_enc_len(const decompressor_t* d) {
+  return (uint32_t)d->frame[2] << 8 | d->frame[3];
+}
+
+/*
+ * Tells if the header of the frame the decompressor holds makes sense. It
+ * must be in.
+ */
+static int frame_valid(const decompressor_t* d) {
+  return frame_raw_len(d) > 0 && frame_raw_len(d) <= COMPRESS_BLOCK &&
+         frame_enc_len(d) < frame_raw_len(d);
+}
+
+/*
+ * Gets the length of the frame the decompressor holds, header included, once
+ * the header is in. A frame with a bad header ends with it.
+ */
+static uint32_t frame_len(const decompressor_t* d) {
+  uint32_t enc_len;
+
+  if (d->len < COMPRESS_FRAME_HDR_LEN || !frame_valid(d)) {
+    return COMPRESS_FRAME_HDR_LEN;
+  }
+  enc_len = frame_enc_len(d);
+  return COMPRESS_FRAME_HDR_LEN + (enc_len == 0 ? frame_raw_len(d) : enc_len);
+}
+
+int decompress_take(decompressor_t* d, const uint8_t* src, uint32_t len) {
+  uint32_t taken = 0;
+
+  if (d->frame == NULL) {
+    // Room for the largest frame: a stored block.
+    d->frame = malloc(COMPRESS_FRAME_HDR_LEN + COMPRESS_BLOCK);
+    if (d->frame == NULL) {
+      return -1;
+    }
+  }
+  while (taken < len) {
+    uint32_t want = frame_len(d);
+    uint32_t n;
+    if (d->len == want) {
+      break;
+    }
+    n = want - d->len < len - taken ? want - d->len : len - taken;
+    memcpy(d->frame + d->len, src + taken, n);
+    d->len += n;
+    taken += n;
+  }
+  return (int)taken;
+}
+
+int decompress_ready(const decompressor_t* d) {
+  if (d->len < COMPRESS_FRAME_HDR_LEN) {
+    return 0;
+  }
+  if (!frame_valid(d)) {
+    return -1;
+  }
+  return d->len < frame_len(d) ? 0 : (int)frame_raw_len(d);
+}
+
+int decompress_finish(decompressor_t* d, uint8_t* dst) {
+  uint32_t raw_len = frame_raw_len(d);
+  uint32_t enc_len = frame_enc_len(d);
+  const uint8_t* body = d->frame + COMPRESS_FRAME_HDR_LEN;
+
+  d->len = 0;
+  if (!frame_valid(d)) {
+    return -1;
+  }
+  if (enc_len == 0) {
+    memcpy(dst, body, raw_len);
+  } else if (lz_decompress(body, enc_len, dst, raw_len) < 0) {
+    return -1;
+  }
+  return (int)raw_len;
+}
+
+void decompress_free(decompressor_t* d) {
+  free(d->frame);
+  d->frame = NULL;
+  d->len = 0;
+}
@@ -0,0 +1,244 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements CRC32C.
+ *
+ * The `crc32` instruction has a latency of three cycles but can start one
+ * every cycle, so the hardware version runs three independent CRCs over
+ * consecutive blocks and then merges them. Merging shifts a CRC over the
+ * length of a block of zeros, which is linear in the CRC and so done with
+ * four table lookups, tables built once from the matrix of that shift.
+ */
+
+#include "crc32c.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// The CRC32C polynomial, bit reflected.
+#define CRC32C_POLY 0x82F63B78u
+
+// Bytes each of the three hardware streams covers per round. Must be a power
+// of two. Small enough that a packet gets several rounds.
+#define CRC32C_BLOCK 256
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int crc_on = 1;
+static int config_loaded = 0;
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+static uint32_t sw_table[8][256];
+static uint32_t block_shift[4][256];
+static uint32_t (*crc32c_fn)(uint32_t, const uint8_t*, size_t);
+static const char* impl_name;
+
+void cmu_set_crc32c(int enabled) {
+  pthread_mutex_lock(&config_lock);
+  crc_on = enabled != 0;
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int crc32c_enabled(void) {
+  int on;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_CRC32C");
+    if (env != NULL && env[0] != '\0') {
+      crc_on = strcmp(env, "0") != 0;
+    }
+    config_loaded = 1;
+  }
+  on = crc_on;
+  pthread_mutex_unlock(&config_lock);
+  return on;
+}
+
+/*
+ * Multiplies the 32x32 bit matrix `mat` by the vector `vec`.
+ */
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec != 0) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+/*
+ * Builds the tables that shift a CRC over `len` zero bytes, `len` a power of
+ * two.
+ */
+static void build_shift_tables(uint32_t tables[4][256], size_t len) {
+  uint32_t odd[32], even[32];
+  uint32_t* op;
+  uint32_t row = 1;
+
+  // The operator for one zero bit, then two, then four.
+  odd[0] = CRC32C_POLY;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+  // Squaring once more gives one zero byte, and each square after that
+  // doubles it until `len` is reached.
+  op = odd;
+  do {
+    gf2_matrix_square(even, odd);
+    op = even;
+    len >>= 1;
+    if (len == 0) {
+      break;
+    }
+    gf2_matrix_square(odd, even);
+    op = odd;
+    len >>= 1;
+  } while (len != 0);
+
+  for (uint32_t n = 0; n < 256; n++) {
+    tables[0][n] = gf2_matrix_times(op, n);
+    tables[1][n] = gf2_matrix_times(op, n << 8);
+    tables[2][n] = gf2_matrix_times(op, n << 16);
+    tables[3][n] = gf2_matrix_times(op, n << 24);
+  }
+}
+
+static uint32_t shift_block(uint32_t crc) {
+  return block_shift[0][crc & 0xFF] ^ block_shift[1][(crc >> 8) & 0xFF] ^
+         block_shift[2][(crc >> 16) & 0xFF] ^ block_shift[3][crc >> 24];
+}
+
+static uint32_t crc32c_table(uint32_t crc, const uint8_t* buf, size_t len) {
+  crc = ~crc;
+  while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+    crc = sw_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    len--;
+  }
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, buf, sizeof(word));
+    word ^= crc;
+    crc = sw_table[7][word & 0xFF] ^ sw_table[6][(word >> 8) & 0xFF] ^
+          sw_table[5][(word >> 16) & 0xFF] ^ sw_table[4][(word >> 24) & 0xFF] ^
+          sw_table[3][(word >> 32) & 0xFF] ^ sw_table[2][(word >> 40) & 0xFF] ^
+          sw_table[1][(word >> 48) & 0xFF] ^ sw_table[0][word >> 56];
+    buf += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    crc = sw_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    len--;
+  }
+  return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(
+    uint32_t crc, const uint8_t* buf, size_t len) {
+  uint64_t crc0 = ~crc;
+
+  while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *buf++);
+    len--;
+  }
+  while (len >= 3 * CRC32C_BLOCK) {
+    uint64_t crc1 = 0, crc2 = 0;
+    const uint8_t* end = buf + CRC32C_BLOCK;
+    do {
+      uint64_t w0, w1, w2;
+      memcpy(&w0, buf, sizeof(w0));
+      memcpy(&w1, buf + CRC32C_BLOCK, sizeof(w1));
+      memcpy(&w2, buf + 2 * CRC32C_BLOCK, sizeof(w2));
+      crc0 = _mm_crc32_u64(crc0, w0);
+      crc1 = _mm_crc32_u64(crc1, w1);
+      crc2 = _mm_crc32_u64(crc2, w2);
+      buf += 8;
+    } while (buf < end);
+    crc0 = shift_block((uint32_t)crc0) ^ crc1;
+    crc0 = shift_block((uint32_t)crc0) ^ crc2;
+    buf += 2 * CRC32C_BLOCK;
+    len -= 3 * CRC32C_BLOCK;
+  }
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, buf, sizeof(word));
+    crc0 = _mm_crc32_u64(crc0, word);
+    buf += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *buf++);
+    len--;
+  }
+  return ~(uint32_t)crc0;
+}
+#endif
+
+static void init_tables(void) {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = n;
+    for (int k = 0; k < 8; k++) {
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    sw_table[0][n] = crc;
+  }
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = sw_table[0][n];
+    for (int k = 1; k < 8; k++) {
+      crc = sw_table[0][crc & 0xFF] ^ (crc >> 8);
+      sw_table[k][n] = crc;
+    }
+  }
+
+  crc32c_fn = crc32c_table;
+  impl_name = "table";
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    build_shift_tables(block_shift, CRC32C_BLOCK);
+    crc32c_fn = crc32c_sse42;
+    impl_name = "sse4.2";
+  }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void* buf, size_t len) {
+  pthread_once(&tables_once, init_tables);
+  return crc32c_fn(crc, buf, len);
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void* buf, size_t len) {
+  pthread_once(&tables_once, init_tables);
+  return crc32c_table(crc, buf, len);
+}
+
+const char* crc32c_impl(void) {
+  pthread_once(&tables_once, init_tables);
+  return impl_name;
+}
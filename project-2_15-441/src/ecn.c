@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the sender's reaction to ECN marks. The backend sets
+ * and reads the IP header bits.
+ */
+
+#include "ecn.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmu_packet.h"
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ecn_on = ECN_MODE_OFF;
+static int config_loaded = 0;
+
+static int clamp_mode(int mode) {
+  return mode == ECN_MODE_CLASSIC || mode == ECN_MODE_DCTCP ? mode
+                                                            : ECN_MODE_OFF;
+}
+
+void cmu_set_ecn(int mode) {
+  pthread_mutex_lock(&config_lock);
+  ecn_on = clamp_mode(mode);
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int ecn_mode(void) {
+  int mode;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_ECN");
+    if (env != NULL && env[0] != '\0') {
+      ecn_on = strcmp(env, "dctcp") == 0 ? ECN_MODE_DCTCP
+               : strcmp(env, "0") != 0   ? ECN_MODE_CLASSIC
+                                         : ECN_MODE_OFF;
+    }
+    config_loaded = 1;
+  }
+  mode = ecn_on;
+  pthread_mutex_unlock(&config_lock);
+  return mode;
+}
+
+void ecn_init(ecn_t* e, int mode) {
+  memset(e, 0, sizeof(*e));
+  e->mode = clamp_mode(mode);
+  // Until a window has been measured, take every byte as marked, so the
+  // first reduction halves the window like the classic response.
+  e->alpha = ECN_ALPHA_ONE;
+}
+
+/*
+ * Folds the share of bytes marked over the window that just ended into the
+ * DCTCP estimate.
+ */
+static void update_alpha(ecn_t* e) {
+  uint32_t marked = e->marked < e->acked ? e->marked : e->acked;
+  uint32_t share = (uint32_t)((uint64_t)marked * ECN_ALPHA_ONE / e->acked);
+
+  e->alpha = e->alpha - (e->alpha >> ECN_DCTCP_SHIFT) +
+             (share >> ECN_DCTCP_SHIFT);
+  e->acked = 0;
+  e->marked = 0;
+}
+
+int ecn_on_ack(ecn_t* e, uint32_t ack, uint32_t acked, uint32_t echoed,
+               uint32_t snd_nxt, uint32_t* cwnd, uint32_t min_cwnd) {
+  // The count wraps; only its growth matters.
+  uint32_t newly = echoed - e->echoed;
+  uint32_t shrunk;
+
+  e->echoed = echoed;
+  e->acked += acked;
+  e->marked += newly;
+  if (!e->measuring) {
+    e->window_end = snd_nxt;
+    e->measuring = 1;
+  } else if (e->acked > 0 && !before(ack, e->window_end)) {
+    update_alpha(e);
+    e->window_end = snd_nxt;
+  }
+  if (e->reduced && !before(ack, e->recover)) {
+    e->reduced = 0;
+  }
+  if (newly == 0 || e->reduced) {
+    return 0;
+  }
+
+  if (e->mode == ECN_MODE_DCTCP) {
+    shrunk = *cwnd - (uint32_t)((uint64_t)*cwnd * e->alpha /
+                                (2 * ECN_ALPHA_ONE));
+  } else {
+    shrunk = *cwnd / 2;
+  }
+  *cwnd = shrunk > min_cwnd ? shrunk : min_cwnd;
+  e->recover = snd_nxt;
+  e->reduced = 1;
+  return 1;
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the fast open cookies and the client's cookie cache.
+ */
+
+#include "fastopen.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "siphash.h"
+
+// Number of listeners whose cookies a client remembers. The least recently
+// stored entry is replaced when the cache is full.
+#define FASTOPEN_CACHE_SIZE 16
+
+typedef struct {
+  uint32_t addr;  // network byte order, 0 for an empty entry
+  uint16_t port;  // network byte order
+  uint8_t cookie[OPT_FASTOPEN_COOKIE_LEN];
+} fastopen_entry_t;
+
+static pthread_once_t secret_once = PTHREAD_ONCE_INIT;
+static uint8_t secret[SIPHASH_KEY_LEN];
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static fastopen_entry_t cache[FASTOPEN_CACHE_SIZE];
+static uint32_t cache_next;
+
+static void init_secret(void) { siphash_random_key(secret); }
+
+void fastopen_make_cookie(const struct sockaddr_in* client, uint8_t* cookie) {
+  uint64_t mac;
+
+  pthread_once(&secret_once, init_secret);
+  mac = siphash24(secret, &client->sin_addr.s_addr,
+                  sizeof(client->sin_addr.s_addr));
+  memcpy(cookie, &mac, OPT_FASTOPEN_COOKIE_LEN);
+}
+
+int fastopen_check_cookie(const struct sockaddr_in* client,
+                          const uint8_t* cookie) {
+  uint8_t expected[OPT_FASTOPEN_COOKIE_LEN];
+  uint8_t diff = 0;
+
+  fastopen_make_cookie(client, expected);
+  for (int i = 0; i < OPT_FASTOPEN_COOKIE_LEN; i++) {
+    diff |= expected[i] ^ cookie[i];
+  }
+  return diff == 0;
+}
+
+int fastopen_cache_get(const struct sockaddr_in* server, uint8_t* cookie) {
+  int found = 0;
+
+  pthread_mutex_lock(&cache_lock);
+  for (int i = 0; i < FASTOPEN_CACHE_SIZE; i++) {
+    if (cache[i].addr == server->sin_addr.s_addr &&
+        cache[i].port == server->sin_port && cache[i].addr != 0) {
+      memcpy(cookie, cache[i].cookie, OPT_FASTOPEN_COOKIE_LEN);
+      found = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return found;
+}
+
+void fastopen_cache_put(const struct sockaddr_in* server,
+                        const uint8_t* cookie) {
+  fastopen_entry_t* entry = NULL;
+
+  pthread_mutex_lock(&cache_lock);
+  for (int i = 0; i < FASTOPEN_CACHE_SIZE; i++) {
+    if (cache[i].addr == server->sin_addr.s_addr &&
+        cache[i].port == server->sin_port) {
+      entry = &cache[i];
+      break;
+    }
+  }
+  if (entry == NULL) {
+    entry = &cache[cache_next++ % FASTOPEN_CACHE_SIZE];
+  }
+  entry->addr = server->sin_addr.s_addr;
+  entry->port = server->sin_port;
+  memcpy(entry->cookie, cookie, OPT_FASTOPEN_COOKIE_LEN);
+  pthread_mutex_unlock(&cache_lock);
+}
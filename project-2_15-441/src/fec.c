@@ -0,0 +1,249 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements forward error correction with XOR parity.
+ */
+
+#include "fec.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmu_packet.h"
+#include "pmtu.h"
+
+// The longest payload a packet can carry, and so a parity.
+#define FEC_MAX_PAYLOAD (PMTU_MAX_LEN - sizeof(cmu_tcp_header_t))
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int group_size = 0;
+static int config_loaded = 0;
+
+static int clamp_group_size(int size) {
+  if (size < 0) {
+    return FEC_ADAPTIVE;
+  }
+  return size > FEC_MAX_GROUP ? FEC_MAX_GROUP : size;
+}
+
+void cmu_set_fec(int size) {
+  pthread_mutex_lock(&config_lock);
+  group_size = clamp_group_size(size);
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int fec_group_size(void) {
+  int size;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_FEC");
+    if (env != NULL && env[0] != '\0') {
+      group_size = strcmp(env, "auto") == 0
+                       ? FEC_ADAPTIVE
+                       : clamp_group_size(atoi(env) > 0 ? atoi(env) : 0);
+    }
+    config_loaded = 1;
+  }
+  size = group_size;
+  pthread_mutex_unlock(&config_lock);
+  return size;
+}
+
+/*
+ * XORs `len` bytes of `src` into `dst`.
+ */
+static void xor_into(uint8_t* dst, const uint8_t* src, uint16_t len) {
+  for (uint16_t i = 0; i < len; i++) {
+    dst[i] ^= src[i];
+  }
+}
+
+/*
+ * XORs a packet into a running sum, growing its zero padded parity as
+ * needed.
+ */
+static void sum_packet(fec_repair_t* sum, uint8_t* parity,
+                       uint16_t* parity_len, uint32_t seq, uint16_t stream,
+                       const uint8_t* payload, uint16_t len) {
+  if (len > *parity_len) {
+    memset(parity + *parity_len, 0, len - *parity_len);
+    *parity_len = len;
+  }
+  xor_into(parity, payload, len);
+  sum->count++;
+  sum->seq ^= seq;
+  sum->len ^= len;
+  sum->stream ^= stream;
+}
+
+void fec_encoder_init(fec_encoder_t* e, int size) {
+  memset(e, 0, sizeof(*e));
+  e->group_size = clamp_group_size(size);
+}
+
+/*
+ * Gets the size of the next group, 0 if no repairs are needed for now.
+ */
+static int target_group_size(const fec_encoder_t* e) {
+  uint32_t size;
+
+  if (e->group_size != FEC_ADAPTIVE) {
+    return e->group_size;
+  }
+  if (e->resent == 0) {
+    return FEC_MAX_GROUP;
+  }
+  // About one loss in four groups.
+  size = e->sent / (4 * e->resent);
+  if (size < FEC_MIN_GROUP) {
+    return FEC_MIN_GROUP;
+  }
+  return size > FEC_MAX_GROUP ? FEC_MAX_GROUP : (int)size;
+}
+
+static void count_sent(fec_encoder_t* e, uint32_t packets) {
+  e->sent += packets;
+  if (e->sent >= FEC_LOSS_WINDOW) {
+    e->sent /= 2;
+    e->resent /= 2;
+  }
+}
+
+int fec_encode(fec_encoder_t* e, uint32_t seq, uint16_t stream,
+               const uint8_t* payload, uint16_t len, uint32_t* group) {
+  count_sent(e, 1);
+  if (target_group_size(e) == 0 || len > FEC_MAX_PAYLOAD) {
+    return 0;
+  }
+  if (e->parity == NULL) {
+    e->parity = malloc(FEC_MAX_PAYLOAD);
+    if (e->parity == NULL) {
+      return 0;
+    }
+  }
+  if (e->repair.count == 0) {
+    e->repair.group = seq;
+  }
+  sum_packet(&e->repair, e->parity, &e->parity_len, seq, stream, payload,
+             len);
+  *group = e->repair.group;
+  return 1;
+}
+
+void fec_note_resent(fec_encoder_t* e, uint32_t packets) {
+  e->resent += packets;
+  count_sent(e, 0);
+}
+
+int fec_repair_due(const fec_encoder_t* e) {
+  return e->repair.count > 0 && e->repair.count >= target_group_size(e);
+}
+
+const uint8_t* fec_take_repair(fec_encoder_t* e, fec_repair_t* repair,
+                               uint16_t* len) {
+  if (e->repair.count == 0) {
+    return NULL;
+  }
+  *repair = e->repair;
+  *len = e->parity_len;
+  memset(&e->repair, 0, sizeof(e->repair));
+  e->parity_len = 0;
+  return e->parity;
+}
+
+void fec_encoder_free(fec_encoder_t* e) {
+  free(e->parity);
+  e->parity = NULL;
+  e->parity_len = 0;
+  memset(&e->repair, 0, sizeof(e->repair));
+}
+
+static fec_group_t* find_group(fec_decoder_t* d, uint32_t group) {
+  for (int i = 0; i < FEC_DECODE_GROUPS; i++) {
+    if (d->groups[i].sum.count > 0 && d->groups[i].sum.group == group) {
+      return &d->groups[i];
+    }
+  }
+  return NULL;
+}
+
+void fec_decode(fec_decoder_t* d, uint32_t group, uint32_t seq,
+                uint16_t stream, const uint8_t* payload, uint16_t len) {
+  fec_group_t* g = find_group(d, group);
+
+  if (len > FEC_MAX_PAYLOAD) {
+    return;
+  }
+  if (g == NULL) {
+    // Take a free group, or the oldest one: its repair must have been lost.
+    g = &d->groups[0];
+    for (int i = 0; i < FEC_DECODE_GROUPS && g->sum.count > 0; i++) {
+      if (d->groups[i].sum.count == 0 || d->groups[i].age < g->age) {
+        g = &d->groups[i];
+      }
+    }
+    if (g->parity == NULL) {
+      g->parity = malloc(FEC_MAX_PAYLOAD);
+      if (g->parity == NULL) {
+        return;
+      }
+    }
+    memset(&g->sum, 0, sizeof(g->sum));
+    g->sum.group = group;
+    g->parity_len = 0;
+    g->age = d->clock++;
+  }
+  if (g->sum.count < FEC_MAX_GROUP) {
+    sum_packet(&g->sum, g->parity, &g->parity_len, seq, stream, payload, len);
+  }
+}
+
+uint16_t fec_recover(fec_decoder_t* d, const fec_repair_t* repair,
+                     const uint8_t* parity, uint16_t len, uint32_t* seq,
+                     uint16_t* stream, uint8_t* payload) {
+  fec_group_t* g = find_group(d, repair->group);
+  fec_repair_t missing = *repair;
+  uint8_t count = g != NULL ? g->sum.count : 0;
+
+  if (g != NULL) {
+    g->sum.count = 0;
+  }
+  if (count + 1 != repair->count) {
+    return 0;
+  }
+  if (g != NULL) {
+    missing.seq ^= g->sum.seq;
+    missing.len ^= g->sum.len;
+    missing.stream ^= g->sum.stream;
+  }
+  if (missing.len == 0 || missing.len > len) {
+    return 0;
+  }
+  memcpy(payload, parity, missing.len);
+  if (g != NULL) {
+    xor_into(payload, g->parity,
+             g->parity_len < missing.len ? g->parity_len : missing.len);
+  }
+  *seq = missing.seq;
+  *stream = missing.stream;
+  return missing.len;
+}
+
+void fec_decoder_free(fec_decoder_t* d) {
+  for (int i = 0; i < FEC_DECODE_GROUPS; i++) {
+    free(d->groups[i].parity);
+    d->groups[i].parity = NULL;
+    d->groups[i].sum.count = 0;
+  }
+}
@@ -0,0 +1,32 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements batch header validation.
+ */
+
+#include "header_codec.h"
+
+#include <stdint.h>
+
+int hdr_validate_batch(uint8_t* const* pkts, const uint32_t* lens, int n,
+                       uint16_t port, cmu_hdr_t* hdrs, uint8_t* valid) {
+  int count = 0;
+
+  // All the loads and swaps first, then all the checks, so the decodes of
+  // different datagrams overlap instead of waiting on each check.
+  for (int i = 0; i < n; i++) {
+    hdr_decode(pkts[i], &hdrs[i]);
+  }
+  for (int i = 0; i < n; i++) {
+    valid[i] = (uint8_t)hdr_valid(&hdrs[i], lens[i], port);
+    count += valid[i];
+  }
+  return count;
+}
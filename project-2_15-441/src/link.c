@@ -0,0 +1,364 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the in-process link emulator.
+ *
+ * Every decision is drawn from a per-link generator, so a given config and
+ * seed always impair the same datagrams in the same way. Held back datagrams
+ * wait in a queue ordered by release time until `link_flush` sends them.
+ */
+
+#include "link.h"
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "clock.h"
+#include "ecn.h"
+#include "log.h"
+
+#define LINK_DEFAULT_QUEUE_LIMIT 1000
+#define LINK_DEFAULT_REORDER_US 5000
+
+typedef struct link_packet {
+  struct link_packet* next;
+  uint64_t release;  // when the datagram leaves the link
+  struct sockaddr_in to;
+  int fd;
+  int ce;  // leaves marked CE
+  size_t len;
+  uint8_t data[];
+} link_packet_t;
+
+struct cmu_link {
+  cmu_link_config_t cfg;
+  uint64_t rng;
+  uint64_t busy_until;  // when the bottleneck finishes the queued datagrams
+  link_packet_t* queue;
+  uint32_t queue_len;
+  uint64_t dropped;
+  uint64_t duplicated;
+  uint64_t reordered;
+  uint64_t marked;
+};
+
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+static cmu_link_config_t default_cfg;
+static int default_loaded = 0;
+static uint64_t links_created = 0;
+
+static uint64_t splitmix64(uint64_t* x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/*
+ * Returns a uniform double in [0, 1).
+ */
+static double next_double(cmu_link_t* link) {
+  return (splitmix64(&link->rng) >> 11) * 0x1.0p-53;
+}
+
+static int chance(cmu_link_t* link, double p) {
+  return p > 0 && next_double(link) < p;
+}
+
+static void parse_config(const char* spec, cmu_link_config_t* cfg) {
+  char* copy = strdup(spec);
+  char* save = NULL;
+
+  for (char* tok = strtok_r(copy, ",", &save); tok != NULL;
+       tok = strtok_r(NULL, ",", &save)) {
+    char* eq = strchr(tok, '=');
+    if (eq == NULL) {
+      LOG_WARN("ignoring CMU_LINK entry '%s'", tok);
+      continue;
+    }
+    *eq = '\0';
+    const char* val = eq + 1;
+    if (strcmp(tok, "loss") == 0) {
+      cfg->loss = strtod(val, NULL);
+    } else if (strcmp(tok, "duplicate") == 0) {
+      cfg->duplicate = strtod(val, NULL);
+    } else if (strcmp(tok, "reorder") == 0) {
+      cfg->reorder = strtod(val, NULL);
+    } else if (strcmp(tok, "reorder_us") == 0) {
+      cfg->reorder_us = strtoull(val, NULL, 10);
+    } else if (strcmp(tok, "delay_us") == 0) {
+      cfg->delay_us = strtoull(val, NULL, 10);
+    } else if (strcmp(tok, "jitter_us") == 0) {
+      cfg->jitter_us = strtoull(val, NULL, 10);
+    } else if (strcmp(tok, "rate_bps") == 0) {
+      cfg->rate_bps = strtoull(val, NULL, 10);
+    } else if (strcmp(tok, "queue_limit") == 0) {
+      cfg->queue_limit = strtoul(val, NULL, 10);
+    } else if (strcmp(tok, "mtu") == 0) {
+      cfg->mtu = strtoul(val, NULL, 10);
+    } else if (strcmp(tok, "mark_us") == 0) {
+      cfg->mark_us = strtoull(val, NULL, 10);
+    } else if (strcmp(tok, "seed") == 0) {
+      cfg->seed = strtoull(val, NULL, 10);
+    } else {
+      LOG_WARN("ignoring unknown CMU_LINK key '%s'", tok);
+    }
+  }
+  free(copy);
+}
+
+static int is_perfect(const cmu_link_config_t* cfg) {
+  return cfg->loss <= 0 && cfg->duplicate <= 0 && cfg->reorder <= 0 &&
+         cfg->delay_us == 0 && cfg->jitter_us == 0 && cfg->rate_bps == 0 &&
+         cfg->mtu == 0;
+}
+
+void cmu_set_link_config(const cmu_link_config_t* cfg) {
+  pthread_mutex_lock(&default_lock);
+  if (cfg != NULL) {
+    default_cfg = *cfg;
+  } else {
+    memset(&default_cfg, 0, sizeof(default_cfg));
+  }
+  default_loaded = 1;
+  pthread_mutex_unlock(&default_lock);
+}
+
+cmu_link_t* link_create(uint64_t salt) {
+  cmu_link_config_t cfg;
+  cmu_link_t* link;
+
+  pthread_mutex_lock(&default_lock);
+  if (!default_loaded) {
+    const char* spec = getenv("CMU_LINK");
+    if (spec != NULL) {
+      parse_config(spec, &default_cfg);
+    }
+    default_loaded = 1;
+  }
+  cfg = default_cfg;
+  // Sockets of the same type in one process differ by creation order.
+  salt = salt << 32 ^ ++links_created;
+  pthread_mutex_unlock(&default_lock);
+
+  if (is_perfect(&cfg)) {
+    return NULL;
+  }
+  link = calloc(1, sizeof(cmu_link_t));
+  if (link == NULL) {
+    return NULL;
+  }
+  link->cfg = cfg;
+  if (link->cfg.queue_limit == 0) {
+    link->cfg.queue_limit = LINK_DEFAULT_QUEUE_LIMIT;
+  }
+  if (link->cfg.reorder > 0 && link->cfg.reorder_us == 0) {
+    link->cfg.reorder_us = LINK_DEFAULT_REORDER_US;
+  }
+  link->rng = cfg.seed ^ splitmix64(&salt);
+  LOG_INFO("link emulator: loss %.4f dup %.4f reorder %.4f delay %lu us "
+           "jitter %lu us rate %lu bps mtu %u mark %lu us seed %lu",
+           cfg.loss, cfg.duplicate, cfg.reorder,
+           (unsigned long)cfg.delay_us, (unsigned long)cfg.jitter_us,
+           (unsigned long)cfg.rate_bps, cfg.mtu, (unsigned long)cfg.mark_us,
+           (unsigned long)cfg.seed);
+  return link;
+}
+
+void link_destroy(cmu_link_t* link) {
+  if (link == NULL) {
+    return;
+  }
+  // Datagrams already on the wire still arrive after the sender goes away,
+  // e.g. the last ACK of a connection.
+  while (link->queue != NULL) {
+    uint64_t now = get_curr_micros();
+    if (link->queue->release > now) {
+      uint64_t wait = link->queue->release - now;
+      struct timespec ts = {(time_t)(wait / USEC_PER_SEC),
+                            (long)(wait % USEC_PER_SEC * 1000)};
+      nanosleep(&ts, NULL);
+    }
+    link_flush(link);
+  }
+  LOG_INFO("link emulator: dropped %lu, duplicated %lu, reordered %lu, "
+           "marked %lu",
+           (unsigned long)link->dropped, (unsigned long)link->duplicated,
+           (unsigned long)link->reordered, (unsigned long)link->marked);
+  free(link);
+}
+
+/*
+ * Tells if the datagrams a UDP socket sends are ECN-capable.
+ */
+static int sends_ect(int fd) {
+  int tos = 0;
+  socklen_t len = sizeof(tos);
+
+  return getsockopt(fd, IPPROTO_IP, IP_TOS, &tos, &len) == 0 &&
+         (tos & ECN_MASK) != 0;
+}
+
+/*
+ * Queues one copy of a datagram, or drops it if the queue is full.
+ */
+static void enqueue(cmu_link_t* link, int fd, const void* buf, size_t len,
+                    const struct sockaddr_in* to) {
+  uint64_t now = get_curr_micros();
+  uint64_t release = now;
+  link_packet_t* pkt;
+  link_packet_t** pos;
+  int ce = 0;
+
+  if (link->queue_len >= link->cfg.queue_limit) {
+    link->dropped++;
+    return;
+  }
+
+  // Serialize through the bottleneck, then add the propagation delay.
+  if (link->cfg.rate_bps > 0) {
+    if (link->busy_until < now) {
+      link->busy_until = now;
+    }
+    // Once the queue builds up, mark the datagrams that are ECN-capable,
+    // like a step AQM.
+    if (link->cfg.mark_us > 0 && link->busy_until - now >= link->cfg.mark_us &&
+        sends_ect(fd)) {
+      ce = 1;
+      link->marked++;
+    }
+    link->busy_until += len * 8 * USEC_PER_SEC / link->cfg.rate_bps;
+    release = link->busy_until;
+  }
+  release += link->cfg.delay_us;
+  if (link->cfg.jitter_us > 0) {
+    release += splitmix64(&link->rng) % (link->cfg.jitter_us + 1);
+  }
+  if (chance(link, link->cfg.reorder)) {
+    release += link->cfg.reorder_us;
+    link->reordered++;
+  }
+
+  pkt = malloc(sizeof(link_packet_t) + len);
+  if (pkt == NULL) {
+    link->dropped++;
+    return;
+  }
+  pkt->release = release;
+  pkt->to = *to;
+  pkt->fd = fd;
+  pkt->ce = ce;
+  pkt->len = len;
+  memcpy(pkt->data, buf, len);
+
+  // Keep the queue sorted by release time, FIFO among equal times.
+  pos = &link->queue;
+  while (*pos != NULL && (*pos)->release <= release) {
+    pos = &(*pos)->next;
+  }
+  pkt->next = *pos;
+  *pos = pkt;
+  link->queue_len++;
+}
+
+/*
+ * Tells if the datagrams a UDP socket sends have DF set.
+ */
+static int df_set(int fd) {
+  int mode = IP_PMTUDISC_WANT;
+  socklen_t len = sizeof(mode);
+
+  getsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &mode, &len);
+  return mode != IP_PMTUDISC_DONT;
+}
+
+void link_send(cmu_link_t* link, int fd, const void* buf, size_t len,
+               const struct sockaddr_in* to) {
+  if (link == NULL) {
+    sendto(fd, buf, len, 0, (const struct sockaddr*)to, sizeof(*to));
+    return;
+  }
+
+  // Like a tunnel that drops datagrams with DF set instead of sending back
+  // an ICMP error. Those without DF it fragments, and the peer reassembles.
+  if (link->cfg.mtu != 0 && len > link->cfg.mtu && df_set(fd)) {
+    link->dropped++;
+    return;
+  }
+  if (chance(link, link->cfg.loss)) {
+    link->dropped++;
+    return;
+  }
+  enqueue(link, fd, buf, len, to);
+  if (chance(link, link->cfg.duplicate)) {
+    enqueue(link, fd, buf, len, to);
+    link->duplicated++;
+  }
+  link_flush(link);
+}
+
+/*
+ * Sends a queued datagram with its ECN field set to CE.
+ */
+static void send_ce(link_packet_t* pkt) {
+  uint8_t ctrl[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = {pkt->data, pkt->len};
+  struct msghdr msg;
+  struct cmsghdr* c;
+  int tos = ECN_CE;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(ctrl, 0, sizeof(ctrl));
+  msg.msg_name = &pkt->to;
+  msg.msg_namelen = sizeof(pkt->to);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = IPPROTO_IP;
+  c->cmsg_type = IP_TOS;
+  c->cmsg_len = CMSG_LEN(sizeof(tos));
+  memcpy(CMSG_DATA(c), &tos, sizeof(tos));
+  sendmsg(pkt->fd, &msg, 0);
+}
+
+void link_flush(cmu_link_t* link) {
+  uint64_t now;
+
+  if (link == NULL || link->queue == NULL) {
+    return;
+  }
+  now = get_curr_micros();
+  while (link->queue != NULL && link->queue->release <= now) {
+    link_packet_t* pkt = link->queue;
+    link->queue = pkt->next;
+    link->queue_len--;
+    if (pkt->ce) {
+      send_ce(pkt);
+    } else {
+      sendto(pkt->fd, pkt->data, pkt->len, 0,
+             (const struct sockaddr*)&pkt->to, sizeof(pkt->to));
+    }
+    free(pkt);
+  }
+}
+
+uint64_t link_next_release(const cmu_link_t* link) {
+  if (link == NULL || link->queue == NULL) {
+    return 0;
+  }
+  return link->queue->release;
+}
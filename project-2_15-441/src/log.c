@@ -0,0 +1,91 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the CMU-TCP logging facility and its trace ring.
+ */
+
+#include "log.h"
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "clock.h"
+
+#define LOG_TRACE_RING_MASK (LOG_TRACE_RING_SIZE - 1)
+
+typedef struct {
+  // Position of the event in the stream plus one, or 0 while it is written.
+  // Readers check it before and after copying the entry, like a seqlock.
+  _Atomic uint64_t seq;
+  uint64_t time;
+  const char* fmt;
+  uint64_t args[3];
+} log_trace_entry_t;
+
+static log_trace_entry_t trace_ring[LOG_TRACE_RING_SIZE];
+static _Atomic uint64_t trace_head;
+
+static const char* level_names[] = {"NONE", "ERROR", "WARN", "INFO", "DEBUG"};
+
+void log_write(int level, const char* file, int line, const char* fmt, ...) {
+  va_list args;
+
+  flockfile(stderr);
+  fprintf(stderr, "[%s] %s:%d: ", level_names[level], file, line);
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+  funlockfile(stderr);
+}
+
+void log_trace(const char* fmt, uint64_t a, uint64_t b, uint64_t c) {
+  uint64_t n = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+  log_trace_entry_t* e = &trace_ring[n & LOG_TRACE_RING_MASK];
+
+  atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  e->time = get_curr_micros();
+  e->fmt = fmt;
+  e->args[0] = a;
+  e->args[1] = b;
+  e->args[2] = c;
+  atomic_store_explicit(&e->seq, n + 1, memory_order_release);
+}
+
+void log_trace_dump(FILE* out) {
+  uint64_t head = atomic_load_explicit(&trace_head, memory_order_acquire);
+  uint64_t start = head > LOG_TRACE_RING_SIZE ? head - LOG_TRACE_RING_SIZE : 0;
+
+  for (uint64_t i = start; i < head; i++) {
+    log_trace_entry_t* e = &trace_ring[i & LOG_TRACE_RING_MASK];
+    log_trace_entry_t copy;
+
+    if (atomic_load_explicit(&e->seq, memory_order_acquire) != i + 1) {
+      continue;
+    }
+    copy.time = e->time;
+    copy.fmt = e->fmt;
+    copy.args[0] = e->args[0];
+    copy.args[1] = e->args[1];
+    copy.args[2] = e->args[2];
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&e->seq, memory_order_relaxed) != i + 1) {
+      continue;
+    }
+
+    fprintf(out, "%" PRIu64 ".%06" PRIu64 " ", copy.time / USEC_PER_SEC,
+            copy.time % USEC_PER_SEC);
+    fprintf(out, copy.fmt, copy.args[0], copy.args[1], copy.args[2]);
+    fputc('\n', out);
+  }
+}
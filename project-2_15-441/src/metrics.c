@@ -0,0 +1,223 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the metrics cache.
+ */
+
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clock.h"
+#include "log.h"
+
+typedef struct {
+  uint32_t addr;       // network byte order, 0 for an empty entry
+  uint64_t stored_us;  // when it was stored, on the wall clock
+  cmu_metrics_t m;
+} metrics_entry_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static metrics_entry_t cache[METRICS_CACHE_SIZE];
+static int cache_on = 1;
+static char* cache_path = NULL;
+static int config_loaded = 0;
+
+/*
+ * Gets the time on the wall clock, which unlike the CMU-TCP clock means the
+ * same to every process reading the file.
+ */
+static uint64_t wall_micros(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * USEC_PER_SEC + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/*
+ * Finds the entry of a host, or the one to replace with it: an empty one or
+ * else the least recently stored. Must be called with `cache_lock` held.
+ */
+static metrics_entry_t* find_entry(uint32_t addr, int* found) {
+  metrics_entry_t* victim = &cache[0];
+
+  for (int i = 0; i < METRICS_CACHE_SIZE; i++) {
+    if (cache[i].addr == addr) {
+      *found = 1;
+      return &cache[i];
+    }
+    if (victim->addr != 0 &&
+        (cache[i].addr == 0 || cache[i].stored_us < victim->stored_us)) {
+      victim = &cache[i];
+    }
+  }
+  *found = 0;
+  return victim;
+}
+
+/*
+ * Stores an entry unless a newer one for the same host is there. Must be
+ * called with `cache_lock` held.
+ */
+static void store(uint32_t addr, uint64_t stored_us, const cmu_metrics_t* m) {
+  int found;
+  metrics_entry_t* e = find_entry(addr, &found);
+
+  if (found && e->stored_us > stored_us) {
+    return;
+  }
+  e->addr = addr;
+  e->stored_us = stored_us;
+  e->m = *m;
+}
+
+/*
+ * Reads the entries of the cache file into the cache. Must be called with
+ * `cache_lock` held.
+ */
+static void read_file(void) {
+  char line[256];
+  FILE* f = fopen(cache_path, "r");
+
+  if (f == NULL) {
+    // Nothing stored yet.
+    return;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr addr;
+    uint64_t stored_us;
+    cmu_metrics_t m;
+    if (sscanf(line, "%15s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu32
+                     " %" SCNu32 " %" SCNu16,
+               ip, &stored_us, &m.srtt_us, &m.rttvar_us, &m.ssthresh, &m.cwnd,
+               &m.pmtu) == 7 &&
+        inet_pton(AF_INET, ip, &addr) == 1 && addr.s_addr != 0) {
+      store(addr.s_addr, stored_us, &m);
+    }
+  }
+  fclose(f);
+}
+
+/*
+ * Rewrites the cache file with the whole cache, through a temporary file so
+ * that readers never see half of it. Must be called with `cache_lock` held.
+ */
+static void write_file(void) {
+  char tmp[4096];
+  FILE* f;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+  f = fopen(tmp, "w");
+  if (f == NULL) {
+    LOG_WARN("cannot write metrics file %s", tmp);
+    return;
+  }
+  for (int i = 0; i < METRICS_CACHE_SIZE; i++) {
+    const metrics_entry_t* e = &cache[i];
+    struct in_addr addr = {e->addr};
+    char ip[INET_ADDRSTRLEN];
+    if (e->addr == 0 || inet_ntop(AF_INET, &addr, ip, sizeof(ip)) == NULL) {
+      continue;
+    }
+    fprintf(f,
+            "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu32 " %" PRIu32
+            " %" PRIu16 "\n",
+            ip, e->stored_us, e->m.srtt_us, e->m.rttvar_us, e->m.ssthresh,
+            e->m.cwnd, e->m.pmtu);
+  }
+  if (fclose(f) != 0 || rename(tmp, cache_path) != 0) {
+    LOG_WARN("cannot write metrics file %s", cache_path);
+  }
+}
+
+/*
+ * Reads the environment the first time around. Must be called with
+ * `cache_lock` held.
+ */
+static void load_config(void) {
+  const char* env;
+
+  if (config_loaded) {
+    return;
+  }
+  config_loaded = 1;
+  env = getenv("CMU_METRICS");
+  if (env != NULL && env[0] != '\0') {
+    cache_on = strcmp(env, "0") != 0;
+  }
+  env = getenv("CMU_METRICS_FILE");
+  if (env != NULL && env[0] != '\0') {
+    cache_path = strdup(env);
+    if (cache_path != NULL) {
+      read_file();
+    }
+  }
+}
+
+void cmu_set_metrics_cache(int enabled) {
+  pthread_mutex_lock(&cache_lock);
+  load_config();
+  cache_on = enabled != 0;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void cmu_set_metrics_file(const char* path) {
+  pthread_mutex_lock(&cache_lock);
+  load_config();
+  free(cache_path);
+  cache_path = path != NULL ? strdup(path) : NULL;
+  if (cache_path != NULL) {
+    read_file();
+  }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+int metrics_get(const struct sockaddr_in* peer, cmu_metrics_t* m) {
+  uint64_t now = wall_micros();
+  uint64_t age = 0;
+  int found;
+  metrics_entry_t* e;
+
+  pthread_mutex_lock(&cache_lock);
+  load_config();
+  e = find_entry(peer->sin_addr.s_addr, &found);
+  found = found && cache_on && peer->sin_addr.s_addr != 0;
+  if (found) {
+    age = now > e->stored_us ? now - e->stored_us : 0;
+    found = age < METRICS_MAX_AGE_US;
+    *m = e->m;
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  if (found && m->rttvar_us < m->srtt_us / 2) {
+    // Trust the variation less as it ages, up to what one sample would give.
+    m->rttvar_us += (m->srtt_us / 2 - m->rttvar_us) * age / METRICS_MAX_AGE_US;
+  }
+  return found;
+}
+
+void metrics_put(const struct sockaddr_in* peer, const cmu_metrics_t* m) {
+  pthread_mutex_lock(&cache_lock);
+  load_config();
+  if (cache_on && peer->sin_addr.s_addr != 0) {
+    store(peer->sin_addr.s_addr, wall_micros(), m);
+    if (cache_path != NULL) {
+      write_file();
+    }
+  }
+  pthread_mutex_unlock(&cache_lock);
+}
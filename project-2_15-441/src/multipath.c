@@ -0,0 +1,116 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the path bookkeeping and scheduler of multipath
+ * connections.
+ */
+
+#include "multipath.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int multipath_on = 0;
+static int config_loaded = 0;
+
+void cmu_set_multipath(int enabled) {
+  pthread_mutex_lock(&config_lock);
+  multipath_on = enabled != 0;
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int multipath_enabled(void) {
+  int on;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_MULTIPATH");
+    if (env != NULL && env[0] != '\0') {
+      multipath_on = strcmp(env, "0") != 0;
+    }
+    config_loaded = 1;
+  }
+  on = multipath_on;
+  pthread_mutex_unlock(&config_lock);
+  return on;
+}
+
+void path_init(cmu_path_t* path, int fd, const struct sockaddr_in* peer,
+               uint64_t rto, uint32_t cwnd) {
+  memset(path, 0, sizeof(*path));
+  path->fd = fd;
+  path->peer = *peer;
+  path->state = PATH_JOINING;
+  rtt_init(&path->rtt, rto);
+  path->cwnd = cwnd;
+}
+
+int path_pick(const cmu_path_t* paths, int n, const uint32_t* in_flight,
+              uint32_t len) {
+  int best = -1;
+  int best_fits = 0;
+  uint64_t best_cost = 0;
+
+  for (int i = 0; i < n; i++) {
+    const cmu_path_t* p = &paths[i];
+    // A path not measured yet goes by its initial timeout.
+    uint64_t rtt = p->rtt.srtt != 0 ? p->rtt.srtt : p->rtt.rto;
+    uint64_t cost = rtt * (p->cwnd + in_flight[i]) / p->cwnd;
+    int fits = in_flight[i] + len <= p->cwnd;
+
+    if (p->state != PATH_UP) {
+      continue;
+    }
+    // Paths with room in their window come first.
+    if (best < 0 || fits > best_fits ||
+        (fits == best_fits && cost < best_cost)) {
+      best = i;
+      best_fits = fits;
+      best_cost = cost;
+    }
+  }
+  return best;
+}
+
+void path_acked(cmu_path_t* path, uint32_t acked, uint32_t mss,
+                uint32_t max_cwnd) {
+  uint32_t grow = (uint32_t)((uint64_t)acked * mss / path->cwnd);
+
+  path->cwnd = path->cwnd + (grow > 0 ? grow : 1);
+  if (path->cwnd > max_cwnd) {
+    path->cwnd = max_cwnd;
+  }
+}
+
+int path_timed_out(cmu_path_t* path, uint32_t mss) {
+  path->cwnd /= 2;
+  if (path->cwnd < 2 * mss) {
+    path->cwnd = 2 * mss;
+  }
+  rtt_backoff(&path->rtt);
+  if (path->state == PATH_UP && ++path->timeouts >= MP_PATH_MAX_RTOS) {
+    path->state = PATH_DOWN;
+    return 1;
+  }
+  return 0;
+}
+
+int path_heard(cmu_path_t* path) {
+  int revived = path->state != PATH_UP;
+
+  path->state = PATH_UP;
+  path->timeouts = 0;
+  path->join_tries = 0;
+  return revived;
+}
@@ -0,0 +1,167 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the path MTU search. It only keeps state; the backend
+ * sends the probes and reports what happens to them.
+ */
+
+#include "pmtu.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int discovery_on = 0;
+static int config_loaded = 0;
+
+void cmu_set_pmtu_discovery(int enabled) {
+  pthread_mutex_lock(&config_lock);
+  discovery_on = enabled != 0;
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int pmtu_discovery_enabled(void) {
+  int on;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_PMTUD");
+    if (env != NULL && env[0] != '\0') {
+      discovery_on = strcmp(env, "0") != 0;
+    }
+    config_loaded = 1;
+  }
+  on = discovery_on;
+  pthread_mutex_unlock(&config_lock);
+  return on;
+}
+
+void pmtu_init(pmtu_t* pmtu, int enabled) {
+  pmtu->enabled = enabled != 0;
+  pmtu->fragment = 0;
+  pmtu->plpmtu = PMTU_START_LEN;
+  pmtu->ceiling = PMTU_MAX_LEN + 1;
+  pmtu->probe_size = 0;
+  pmtu->probe_count = 0;
+  pmtu->probe_time = 0;
+  pmtu->raise_time = 0;
+  pmtu->rtos = 0;
+}
+
+void pmtu_resume(pmtu_t* pmtu, uint16_t plpmtu) {
+  if (!pmtu->enabled || plpmtu < PMTU_BASE_LEN || plpmtu > PMTU_MAX_LEN) {
+    return;
+  }
+  // A path found to carry less than PMTU_START_LEN is not black-holed again.
+  pmtu->plpmtu = plpmtu;
+  if (pmtu->ceiling <= plpmtu) {
+    pmtu->ceiling = plpmtu + 1;
+  }
+}
+
+/*
+ * Picks the next length to try between what works and what does not: the
+ * largest one first, then Ethernet's, then halfway.
+ */
+static uint16_t pick_probe_size(const pmtu_t* pmtu) {
+  if (pmtu->ceiling > PMTU_MAX_LEN) {
+    return PMTU_MAX_LEN;
+  }
+  if (pmtu->plpmtu < PMTU_ETHERNET_LEN && pmtu->ceiling > PMTU_ETHERNET_LEN) {
+    return PMTU_ETHERNET_LEN;
+  }
+  return pmtu->plpmtu + (pmtu->ceiling - pmtu->plpmtu) / 2;
+}
+
+uint16_t pmtu_next_probe(pmtu_t* pmtu, uint64_t now, uint64_t rto) {
+  // Without DF, probes too large for the path would get through in pieces.
+  if (!pmtu->enabled || pmtu->fragment) {
+    return 0;
+  }
+  if (pmtu->probe_size != 0) {
+    if (now - pmtu->probe_time < rto) {
+      return 0;
+    }
+    if (pmtu->probe_count < PMTU_MAX_PROBES) {
+      pmtu->probe_count++;
+      pmtu->probe_time = now;
+      return pmtu->probe_size;
+    }
+    pmtu->ceiling = pmtu->probe_size;
+    pmtu->probe_size = 0;
+  }
+
+  if (pmtu->ceiling - pmtu->plpmtu <= PMTU_SEARCH_STEP) {
+    if (pmtu->plpmtu >= PMTU_MAX_LEN) {
+      return 0;
+    }
+    if (pmtu->raise_time == 0) {
+      pmtu->raise_time = now + PMTU_RAISE_US;
+    }
+    if (now < pmtu->raise_time) {
+      return 0;
+    }
+    // The path may have changed; see if it carries more now.
+    pmtu->ceiling = PMTU_MAX_LEN + 1;
+    pmtu->raise_time = 0;
+  }
+
+  pmtu->probe_size = pick_probe_size(pmtu);
+  pmtu->probe_count = 1;
+  pmtu->probe_time = now;
+  return pmtu->probe_size;
+}
+
+int pmtu_probe_acked(pmtu_t* pmtu, uint16_t size) {
+  if (size <= pmtu->plpmtu || size > PMTU_MAX_LEN) {
+    return 0;
+  }
+  pmtu->plpmtu = size;
+  pmtu->rtos = 0;
+  if (pmtu->ceiling <= size) {
+    pmtu->ceiling = size + 1;
+  }
+  if (pmtu->probe_size <= size) {
+    pmtu->probe_size = 0;
+  }
+  return 1;
+}
+
+void pmtu_progress(pmtu_t* pmtu) { pmtu->rtos = 0; }
+
+int pmtu_timeout(pmtu_t* pmtu) {
+  if (!pmtu->enabled || pmtu->fragment ||
+      ++pmtu->rtos < PMTU_BLACK_HOLE_RTOS) {
+    return 0;
+  }
+  pmtu->probe_size = 0;
+  pmtu->raise_time = 0;
+  pmtu->rtos = 0;
+  if (pmtu->plpmtu <= PMTU_BASE_LEN) {
+    pmtu->fragment = 1;
+    return 1;
+  }
+  pmtu->ceiling = pmtu->plpmtu;
+  pmtu->plpmtu = PMTU_BASE_LEN;
+  return 1;
+}
+
+uint64_t pmtu_deadline(const pmtu_t* pmtu, uint64_t rto) {
+  if (pmtu->fragment) {
+    return 0;
+  }
+  if (pmtu->probe_size != 0) {
+    return pmtu->probe_time + rto;
+  }
+  return pmtu->raise_time;
+}
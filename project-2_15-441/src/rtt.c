@@ -0,0 +1,71 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the RFC 6298 round-trip time estimator.
+ */
+
+#include "rtt.h"
+
+#include <stdint.h>
+
+// Clock granularity, G in RFC 6298.
+#define RTT_CLOCK_GRANULARITY_US 1
+
+static uint64_t clamp_rto(uint64_t rto) {
+  if (rto < RTT_MIN_RTO_US) {
+    return RTT_MIN_RTO_US;
+  }
+  if (rto > RTT_MAX_RTO_US) {
+    return RTT_MAX_RTO_US;
+  }
+  return rto;
+}
+
+void rtt_init(rtt_estimator_t* rtt, uint64_t initial_rto) {
+  rtt->srtt = 0;
+  rtt->rttvar = 0;
+  rtt->latest = 0;
+  rtt->min_rtt = 0;
+  rtt->rto = clamp_rto(initial_rto);
+  rtt->backoff = 0;
+}
+
+void rtt_sample(rtt_estimator_t* rtt, uint64_t sample) {
+  rtt->latest = sample;
+  if (rtt->min_rtt == 0 || sample < rtt->min_rtt) {
+    rtt->min_rtt = sample > 0 ? sample : 1;
+  }
+  if (rtt->srtt == 0) {
+    // First measurement: SRTT <- R, RTTVAR <- R/2.
+    rtt->srtt = sample > 0 ? sample : 1;
+    rtt->rttvar = sample / 2;
+  } else {
+    // RTTVAR <- 3/4 RTTVAR + 1/4 |SRTT - R'|, then SRTT <- 7/8 SRTT + 1/8 R'.
+    // Both are computed on unsigned values without ever going negative.
+    uint64_t err = rtt->srtt > sample ? rtt->srtt - sample : sample - rtt->srtt;
+    rtt->rttvar = rtt->rttvar - rtt->rttvar / 4 + err / 4;
+    rtt->srtt = rtt->srtt - rtt->srtt / 8 + sample / 8;
+    if (rtt->srtt == 0) {
+      rtt->srtt = 1;
+    }
+  }
+
+  uint64_t var = 4 * rtt->rttvar;
+  if (var < RTT_CLOCK_GRANULARITY_US) {
+    var = RTT_CLOCK_GRANULARITY_US;
+  }
+  rtt->rto = clamp_rto(rtt->srtt + var);
+  rtt->backoff = 0;
+}
+
+void rtt_backoff(rtt_estimator_t* rtt) {
+  rtt->rto = clamp_rto(rtt->rto * 2);
+  rtt->backoff++;
+}
@@ -15,7 +15,6 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 
 #include "cmu_tcp.h"
 
@@ -42,11 +41,12 @@ void functionality(cmu_socket_t *sock) {
   printf("N: %d\n", n);
   cmu_write(sock, "https://www.youtube.com/watch?v=dQw4w9WgXcQ", 44);
 
-  sleep(5);
-  n = cmu_read(sock, buf, BUF_SIZE, NO_FLAG);
-  printf("N: %d\n", n);
+  // Save everything else the client sends, up to the end of the stream.
   fp = fopen("/tmp/file.c", "w");
-  fwrite(buf, 1, n, fp);
+  while ((n = cmu_read(sock, buf, BUF_SIZE, NO_FLAG)) > 0) {
+    printf("N: %d\n", n);
+    fwrite(buf, 1, n, fp);
+  }
   fclose(fp);
 }
 
@@ -0,0 +1,99 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements SipHash-2-4, following the reference implementation by
+ * Jean-Philippe Aumasson and Daniel J. Bernstein.
+ */
+
+#include "siphash.h"
+
+#include <stdint.h>
+#include <sys/random.h>
+
+#include "clock.h"
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND           \
+  do {                     \
+    v0 += v1;              \
+    v1 = ROTL(v1, 13);     \
+    v1 ^= v0;              \
+    v0 = ROTL(v0, 32);     \
+    v2 += v3;              \
+    v3 = ROTL(v3, 16);     \
+    v3 ^= v2;              \
+    v0 += v3;              \
+    v3 = ROTL(v3, 21);     \
+    v3 ^= v0;              \
+    v2 += v1;              \
+    v1 = ROTL(v1, 17);     \
+    v1 ^= v2;              \
+    v2 = ROTL(v2, 32);     \
+  } while (0)
+
+/*
+ * Reads eight bytes as a little endian integer.
+ */
+static uint64_t load_le64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+uint64_t siphash24(const uint8_t key[SIPHASH_KEY_LEN], const void* data,
+                   size_t len) {
+  const uint8_t* in = data;
+  const uint8_t* end = in + len - (len % 8);
+  uint64_t k0 = load_le64(key);
+  uint64_t k1 = load_le64(key + 8);
+  uint64_t v0 = UINT64_C(0x736f6d6570736575) ^ k0;
+  uint64_t v1 = UINT64_C(0x646f72616e646f6d) ^ k1;
+  uint64_t v2 = UINT64_C(0x6c7967656e657261) ^ k0;
+  uint64_t v3 = UINT64_C(0x7465646279746573) ^ k1;
+  uint64_t b = (uint64_t)len << 56;
+  uint64_t m;
+
+  for (; in != end; in += 8) {
+    m = load_le64(in);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+
+  for (int i = (int)(len % 8) - 1; i >= 0; i--) {
+    b |= (uint64_t)in[i] << (8 * i);
+  }
+  v3 ^= b;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+void siphash_random_key(uint8_t key[SIPHASH_KEY_LEN]) {
+  if (getrandom(key, SIPHASH_KEY_LEN, 0) != SIPHASH_KEY_LEN) {
+    // Not secret, but still different for every process.
+    uint64_t seed = get_curr_micros() ^ (uint64_t)(uintptr_t)&seed;
+    for (size_t i = 0; i < SIPHASH_KEY_LEN; i++) {
+      seed = seed * UINT64_C(6364136223846793005) + 1;
+      key[i] = (uint8_t)(seed >> 56);
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements SYN cookies.
+ */
+
+#include "syncookie.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "siphash.h"
+
+#define SYNCOOKIE_HASH_MASK 0xFFFFFFu
+
+static pthread_once_t secret_once = PTHREAD_ONCE_INIT;
+static uint8_t secret[SIPHASH_KEY_LEN];
+
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cookies_on = 0;
+static int config_loaded = 0;
+
+static void init_secret(void) { siphash_random_key(secret); }
+
+void cmu_set_syn_cookies(int enabled) {
+  pthread_mutex_lock(&config_lock);
+  cookies_on = enabled != 0;
+  config_loaded = 1;
+  pthread_mutex_unlock(&config_lock);
+}
+
+int syncookie_enabled(void) {
+  int on;
+
+  pthread_mutex_lock(&config_lock);
+  if (!config_loaded) {
+    const char* env = getenv("CMU_SYNCOOKIES");
+    if (env != NULL && env[0] != '\0') {
+      cookies_on = strcmp(env, "0") != 0;
+    }
+    config_loaded = 1;
+  }
+  on = cookies_on;
+  pthread_mutex_unlock(&config_lock);
+  return on;
+}
+
+/*
+ * Returns the 24 bit MAC of a connection attempt during time tick `t`.
+ */
+static uint32_t cookie_hash(const struct sockaddr_in* client,
+                            uint16_t local_port, uint32_t client_isn,
+                            uint8_t t) {
+  uint8_t msg[13];
+
+  pthread_once(&secret_once, init_secret);
+  memcpy(msg, &client->sin_addr.s_addr, 4);
+  memcpy(msg + 4, &client->sin_port, 2);
+  memcpy(msg + 6, &local_port, 2);
+  memcpy(msg + 8, &client_isn, 4);
+  msg[12] = t;
+  return (uint32_t)siphash24(secret, msg, sizeof(msg)) & SYNCOOKIE_HASH_MASK;
+}
+
+static uint8_t current_tick(void) {
+  return (uint8_t)(get_curr_micros() / (SYNCOOKIE_PERIOD_SEC * USEC_PER_SEC));
+}
+
+uint32_t syncookie_make(const struct sockaddr_in* client, uint16_t local_port,
+                        uint32_t client_isn) {
+  uint8_t t = current_tick();
+  return (uint32_t)t << 24 | cookie_hash(client, local_port, client_isn, t);
+}
+
+int syncookie_check(const struct sockaddr_in* client, uint16_t local_port,
+                    uint32_t client_isn, uint32_t cookie) {
+  uint8_t t = (uint8_t)(cookie >> 24);
+  uint8_t age = (uint8_t)(current_tick() - t);
+
+  if (age > 1) {
+    return 0;
+  }
+  return (cookie & SYNCOOKIE_HASH_MASK) ==
+         cookie_hash(client, local_port, client_isn, t);
+}
@@ -0,0 +1,223 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements the per-connection binary event trace.
+ *
+ * The ring has a single producer, the backend thread, and a single consumer,
+ * the writer thread. Each side only ever advances its own index, so neither
+ * needs a lock.
+ */
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clock.h"
+#include "log.h"
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+struct cmu_trace {
+  cmu_trace_event_t ring[TRACE_RING_SIZE];
+  _Atomic uint64_t head;  // next event to record, written by the producer
+  _Atomic uint64_t tail;  // next event to write out, written by the writer
+  uint64_t dropped;
+  FILE* file;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int closing;
+};
+
+static pthread_mutex_t prefix_lock = PTHREAD_MUTEX_INITIALIZER;
+static char* trace_prefix = NULL;
+static int prefix_loaded = 0;
+
+static const char* event_names[TRACE_EVENT_MAX] = {
+    [TRACE_SEND] = "send",       [TRACE_RETRANSMIT] = "retransmit",
+    [TRACE_ACK] = "ack",         [TRACE_DUP_ACK] = "dup_ack",
+    [TRACE_RECV] = "recv",       [TRACE_RTO] = "rto",
+    [TRACE_RTT] = "rtt",         [TRACE_CWND] = "cwnd",
+    [TRACE_WINDOW] = "window",
+};
+
+const char* trace_event_name(uint32_t type) {
+  if (type >= TRACE_EVENT_MAX || event_names[type] == NULL) {
+    return "unknown";
+  }
+  return event_names[type];
+}
+
+void cmu_set_trace_prefix(const char* prefix) {
+  pthread_mutex_lock(&prefix_lock);
+  free(trace_prefix);
+  trace_prefix = prefix != NULL ? strdup(prefix) : NULL;
+  prefix_loaded = 1;
+  pthread_mutex_unlock(&prefix_lock);
+}
+
+/*
+ * Writes out every event recorded so far. Only called by the writer thread,
+ * or once it has exited.
+ */
+static void drain(cmu_trace_t* trace) {
+  uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+
+  while (tail != head) {
+    uint64_t start = tail & TRACE_RING_MASK;
+    uint64_t n = head - tail;
+    if (n > TRACE_RING_SIZE - start) {
+      n = TRACE_RING_SIZE - start;
+    }
+    fwrite(&trace->ring[start], sizeof(cmu_trace_event_t), n, trace->file);
+    tail += n;
+    atomic_store_explicit(&trace->tail, tail, memory_order_release);
+  }
+}
+
+static void* writer_thread(void* in) {
+  cmu_trace_t* trace = in;
+  int closing = 0;
+
+  while (!closing) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    if (!trace->closing) {
+      pthread_cond_timedwait(&trace->wake, &trace->lock, &deadline);
+    }
+    closing = trace->closing;
+    pthread_mutex_unlock(&trace->lock);
+
+    drain(trace);
+  }
+  return NULL;
+}
+
+cmu_trace_t* trace_open(uint16_t local_port, uint16_t peer_port,
+                        uint32_t role) {
+  char path[4096];
+  cmu_trace_header_t header;
+  cmu_trace_t* trace;
+  pthread_condattr_t attr;
+
+  pthread_mutex_lock(&prefix_lock);
+  if (!prefix_loaded) {
+    const char* env = getenv("CMU_TRACE");
+    if (env != NULL && env[0] != '\0') {
+      trace_prefix = strdup(env);
+    }
+    prefix_loaded = 1;
+  }
+  if (trace_prefix == NULL) {
+    pthread_mutex_unlock(&prefix_lock);
+    return NULL;
+  }
+  snprintf(path, sizeof(path), "%s.%u.trace", trace_prefix, local_port);
+  pthread_mutex_unlock(&prefix_lock);
+
+  trace = malloc(sizeof(cmu_trace_t));
+  if (trace == NULL) {
+    return NULL;
+  }
+  trace->file = fopen(path, "wb");
+  if (trace->file == NULL) {
+    LOG_WARN("cannot open trace file %s", path);
+    free(trace);
+    return NULL;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.event_size = sizeof(cmu_trace_event_t);
+  header.local_port = local_port;
+  header.peer_port = peer_port;
+  header.role = role;
+  header.start_us = get_curr_micros();
+  fwrite(&header, sizeof(header), 1, trace->file);
+
+  atomic_init(&trace->head, 0);
+  atomic_init(&trace->tail, 0);
+  trace->dropped = 0;
+  trace->closing = 0;
+  pthread_mutex_init(&trace->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&trace->wake, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&trace->writer, NULL, writer_thread, trace) != 0) {
+    LOG_WARN("cannot start the trace writer for %s", path);
+    fclose(trace->file);
+    pthread_cond_destroy(&trace->wake);
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+    return NULL;
+  }
+  LOG_INFO("tracing connection to %s", path);
+  return trace;
+}
+
+void trace_close(cmu_trace_t* trace) {
+  if (trace == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&trace->lock);
+  trace->closing = 1;
+  pthread_cond_signal(&trace->wake);
+  pthread_mutex_unlock(&trace->lock);
+  pthread_join(trace->writer, NULL);
+
+  drain(trace);
+  fclose(trace->file);
+  if (trace->dropped > 0) {
+    LOG_WARN("trace ring overflowed, %lu events dropped",
+             (unsigned long)trace->dropped);
+  }
+  pthread_cond_destroy(&trace->wake);
+  pthread_mutex_destroy(&trace->lock);
+  free(trace);
+}
+
+void trace_record(cmu_trace_t* trace, cmu_trace_event_type_t type, uint32_t seq,
+                  uint32_t len, uint32_t cwnd, uint32_t in_flight,
+                  uint32_t value) {
+  uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_acquire);
+  cmu_trace_event_t* e;
+
+  if (head - tail >= TRACE_RING_SIZE) {
+    trace->dropped++;
+    return;
+  }
+  e = &trace->ring[head & TRACE_RING_MASK];
+  e->time_us = get_curr_micros();
+  e->type = type;
+  e->seq = seq;
+  e->len = len;
+  e->cwnd = cwnd;
+  e->in_flight = in_flight;
+  e->value = value;
+  atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
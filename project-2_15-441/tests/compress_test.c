@@ -0,0 +1,228 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements a test of the payload compression. Compressible,
+ * incompressible and single-byte buffers of lengths around the block and
+ * frame limits must come back as they were, fed to the decoder in pieces as
+ * packets would bring them. Frames that are truncated or refer back past the
+ * start of their block must be rejected.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+
+#define CHECK(cond, ...)                              \
+  do {                                                \
+    checks++;                                         \
+    if (!(cond)) {                                    \
+      failures++;                                     \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);                   \
+      fprintf(stderr, "\n");                          \
+    }                                                 \
+  } while (0)
+
+typedef enum { TEXT, RANDOM, RUN } kind_t;
+
+static const char *kind_names[] = {"text", "random", "run"};
+
+static const uint32_t sizes[] = {1,
+                                 COMPRESS_MIN_LEN - 1,
+                                 COMPRESS_MIN_LEN,
+                                 1400,
+                                 COMPRESS_BLOCK - 1,
+                                 COMPRESS_BLOCK,
+                                 COMPRESS_BLOCK + 1,
+                                 3 * COMPRESS_BLOCK + 17};
+
+// Bytes handed to the decoder at a time: one, a packet's worth, everything.
+static const uint32_t steps[] = {1, 1359, UINT32_MAX};
+
+static int checks = 0;
+static int failures = 0;
+
+static void fill(uint8_t *buf, uint32_t len, kind_t kind) {
+  static const char words[] =
+      "the quick brown fox jumps over the lazy dog while the cat sleeps ";
+  uint64_t x = 88172645463325252ULL;
+
+  for (uint32_t i = 0; i < len; i++) {
+    switch (kind) {
+      case TEXT:
+        buf[i] = (uint8_t)words[(i * 7 / 5) % (sizeof(words) - 1)];
+        break;
+      case RANDOM:
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)x;
+        break;
+      case RUN:
+        buf[i] = 'a';
+        break;
+    }
+  }
+}
+
+/*
+ * Feeds frames to a fresh decompressor `step` bytes at a time and decodes
+ * every frame as it completes.
+ *
+ * @return The number of raw bytes decoded, or -1 if a frame was corrupt or
+ *         the last one incomplete.
+ */
+static int64_t decode(const uint8_t *frames, uint32_t len, uint32_t step,
+                      uint8_t *out) {
+  decompressor_t d = {NULL, 0};
+  int64_t out_len = 0;
+  uint32_t off = 0;
+
+  while (off < len) {
+    int taken = decompress_take(&d, frames + off, MIN(step, len - off));
+    if (taken < 0) {
+      out_len = -1;
+      break;
+    }
+    off += taken;
+    if (decompress_ready(&d) != 0) {
+      int got = decompress_finish(&d, out + out_len);
+      if (got < 0) {
+        out_len = -1;
+        break;
+      }
+      out_len += got;
+    }
+  }
+  if (d.len != 0) {
+    out_len = -1;
+  }
+  decompress_free(&d);
+  return out_len;
+}
+
+static void test_round_trip(kind_t kind, uint32_t len) {
+  uint8_t *src = malloc(len);
+  uint8_t *frames = malloc(compress_bound(len));
+  uint8_t *out = malloc(len);
+  compressor_t c = {0, 0, 0};
+  uint32_t frames_len;
+  uint32_t blocks = (len + COMPRESS_BLOCK - 1) / COMPRESS_BLOCK;
+
+  fill(src, len, kind);
+  frames_len = compress_frames(&c, src, len, frames);
+  CHECK(frames_len <= compress_bound(len), "%s %u: %u bytes over the bound",
+        kind_names[kind], len, frames_len);
+  if (kind == RANDOM) {
+    CHECK(c.stored_blocks == blocks, "%s %u: %lu of %u blocks stored",
+          kind_names[kind], len, (unsigned long)c.stored_blocks, blocks);
+  } else if (len >= 1024) {
+    // Shorter ones may not repeat enough to save COMPRESS_MIN_SAVING.
+    CHECK(frames_len < len, "%s %u: grew to %u bytes", kind_names[kind], len,
+          frames_len);
+  }
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    int64_t got;
+    memset(out, 0, len);
+    got = decode(frames, frames_len, steps[i], out);
+    CHECK(got == len && memcmp(src, out, len) == 0,
+          "%s %u fed %u at a time: decoded %ld bytes%s", kind_names[kind],
+          len, steps[i], (long)got, got == len ? " that differ" : "");
+  }
+  free(src);
+  free(frames);
+  free(out);
+}
+
+/*
+ * Decodes one hand-made frame.
+ *
+ * @return What `decompress_finish` returned, or 0 if `decompress_ready` did
+ *         not see the frame complete.
+ */
+static int decode_frame(uint32_t raw_len, const uint8_t *body,
+                        uint32_t enc_len, uint8_t *out) {
+  uint8_t frame[COMPRESS_FRAME_HDR_LEN + COMPRESS_BLOCK];
+  decompressor_t d = {NULL, 0};
+  int ret = 0;
+
+  frame[0] = (uint8_t)(raw_len >> 8);
+  frame[1] = (uint8_t)raw_len;
+  frame[2] = (uint8_t)(enc_len >> 8);
+  frame[3] = (uint8_t)enc_len;
+  memcpy(frame + COMPRESS_FRAME_HDR_LEN, body, enc_len);
+  decompress_take(&d, frame, COMPRESS_FRAME_HDR_LEN + enc_len);
+  if (decompress_ready(&d) != 0) {
+    ret = decompress_finish(&d, out);
+  }
+  decompress_free(&d);
+  return ret;
+}
+
+static void test_corrupt(void) {
+  // Four literals, then a match of four at offset four: "abcdabcd".
+  const uint8_t good[] = {0x40, 'a', 'b', 'c', 'd', 0x04, 0x00};
+  // The same match, one byte longer than the block.
+  const uint8_t too_long[] = {0x41, 'a', 'b', 'c', 'd', 0x04, 0x00};
+  // A match before the first byte of the block.
+  const uint8_t before_start[] = {0x00, 0x01, 0x00};
+  // A match at offset 0.
+  const uint8_t zero_offset[] = {0x10, 'a', 0x00, 0x00};
+  // A literal length continued past the end of the frame.
+  const uint8_t cut_length[] = {0xF0};
+  uint8_t src[4096];
+  uint8_t frames[4096 + COMPRESS_FRAME_HDR_LEN];
+  uint8_t out[COMPRESS_BLOCK];
+  compressor_t c = {0, 0, 0};
+  uint32_t enc_len;
+
+  CHECK(decode_frame(8, good, sizeof(good), out) == 8 &&
+            memcmp(out, "abcdabcd", 8) == 0,
+        "a valid hand-made frame was rejected");
+  CHECK(decode_frame(8, too_long, sizeof(too_long), out) == -1,
+        "a match past the end of the block was accepted");
+  CHECK(decode_frame(8, before_start, sizeof(before_start), out) == -1,
+        "a match before the start of the block was accepted");
+  CHECK(decode_frame(9, zero_offset, sizeof(zero_offset), out) == -1,
+        "a match at offset 0 was accepted");
+  CHECK(decode_frame(20, cut_length, sizeof(cut_length), out) == -1,
+        "a cut off literal length was accepted");
+  CHECK(decode_frame(0, good, sizeof(good), out) == -1,
+        "a frame of no raw bytes was accepted");
+  CHECK(decode_frame(7, good, sizeof(good), out) == -1,
+        "a frame longer encoded than raw was accepted");
+
+  // Real frames with their ends cut off, the header adjusted to match.
+  fill(src, sizeof(src), TEXT);
+  compress_frames(&c, src, sizeof(src), frames);
+  enc_len = (uint32_t)frames[2] << 8 | frames[3];
+  CHECK(enc_len > 0, "text was not compressed");
+  for (uint32_t cut = 1; cut <= 16 && cut < enc_len; cut++) {
+    CHECK(decode_frame(sizeof(src), frames + COMPRESS_FRAME_HDR_LEN,
+                       enc_len - cut, out) == -1,
+          "a frame cut short by %u bytes was accepted", cut);
+  }
+}
+
+int main(void) {
+  for (int kind = TEXT; kind <= RUN; kind++) {
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      test_round_trip((kind_t)kind, sizes[i]);
+    }
+  }
+  test_corrupt();
+  printf("compress_test: %d checks, %d failed\n", checks, failures);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
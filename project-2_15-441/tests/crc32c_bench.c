@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements a benchmark of the CRC32C implementations, over buffers
+ * the size of a small packet, a full packet, a jumbo frame and a large write.
+ * It checks that they agree before timing them.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "crc32c.h"
+
+// Bytes hashed per size and implementation.
+#define BENCH_BYTES (256 << 20)
+
+static const size_t sizes[] = {64, 1400, 8972, 65536};
+
+/*
+ * Hashes `buf` over and over and returns the throughput in GB/s.
+ */
+static double run(uint32_t (*fn)(uint32_t, const void *, size_t),
+                  const uint8_t *buf, size_t len, uint32_t *sink) {
+  size_t rounds = BENCH_BYTES / len;
+  uint64_t start = get_curr_micros();
+  uint32_t crc = 0;
+
+  for (size_t i = 0; i < rounds; i++) {
+    crc ^= fn(0, buf, len);
+  }
+  *sink ^= crc;
+  return (double)rounds * len / 1e3 / (get_curr_micros() - start);
+}
+
+int main(void) {
+  const size_t max_len = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+  uint8_t *buf = malloc(max_len);
+  uint32_t sink = 0;
+
+  for (size_t i = 0; i < max_len; i++) {
+    buf[i] = (uint8_t)(i * 131 + 7);
+  }
+  if (crc32c(0, "123456789", 9) != 0xE3069283u ||
+      crc32c_sw(0, "123456789", 9) != 0xE3069283u) {
+    fprintf(stderr, "wrong check value\n");
+    return EXIT_FAILURE;
+  }
+  for (size_t len = 0; len <= max_len; len += len < 4096 ? 1 : 4093) {
+    if (crc32c(0, buf, len) != crc32c_sw(0, buf, len)) {
+      fprintf(stderr, "implementations differ at length %zu\n", len);
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("implementation: %s\n", crc32c_impl());
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    double hw = run(crc32c, buf, sizes[i], &sink);
+    double sw = run(crc32c_sw, buf, sizes[i], &sink);
+    printf("%6zu bytes: %6.2f GB/s, table %5.2f GB/s\n", sizes[i], hw, sw);
+  }
+  free(buf);
+  return sink == 0xFFFFFFFFu;  // keep the work from being optimized away
+}
@@ -0,0 +1,215 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements a test of the XOR forward error correction. A group
+ * with any one of its packets lost must give that packet back with its
+ * sequence number, stream and bytes, whatever its length next to the others.
+ * A group with two packets lost must give nothing back.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fec.h"
+
+#define CHECK(cond, ...)                              \
+  do {                                                \
+    checks++;                                         \
+    if (!(cond)) {                                    \
+      failures++;                                     \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);                   \
+      fprintf(stderr, "\n");                          \
+    }                                                 \
+  } while (0)
+
+#define GROUP 8
+#define MAX_PAYLOAD 1400
+
+typedef struct {
+  uint32_t seq;
+  uint16_t stream;
+  uint16_t len;
+  uint8_t payload[MAX_PAYLOAD];
+} packet_t;
+
+// The longest and shortest packets sit first, last and in between, so that
+// the parity's zero padding is tried in every position.
+static const uint16_t lengths[GROUP] = {1359, 700, 1, 1359, 42, 1024, 3, 999};
+
+static int checks = 0;
+static int failures = 0;
+
+/*
+ * Makes a group of packets that follow each other from `seq` on, each on one
+ * of a few streams, and encodes them.
+ *
+ * @return The parity, valid until the encoder is used again.
+ */
+static const uint8_t *make_group(fec_encoder_t *e, uint32_t seq,
+                                 packet_t *pkts, int n, fec_repair_t *repair,
+                                 uint16_t *parity_len) {
+  for (int i = 0; i < n; i++) {
+    uint32_t group;
+    pkts[i].seq = seq;
+    pkts[i].stream = (uint16_t)(i % 3 == 0 ? 0 : i);
+    pkts[i].len = lengths[i % GROUP];
+    for (uint16_t b = 0; b < pkts[i].len; b++) {
+      pkts[i].payload[b] = (uint8_t)(seq * 31 + b * 7 + i);
+    }
+    CHECK(fec_encode(e, seq, pkts[i].stream, pkts[i].payload, pkts[i].len,
+                     &group) == 1 &&
+              group == pkts[0].seq,
+          "packet %d did not join the group of seq %u", i, pkts[0].seq);
+    seq += pkts[i].len;
+  }
+  CHECK(fec_repair_due(e) == (n == GROUP), "repair due after %d packets", n);
+  return fec_take_repair(e, repair, parity_len);
+}
+
+/*
+ * Hands a decoder the packets of a group, but for those in `lost`.
+ */
+static void deliver(fec_decoder_t *d, const packet_t *pkts, int n,
+                    uint32_t lost) {
+  for (int i = 0; i < n; i++) {
+    if (!(lost & (1u << i))) {
+      fec_decode(d, pkts[0].seq, pkts[i].seq, pkts[i].stream,
+                 pkts[i].payload, pkts[i].len);
+    }
+  }
+}
+
+/*
+ * Checks that a recovered packet is the one that was lost.
+ */
+static void check_rebuilt(const packet_t *want, uint16_t len, uint32_t seq,
+                          uint16_t stream, const uint8_t *payload) {
+  CHECK(len == want->len, "rebuilt %u bytes instead of %u", len, want->len);
+  CHECK(seq == want->seq, "rebuilt seq %u instead of %u", seq, want->seq);
+  CHECK(stream == want->stream, "rebuilt stream %u instead of %u", stream,
+        want->stream);
+  CHECK(len == want->len && memcmp(payload, want->payload, len) == 0,
+        "rebuilt payload of seq %u differs", want->seq);
+}
+
+static void test_one_lost(void) {
+  fec_encoder_t e;
+  packet_t pkts[GROUP];
+  fec_repair_t repair;
+  uint16_t parity_len;
+  const uint8_t *parity;
+
+  fec_encoder_init(&e, GROUP);
+  parity = make_group(&e, 1000, pkts, GROUP, &repair, &parity_len);
+  CHECK(parity != NULL && repair.count == GROUP && repair.group == 1000,
+        "no repair for the group");
+  CHECK(parity_len == 1359, "parity of %u bytes", parity_len);
+  for (int lost = 0; lost < GROUP; lost++) {
+    fec_decoder_t d;
+    uint8_t payload[MAX_PAYLOAD];
+    uint32_t seq = 0;
+    uint16_t stream = 0;
+    uint16_t len;
+
+    memset(&d, 0, sizeof(d));
+    deliver(&d, pkts, GROUP, 1u << lost);
+    len = fec_recover(&d, &repair, parity, parity_len, &seq, &stream, payload);
+    check_rebuilt(&pkts[lost], len, seq, stream, payload);
+    // The group is forgotten once its repair is used.
+    CHECK(fec_recover(&d, &repair, parity, parity_len, &seq, &stream,
+                      payload) == 0,
+          "group recovered twice");
+    fec_decoder_free(&d);
+  }
+  fec_encoder_free(&e);
+}
+
+static void test_two_lost(void) {
+  fec_encoder_t e;
+  packet_t pkts[GROUP];
+  fec_repair_t repair;
+  uint16_t parity_len;
+  const uint8_t *parity;
+
+  fec_encoder_init(&e, GROUP);
+  parity = make_group(&e, 5000, pkts, GROUP, &repair, &parity_len);
+  for (int a = 0; a < GROUP; a++) {
+    for (int b = a + 1; b < GROUP; b++) {
+      fec_decoder_t d;
+      uint8_t payload[MAX_PAYLOAD];
+      uint32_t seq;
+      uint16_t stream;
+
+      memset(&d, 0, sizeof(d));
+      deliver(&d, pkts, GROUP, 1u << a | 1u << b);
+      CHECK(fec_recover(&d, &repair, parity, parity_len, &seq, &stream,
+                        payload) == 0,
+            "rebuilt a packet with %d and %d lost", a, b);
+      fec_decoder_free(&d);
+    }
+  }
+  fec_encoder_free(&e);
+}
+
+/*
+ * A group cut short by a pause in sending, which is all of it lost, and two
+ * groups whose packets arrive interleaved.
+ */
+static void test_partial_and_interleaved(void) {
+  fec_encoder_t e;
+  fec_decoder_t d;
+  packet_t one[1], first[GROUP], second[GROUP];
+  fec_repair_t r1, r2;
+  uint16_t len1, len2, len;
+  const uint8_t *parity;
+  uint8_t parity1[MAX_PAYLOAD], parity2[MAX_PAYLOAD], payload[MAX_PAYLOAD];
+  uint32_t seq;
+  uint16_t stream;
+
+  fec_encoder_init(&e, GROUP);
+  memset(&d, 0, sizeof(d));
+  parity = make_group(&e, 42, one, 1, &r1, &len1);
+  memcpy(parity1, parity, len1);
+  len = fec_recover(&d, &r1, parity1, len1, &seq, &stream, payload);
+  check_rebuilt(&one[0], len, seq, stream, payload);
+
+  // The encoder reuses its parity buffer for the next group.
+  parity = make_group(&e, 7000, first, GROUP, &r1, &len1);
+  memcpy(parity1, parity, len1);
+  parity = make_group(&e, 20000, second, GROUP, &r2, &len2);
+  memcpy(parity2, parity, len2);
+  for (int i = 0; i < GROUP; i++) {
+    if (i != 2) {
+      fec_decode(&d, first[0].seq, first[i].seq, first[i].stream,
+                 first[i].payload, first[i].len);
+    }
+    if (i != 5) {
+      fec_decode(&d, second[0].seq, second[i].seq, second[i].stream,
+                 second[i].payload, second[i].len);
+    }
+  }
+  len = fec_recover(&d, &r2, parity2, len2, &seq, &stream, payload);
+  check_rebuilt(&second[5], len, seq, stream, payload);
+  len = fec_recover(&d, &r1, parity1, len1, &seq, &stream, payload);
+  check_rebuilt(&first[2], len, seq, stream, payload);
+  fec_decoder_free(&d);
+  fec_encoder_free(&e);
+}
+
+int main(void) {
+  test_one_lost();
+  test_two_lost();
+  test_partial_and_interleaved();
+  printf("fec_test: %d checks, %d failed\n", checks, failures);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,236 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements a throughput and latency benchmark for CMU-TCP over the
+ * loopback interface. It needs no containers or privileges.
+ *
+ * The initiator first streams a bulk transfer to the listener, which answers
+ * with a single byte once it has read everything. It then runs a number of
+ * request/response round trips. Both sides can run in one process (the
+ * default) or in two, with `-m server` and `-m client`.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "clock.h"
+#include "cmu_tcp.h"
+
+typedef struct {
+  const char *mode;
+  const char *addr;
+  int port;
+  int bulk_bytes;
+  int requests;
+  int request_bytes;
+  int response_bytes;
+} bench_config_t;
+
+/*
+ * Reads exactly `length` bytes from the socket. A run whose peer closes or
+ * fails first has no result, so it exits with an error.
+ */
+static void read_full(cmu_socket_t *sock, uint8_t *buf, int length) {
+  int n = 0;
+  while (n < length) {
+    int got = cmu_read(sock, buf + n, length - n, NO_FLAG);
+    if (got <= 0) {
+      fprintf(stderr, "read failed after %d of %d bytes: %s\n", n, length,
+              got == 0 ? "connection closed" : "error");
+      exit(EXIT_FAILURE);
+    }
+    n += got;
+  }
+}
+
+/*
+ * Returns the CPU time used by the process so far, in microseconds.
+ */
+static uint64_t cpu_micros(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * USEC_PER_SEC +
+         ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void run_listener(cmu_socket_t *sock, const bench_config_t *cfg) {
+  uint8_t *buf = malloc(cfg->bulk_bytes > cfg->request_bytes
+                            ? cfg->bulk_bytes
+                            : cfg->request_bytes);
+  uint8_t *response = calloc(cfg->response_bytes, 1);
+
+  read_full(sock, buf, cfg->bulk_bytes);
+  cmu_write(sock, "k", 1);
+
+  for (int i = 0; i < cfg->requests; i++) {
+    read_full(sock, buf, cfg->request_bytes);
+    cmu_write(sock, response, cfg->response_bytes);
+  }
+
+  free(buf);
+  free(response);
+}
+
+static void run_initiator(cmu_socket_t *sock, const bench_config_t *cfg) {
+  uint8_t *bulk = malloc(cfg->bulk_bytes);
+  uint8_t *request = calloc(cfg->request_bytes, 1);
+  uint8_t *response = malloc(cfg->response_bytes + 1);
+  uint64_t *latencies = malloc(sizeof(uint64_t) * cfg->requests);
+  cmu_stats_t before, after;
+  uint64_t start, elapsed, cpu;
+
+  for (int i = 0; i < cfg->bulk_bytes; i++) {
+    bulk[i] = (uint8_t)i;
+  }
+
+  cmu_get_stats(sock, &before);
+  cpu = cpu_micros();
+  start = get_curr_micros();
+  cmu_write(sock, bulk, cfg->bulk_bytes);
+  read_full(sock, response, 1);
+  elapsed = get_curr_micros() - start;
+  cpu = cpu_micros() - cpu;
+  cmu_get_stats(sock, &after);
+
+  printf("throughput: %d bytes in %.3f s, %.2f MB/s, %.0f pkts/s, "
+         "%.2f ns CPU/byte, %lu retransmits\n",
+         cfg->bulk_bytes, elapsed / 1e6,
+         cfg->bulk_bytes / (double)elapsed,
+         (after.segments_sent - before.segments_sent) * 1e6 / elapsed,
+         cpu * 1e3 / cfg->bulk_bytes,
+         (unsigned long)(after.segments_retransmitted -
+                         before.segments_retransmitted));
+  if (after.compress_raw_bytes > before.compress_raw_bytes) {
+    printf("compression: %.2fx, %lu blocks stored\n",
+           (double)(after.compress_raw_bytes - before.compress_raw_bytes) /
+               (after.compress_wire_bytes - before.compress_wire_bytes),
+           (unsigned long)(after.compress_stored_blocks -
+                           before.compress_stored_blocks));
+  }
+  if (after.fec_repairs_sent > before.fec_repairs_sent) {
+    printf("fec: %lu repair packets for %lu data packets\n",
+           (unsigned long)(after.fec_repairs_sent - before.fec_repairs_sent),
+           (unsigned long)(after.segments_sent - before.segments_sent));
+  }
+
+  for (int i = 0; i < cfg->requests; i++) {
+    start = get_curr_micros();
+    cmu_write(sock, request, cfg->request_bytes);
+    read_full(sock, response, cfg->response_bytes);
+    latencies[i] = get_curr_micros() - start;
+  }
+  if (cfg->requests > 0) {
+    qsort(latencies, cfg->requests, sizeof(uint64_t), compare_u64);
+    printf("latency: %d round trips of %d/%d bytes, p50 %lu us, p99 %lu us\n",
+           cfg->requests, cfg->request_bytes, cfg->response_bytes,
+           (unsigned long)latencies[cfg->requests / 2],
+           (unsigned long)latencies[cfg->requests * 99 / 100]);
+  }
+
+  free(bulk);
+  free(request);
+  free(response);
+  free(latencies);
+}
+
+static void *listener_thread(void *in) {
+  const bench_config_t *cfg = in;
+  cmu_socket_t sock;
+
+  if (cmu_socket(&sock, TCP_LISTENER, cfg->port, cfg->addr) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  run_listener(&sock, cfg);
+  cmu_close(&sock);
+  return NULL;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-m both|server|client] [-a addr] [-p port]\n"
+          "          [-s bulk_bytes] [-n requests] [-q request_bytes]\n"
+          "          [-r response_bytes]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  bench_config_t cfg = {"both", "127.0.0.1", 15441, 4 << 20, 1000, 64, 64};
+  cmu_socket_t sock;
+  pthread_t listener;
+  uint64_t start;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:a:p:s:n:q:r:")) != -1) {
+    switch (opt) {
+      case 'm':
+        cfg.mode = optarg;
+        break;
+      case 'a':
+        cfg.addr = optarg;
+        break;
+      case 'p':
+        cfg.port = atoi(optarg);
+        break;
+      case 's':
+        cfg.bulk_bytes = atoi(optarg);
+        break;
+      case 'n':
+        cfg.requests = atoi(optarg);
+        break;
+      case 'q':
+        cfg.request_bytes = atoi(optarg);
+        break;
+      case 'r':
+        cfg.response_bytes = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (cfg.bulk_bytes < 1 || cfg.requests < 0 || cfg.request_bytes < 1 ||
+      cfg.response_bytes < 1) {
+    usage(argv[0]);
+  }
+
+  if (strcmp(cfg.mode, "server") == 0) {
+    listener_thread(&cfg);
+    return EXIT_SUCCESS;
+  }
+  if (strcmp(cfg.mode, "both") == 0) {
+    pthread_create(&listener, NULL, listener_thread, &cfg);
+  } else if (strcmp(cfg.mode, "client") != 0) {
+    usage(argv[0]);
+  }
+
+  if (cmu_socket(&sock, TCP_INITIATOR, cfg.port, cfg.addr) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  run_initiator(&sock, &cfg);
+  start = get_curr_micros();
+  cmu_close(&sock);
+  printf("teardown: %lu us\n", (unsigned long)(get_curr_micros() - start));
+
+  if (strcmp(cfg.mode, "both") == 0) {
+    pthread_join(listener, NULL);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,422 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements microbenchmarks of the data path primitives: building
+ * and parsing packets, the receive window, and the buffers behind `cmu_read`
+ * and `cmu_write`. They run on a socket that is never connected, with no
+ * backend thread, so nothing but the primitive itself is timed.
+ *
+ * Every primitive runs a fixed number of operations, once to warm up and then
+ * several times, and the median run is reported: nanoseconds and TSC cycles
+ * per operation, and the heap allocations per operation, counted by wrapping
+ * `malloc` and friends. `-f csv` or `-f json` prints the same results for
+ * comparing a change against the tree before it.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "backend.h"
+#include "cmu_packet.h"
+#include "cmu_tcp.h"
+
+// Runs per primitive after the warm-up; the median is reported.
+#define DEFAULT_RUNS 7
+
+// The payload of a full packet at the default MTU.
+#define PAYLOAD_LEN 1375
+
+#define WINDOW_SLOTS (WINDOW_INITIAL_WINDOW_SIZE / MSS)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t allocs;
+
+void *malloc(size_t size) {
+  allocs++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  allocs++;
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  allocs++;
+  return __libc_realloc(ptr, size);
+}
+
+typedef struct {
+  const char *name;
+  const char *op;  // what one operation is
+  uint64_t iters;  // operations per run
+  // Gets ready for a run, untimed. May be NULL.
+  void (*prepare)(cmu_socket_t *sock, uint64_t iters);
+  // Runs `iters` operations.
+  void (*run)(cmu_socket_t *sock, uint64_t iters);
+} bench_t;
+
+typedef struct {
+  double ns;
+  double cycles;
+  double allocs;
+} result_t;
+
+static uint8_t payload[PAYLOAD_LEN];
+static uint8_t read_buf[PAYLOAD_LEN];
+static uintptr_t sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#if defined(__x86_64__)
+  unsigned int aux;
+  return __rdtscp(&aux);
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Keeps the compiler from assuming anything about `p`, so work on it is not
+ * hoisted out of the loop or dropped.
+ */
+#define OPAQUE(p) __asm__ volatile("" : "+r"(p) : : "memory")
+
+/*
+ * Sets up a socket the primitives can run on, as `cmu_socket` and the
+ * backend would, but without a UDP socket, a peer or a backend thread.
+ */
+static void bench_socket(cmu_socket_t *sock) {
+  memset(sock, 0, sizeof(*sock));
+  pthread_mutex_init(&sock->recv_lock, NULL);
+  pthread_mutex_init(&sock->send_lock, NULL);
+  pthread_mutex_init(&sock->death_lock, NULL);
+  pthread_mutex_init(&sock->window.ack_lock, NULL);
+  pthread_cond_init(&sock->wait_cond, NULL);
+  sock->socket = -1;
+  sock->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  sock->type = TCP_INITIATOR;
+  sock->state = ESTABLISHED;
+  sock->window.cwnd = WINDOW_INITIAL_WINDOW_SIZE;
+  sock->window.ssthresh = WINDOW_INITIAL_SSTHRESH;
+  sock->nodelay = 1;
+  pmtu_init(&sock->pmtu, 0);
+  pthread_mutex_lock(&sock->recv_lock);
+  alloc_windows(sock);
+  pthread_mutex_unlock(&sock->recv_lock);
+}
+
+static void free_socket(cmu_socket_t *sock) {
+  for (int i = 0; i < CMU_MAX_STREAMS; i++) {
+    free(sock->streams[i].sending_buf);
+    while (sock->streams[i].received_head != NULL) {
+      cmu_segment_t *seg = sock->streams[i].received_head;
+      sock->streams[i].received_head = seg->next;
+      free(seg);
+    }
+  }
+  free_windows(sock);
+  while (sock->segment_pool != NULL) {
+    cmu_segment_t *seg = sock->segment_pool;
+    sock->segment_pool = seg->next;
+    free(seg);
+  }
+  close(sock->wake_fd);
+}
+
+/*
+ * Puts the segments the receive queue holds back into the pool, as
+ * `cmu_read` does once it has copied them out.
+ */
+static void recycle_queue(cmu_socket_t *sock) {
+  cmu_stream_t *stream = &sock->streams[0];
+  while (stream->received_head != NULL) {
+    cmu_segment_t *seg = stream->received_head;
+    stream->received_head = seg->next;
+    segment_put(sock, seg);
+  }
+  stream->received_tail = NULL;
+  stream->received_len = 0;
+  sock->received_len = 0;
+}
+
+static void run_create_packet(cmu_socket_t *sock, uint64_t iters) {
+  (void)sock;
+  for (uint64_t i = 0; i < iters; i++) {
+    uint8_t *pkt = create_packet(
+        15441, 15441, (uint32_t)i, 0, sizeof(cmu_tcp_header_t),
+        sizeof(cmu_tcp_header_t) + PAYLOAD_LEN, 0, 1, 0, NULL, payload,
+        PAYLOAD_LEN);
+    OPAQUE(pkt);
+    free(pkt);
+  }
+}
+
+static void run_get_payload(cmu_socket_t *sock, uint64_t iters) {
+  uint8_t pkt[sizeof(cmu_tcp_header_t) + PAYLOAD_LEN];
+  uint8_t *p = pkt;
+
+  (void)sock;
+  memset(pkt, 0, sizeof(pkt));
+  set_hlen((cmu_tcp_header_t *)pkt, sizeof(cmu_tcp_header_t));
+  for (uint64_t i = 0; i < iters; i++) {
+    OPAQUE(p);
+    sink += (uintptr_t)get_payload(p);
+  }
+}
+
+/*
+ * Fills every slot of the receive window, in no particular order, with the
+ * data that comes right after `next_seq_expected`: the longest walk.
+ */
+static void prepare_next_expected(cmu_socket_t *sock, uint64_t iters) {
+  (void)iters;
+  sock->window.next_seq_expected = 1;
+  for (uint32_t i = 0; i < WINDOW_SLOTS; i++) {
+    receiving_window *slot = &sock->window.received_windows[i];
+    slot->seq = 1 + (i * 7 % WINDOW_SLOTS) * PAYLOAD_LEN;
+    slot->payload_len = PAYLOAD_LEN;
+  }
+}
+
+static void run_next_expected(cmu_socket_t *sock, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    cmu_socket_t *s = sock;
+    OPAQUE(s);
+    sink += get_next_expected_seq(s);
+  }
+  for (uint32_t i = 0; i < WINDOW_SLOTS; i++) {
+    sock->window.received_windows[i].payload_len = 0;
+  }
+}
+
+static void prepare_window(cmu_socket_t *sock, uint64_t iters) {
+  (void)iters;
+  sock->window.next_seq_expected = 1;
+}
+
+/*
+ * Segments arriving in order: each is copied into a slot and delivered
+ * straight away.
+ */
+static void run_window_in_order(cmu_socket_t *sock, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    store_segment(sock, sock->window.next_seq_expected, payload, PAYLOAD_LEN,
+                  0);
+    sock->window.next_seq_expected = deliver_window(sock);
+    recycle_queue(sock);
+  }
+}
+
+/*
+ * Windows arriving last segment first: each segment is copied into a slot,
+ * and the whole window is delivered when the first one arrives.
+ */
+static void run_window_reversed(cmu_socket_t *sock, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    uint32_t k = WINDOW_SLOTS - 1 - i % WINDOW_SLOTS;
+    store_segment(sock, sock->window.next_seq_expected + k * PAYLOAD_LEN,
+                  payload, PAYLOAD_LEN, 0);
+    sock->window.next_seq_expected = deliver_window(sock);
+    if (k == 0) {
+      recycle_queue(sock);
+    }
+  }
+}
+
+/*
+ * Writes of one packet each, taken by the backend a window at a time.
+ */
+static void run_write(cmu_socket_t *sock, uint64_t iters) {
+  uint8_t *data;
+  send_chunk_t *chunks;
+  int nchunks;
+
+  for (uint64_t i = 0; i < iters; i++) {
+    cmu_write(sock, payload, PAYLOAD_LEN);
+    if ((i + 1) % WINDOW_SLOTS == 0) {
+      take_send_batch(sock, 1, &data, &chunks, &nchunks);
+      free(data);
+      free(chunks);
+    }
+  }
+}
+
+/*
+ * Queues a segment per read to come, as the receive window delivers them.
+ */
+static void prepare_read(cmu_socket_t *sock, uint64_t iters) {
+  sock->window.next_seq_expected = 1;
+  for (uint64_t i = 0; i < iters; i++) {
+    store_segment(sock, sock->window.next_seq_expected, payload, PAYLOAD_LEN,
+                  0);
+    sock->window.next_seq_expected = deliver_window(sock);
+  }
+}
+
+static void run_read(cmu_socket_t *sock, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    cmu_read(sock, read_buf, PAYLOAD_LEN, NO_WAIT);
+  }
+}
+
+static const bench_t benches[] = {
+    {"create_packet", "packet built and freed", 1 << 20, NULL,
+     run_create_packet},
+    {"get_payload", "call", 1 << 24, NULL, run_get_payload},
+    {"get_next_expected_seq", "walk of a full window", 1 << 18,
+     prepare_next_expected, run_next_expected},
+    {"recv_window_in_order", "segment stored and delivered", 1 << 20,
+     prepare_window, run_window_in_order},
+    {"recv_window_reversed", "segment stored, delivered a window at a time",
+     1 << 20, prepare_window, run_window_reversed},
+    {"cmu_write", "write taken by the backend", 1 << 18, NULL, run_write},
+    {"cmu_read", "read of a queued segment", 1 << 15, prepare_read, run_read},
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static int by_ns(const void *a, const void *b) {
+  double x = ((const result_t *)a)->ns, y = ((const result_t *)b)->ns;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Runs one primitive on a fresh socket and returns its median run.
+ */
+static result_t measure(const bench_t *b, int runs) {
+  result_t *r = calloc(runs, sizeof(result_t));
+  result_t median;
+  cmu_socket_t sock;
+
+  bench_socket(&sock);
+  // Warm up the caches, the branch predictors and the segment pool.
+  if (b->prepare != NULL) {
+    b->prepare(&sock, b->iters);
+  }
+  b->run(&sock, b->iters);
+  for (int i = 0; i < runs; i++) {
+    uint64_t t0, c0, a0;
+    if (b->prepare != NULL) {
+      b->prepare(&sock, b->iters);
+    }
+    a0 = allocs;
+    c0 = cycles();
+    t0 = now_ns();
+    b->run(&sock, b->iters);
+    r[i].ns = (double)(now_ns() - t0) / b->iters;
+    r[i].cycles = (double)(cycles() - c0) / b->iters;
+    r[i].allocs = (double)(allocs - a0) / b->iters;
+  }
+  free_socket(&sock);
+  qsort(r, runs, sizeof(result_t), by_ns);
+  median = r[runs / 2];
+  free(r);
+  return median;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-f text|csv|json] [-r runs] [-o output]\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  const char *format = "text";
+  const char *output = NULL;
+  FILE *out = stdout;
+  int runs = DEFAULT_RUNS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:r:o:")) != -1) {
+    switch (opt) {
+      case 'f':
+        format = optarg;
+        break;
+      case 'r':
+        runs = atoi(optarg);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || runs < 1 ||
+      (strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 &&
+       strcmp(format, "json") != 0)) {
+    usage(argv[0]);
+  }
+  if (output != NULL) {
+    out = fopen(output, "w");
+    if (out == NULL) {
+      perror(output);
+      return EXIT_FAILURE;
+    }
+  }
+  for (size_t i = 0; i < PAYLOAD_LEN; i++) {
+    payload[i] = (uint8_t)(i * 131 + 7);
+  }
+
+  if (strcmp(format, "csv") == 0) {
+    fprintf(out, "name,iters,runs,ns_per_op,cycles_per_op,allocs_per_op\n");
+  } else if (strcmp(format, "json") == 0) {
+    fprintf(out, "[");
+  } else {
+    fprintf(out, "%-24s %10s %10s %10s  %s\n", "primitive", "ns/op",
+            "cycles/op", "allocs/op", "op");
+  }
+  for (size_t i = 0; i < NUM_BENCHES; i++) {
+    const bench_t *b = &benches[i];
+    result_t r = measure(b, runs);
+    if (strcmp(format, "csv") == 0) {
+      fprintf(out, "%s,%llu,%d,%.2f,%.1f,%.3f\n", b->name,
+              (unsigned long long)b->iters, runs, r.ns, r.cycles, r.allocs);
+    } else if (strcmp(format, "json") == 0) {
+      fprintf(out,
+              "%s\n  {\"name\": \"%s\", \"iters\": %llu, \"runs\": %d, "
+              "\"ns_per_op\": %.2f, \"cycles_per_op\": %.1f, "
+              "\"allocs_per_op\": %.3f}",
+              i > 0 ? "," : "", b->name, (unsigned long long)b->iters, runs,
+              r.ns, r.cycles, r.allocs);
+    } else {
+      fprintf(out, "%-24s %10.2f %10.1f %10.3f  %s\n", b->name, r.ns,
+              r.cycles, r.allocs, b->op);
+    }
+  }
+  if (strcmp(format, "json") == 0) {
+    fprintf(out, "\n]\n");
+  }
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  return sink == 1;  // keep the work from being optimized away
+}
@@ -13,7 +13,6 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 
 #include "cmu_tcp.h"
 
@@ -74,8 +73,6 @@ int main() {
   printf("finished socket\n");
   functionality(&socket);
 
-  sleep(5);
-
   if (cmu_close(&socket) < 0) exit(EXIT_FAILURE);
   return EXIT_SUCCESS;
 }
@@ -15,8 +15,8 @@ PCAP_NAME=$2
 
 if [ -z "$FUNCTION_TO_RUN" ]
     then
-        echo "usage: ./capture_packets.sh < start | stop | analyze > PCAP_NAME"
-        echo "Expecting name of function to run: start, stop, or analyze."
+        echo "usage: ./capture_packets.sh < start|stop|analyze|metrics > PCAP_NAME"
+        echo "Expecting name of function to run: start, stop, analyze, metrics."
         exit 1
 fi
 
@@ -54,4 +54,10 @@ analyze() {
     -2
 }
 
+# Per-flow throughput, retransmissions, bytes in flight and RTT over time, as
+# CSV. Much faster than `analyze` on large captures; build it with `make`.
+metrics() {
+    $DIR/pcap_analyze $PCAP_NAME
+}
+
 $FUNCTION_TO_RUN
@@ -0,0 +1,719 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements a packet capture analyzer for CMU-TCP.
+ *
+ * It maps a pcap file, such as one `capture_packets.sh start` records, and
+ * reads it in one pass, keeping only a little state per flow, so it gets
+ * through gigabytes of capture in seconds. Every direction of a connection
+ * that sends data gets a CSV row per time interval, printed as soon as the
+ * interval is over:
+ *
+ *   time_us       start of the interval, since the first packet captured
+ *   flow          the sender and receiver, as addr:port>addr:port
+ *   packets       data packets sent
+ *   bytes         payload bytes sent, retransmissions included
+ *   new_bytes     payload bytes sent for the first time
+ *   throughput_bps, goodput_bps
+ *                 the two above, in bits per second
+ *   retransmits   data packets that resent data sent before
+ *   in_flight     the most bytes sent but not yet acknowledged
+ *   rtt_us        the mean RTT sample, empty without samples
+ *   rtt_samples   the number of RTT samples
+ *   adv_window    the window the receiver last advertised
+ *
+ * An RTT sample is the time from a data packet to the ACK that acknowledges
+ * exactly up to its end, unless it was retransmitted (Karn's rule), so it is
+ * the RTT the sender sees when the capture is taken on the sender's host.
+ * Path MTU probes and FEC repairs are not counted as data.
+ *
+ * The rows of one flow come in time order; those of different flows may
+ * interleave a little out of it.
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmu_options.h"
+#include "cmu_packet.h"
+#include "header_codec.h"
+
+#define DEFAULT_INTERVAL_US 100000
+#define OUT_BUF_SIZE (1 << 20)
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAPNG_MAGIC 0x0a0d0d0a
+#define PCAP_FILE_HEADER_LEN 24
+#define PCAP_RECORD_HEADER_LEN 16
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+#define IPPROTO_UDP_NUM 17
+#define UDP_HEADER_LEN 8
+
+/*
+ * A data packet not yet acknowledged.
+ */
+typedef struct {
+  uint32_t seq;
+  uint32_t end;
+  uint64_t sent_us;
+  int retx;  // some of it was sent again
+} segment_t;
+
+/*
+ * One direction of a connection: the data one end sends, and the ACKs the
+ * other end sends back for it.
+ */
+typedef struct {
+  char name[48];
+  int started;    // `high` is set
+  uint32_t high;  // the end of the newest data sent
+  int acked;      // `una` is set
+  uint32_t una;   // the peer's highest cumulative ACK
+  uint16_t adv_window;
+  segment_t *segs;  // in sequence order, from `seg_head` in a ring
+  uint32_t seg_head;
+  uint32_t seg_count;
+  uint32_t seg_cap;
+
+  // The interval being accumulated.
+  int bin_open;
+  uint64_t bin;
+  uint64_t bin_packets;
+  uint64_t bin_bytes;
+  uint64_t bin_new_bytes;
+  uint64_t bin_retx;
+  uint32_t bin_in_flight;
+  uint64_t bin_rtt_sum;
+  uint64_t bin_rtt_n;
+
+  // Totals over the capture.
+  uint64_t packets;
+  uint64_t bytes;
+  uint64_t new_bytes;
+  uint64_t retx;
+  uint64_t rtt_sum;
+  uint64_t rtt_n;
+  uint64_t rtt_min;
+  uint64_t first_us;
+  uint64_t last_us;
+} direction_t;
+
+/*
+ * A connection, between the lower endpoint 0 and the higher endpoint 1.
+ * `dir[i]` holds the data endpoint i sends.
+ */
+typedef struct {
+  int used;
+  uint32_t addr[2];
+  uint16_t port[2];
+  direction_t dir[2];
+} flow_t;
+
+typedef struct {
+  FILE *out;
+  FILE *rtt_out;
+  uint64_t interval_us;
+  uint64_t start_us;
+  flow_t *flows;
+  uint32_t flow_cap;  // a power of two
+  uint32_t flow_count;
+  flow_t *last;  // the flow of the previous packet
+  uint64_t records;
+  uint64_t cmu_packets;
+} analyzer_t;
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-i interval_us] [-o output] [-r rtt_output] "
+          "capture.pcap\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+static uint32_t rd32(const uint8_t *p, int swap) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t rd16be(const uint8_t *p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t rd32be(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         p[3];
+}
+
+static uint32_t flow_hash(uint32_t a0, uint16_t p0, uint32_t a1, uint16_t p1) {
+  uint64_t h = ((uint64_t)a0 << 32 | a1) * 0x9E3779B97F4A7C15ULL;
+  h ^= ((uint64_t)p0 << 16 | p1) * 0xBF58476D1CE4E5B9ULL;
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+static void name_direction(direction_t *d, uint32_t from, uint16_t from_port,
+                           uint32_t to, uint16_t to_port) {
+  char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+  uint32_t from_n = htonl(from), to_n = htonl(to);
+
+  inet_ntop(AF_INET, &from_n, src, sizeof(src));
+  inet_ntop(AF_INET, &to_n, dst, sizeof(dst));
+  snprintf(d->name, sizeof(d->name), "%s:%u>%s:%u", src, from_port, dst,
+           to_port);
+}
+
+static void grow_flows(analyzer_t *a);
+
+/*
+ * Finds the flow between two endpoints, adding it if it is new.
+ */
+static flow_t *find_flow(analyzer_t *a, uint32_t a0, uint16_t p0, uint32_t a1,
+                         uint16_t p1) {
+  uint32_t i;
+  flow_t *f;
+
+  if (a->flow_count * 2 >= a->flow_cap) {
+    grow_flows(a);
+  }
+  i = flow_hash(a0, p0, a1, p1) & (a->flow_cap - 1);
+  while (a->flows[i].used) {
+    f = &a->flows[i];
+    if (f->addr[0] == a0 && f->port[0] == p0 && f->addr[1] == a1 &&
+        f->port[1] == p1) {
+      return f;
+    }
+    i = (i + 1) & (a->flow_cap - 1);
+  }
+  f = &a->flows[i];
+  f->used = 1;
+  f->addr[0] = a0;
+  f->port[0] = p0;
+  f->addr[1] = a1;
+  f->port[1] = p1;
+  name_direction(&f->dir[0], a0, p0, a1, p1);
+  name_direction(&f->dir[1], a1, p1, a0, p0);
+  a->flow_count++;
+  return f;
+}
+
+static void grow_flows(analyzer_t *a) {
+  flow_t *old = a->flows;
+  uint32_t old_cap = a->flow_cap;
+
+  a->flow_cap = old_cap == 0 ? 64 : old_cap * 2;
+  a->flows = calloc(a->flow_cap, sizeof(flow_t));
+  if (a->flows == NULL) {
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  a->flow_count = 0;
+  a->last = NULL;
+  for (uint32_t i = 0; i < old_cap; i++) {
+    if (old[i].used) {
+      flow_t *f = find_flow(a, old[i].addr[0], old[i].port[0], old[i].addr[1],
+                            old[i].port[1]);
+      *f = old[i];
+    }
+  }
+  free(old);
+}
+
+static uint32_t in_flight(const direction_t *d) {
+  return d->started && d->acked && after(d->high, d->una) ? d->high - d->una
+                                                          : 0;
+}
+
+static void flush_bin(analyzer_t *a, direction_t *d) {
+  double secs = (double)a->interval_us / 1e6;
+
+  if (!d->bin_open) {
+    return;
+  }
+  d->bin_open = 0;
+  if (d->bin_packets == 0 && d->bin_in_flight == 0 && d->bin_rtt_n == 0) {
+    return;  // only ACKs for the peer's data went this way
+  }
+  fprintf(a->out, "%llu,%s,%llu,%llu,%llu,%.0f,%.0f,%llu,%u,",
+          (unsigned long long)(d->bin * a->interval_us), d->name,
+          (unsigned long long)d->bin_packets,
+          (unsigned long long)d->bin_bytes,
+          (unsigned long long)d->bin_new_bytes, d->bin_bytes * 8 / secs,
+          d->bin_new_bytes * 8 / secs, (unsigned long long)d->bin_retx,
+          d->bin_in_flight);
+  if (d->bin_rtt_n > 0) {
+    fprintf(a->out, "%llu",
+            (unsigned long long)(d->bin_rtt_sum / d->bin_rtt_n));
+  }
+  fprintf(a->out, ",%llu,%u\n", (unsigned long long)d->bin_rtt_n,
+          d->adv_window);
+}
+
+/*
+ * Moves a direction to the interval `t` falls in, printing the one before.
+ */
+static void enter_bin(analyzer_t *a, direction_t *d, uint64_t t) {
+  uint64_t bin = (t - a->start_us) / a->interval_us;
+
+  if (d->bin_open && d->bin == bin) {
+    return;
+  }
+  flush_bin(a, d);
+  d->bin_open = 1;
+  d->bin = bin;
+  d->bin_packets = 0;
+  d->bin_bytes = 0;
+  d->bin_new_bytes = 0;
+  d->bin_retx = 0;
+  d->bin_in_flight = in_flight(d);
+  d->bin_rtt_sum = 0;
+  d->bin_rtt_n = 0;
+}
+
+static void note_in_flight(direction_t *d) {
+  uint32_t n = in_flight(d);
+  if (n > d->bin_in_flight) {
+    d->bin_in_flight = n;
+  }
+}
+
+static void push_segment(direction_t *d, uint32_t seq, uint32_t end,
+                         uint64_t t) {
+  segment_t *s;
+
+  if (d->seg_count == d->seg_cap) {
+    uint32_t cap = d->seg_cap == 0 ? 64 : d->seg_cap * 2;
+    segment_t *segs = malloc(cap * sizeof(segment_t));
+    if (segs == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < d->seg_count; i++) {
+      segs[i] = d->segs[(d->seg_head + i) & (d->seg_cap - 1)];
+    }
+    free(d->segs);
+    d->segs = segs;
+    d->seg_cap = cap;
+    d->seg_head = 0;
+  }
+  s = &d->segs[(d->seg_head + d->seg_count) & (d->seg_cap - 1)];
+  s->seq = seq;
+  s->end = end;
+  s->sent_us = t;
+  s->retx = 0;
+  d->seg_count++;
+}
+
+static void on_data(analyzer_t *a, direction_t *d, const cmu_hdr_t *h,
+                    uint64_t t) {
+  uint32_t len = h->payload_len;
+  uint32_t end;
+
+  if (h->flags & SYN_FLAG_MASK) {
+    // The SYN takes one sequence number, any data the next ones.
+    d->started = 1;
+    d->high = h->seq + 1 + len;
+    d->seg_count = 0;
+    d->acked = 0;
+    return;
+  }
+  end = h->seq + len + ((h->flags & FIN_FLAG_MASK) ? 1 : 0);
+  if (end == h->seq) {
+    return;
+  }
+  if (!d->started) {
+    // The capture began after the handshake.
+    d->started = 1;
+    d->high = h->seq;
+  }
+  enter_bin(a, d, t);
+  if (d->packets == 0) {
+    d->first_us = t;
+  }
+  d->last_us = t;
+  d->packets++;
+  d->bytes += len;
+  d->bin_packets++;
+  d->bin_bytes += len;
+  if (before(h->seq, d->high)) {
+    d->retx++;
+    d->bin_retx++;
+    for (uint32_t i = 0; i < d->seg_count; i++) {
+      segment_t *s = &d->segs[(d->seg_head + i) & (d->seg_cap - 1)];
+      if (before(s->seq, end) && after(s->end, h->seq)) {
+        s->retx = 1;
+      }
+    }
+    if (after(end, d->high)) {
+      d->new_bytes += end - d->high;
+      d->bin_new_bytes += end - d->high;
+      d->high = end;
+    }
+  } else {
+    d->new_bytes += len;
+    d->bin_new_bytes += len;
+    push_segment(d, h->seq, end, t);
+    d->high = end;
+  }
+  note_in_flight(d);
+}
+
+static void on_ack(analyzer_t *a, direction_t *d, const cmu_hdr_t *h,
+                   uint64_t t) {
+  if (!d->started) {
+    return;
+  }
+  enter_bin(a, d, t);
+  d->adv_window = h->adv_window;
+  if (d->acked && !after(h->ack, d->una)) {
+    return;
+  }
+  d->acked = 1;
+  d->una = h->ack;
+  while (d->seg_count > 0) {
+    segment_t *s = &d->segs[d->seg_head];
+    if (after(s->end, h->ack)) {
+      break;
+    }
+    if (s->end == h->ack && !s->retx) {
+      uint64_t rtt = t - s->sent_us;
+      d->bin_rtt_sum += rtt;
+      d->bin_rtt_n++;
+      d->rtt_sum += rtt;
+      if (d->rtt_n == 0 || rtt < d->rtt_min) {
+        d->rtt_min = rtt;
+      }
+      d->rtt_n++;
+      if (a->rtt_out != NULL) {
+        fprintf(a->rtt_out, "%llu,%s,%u,%llu\n",
+                (unsigned long long)(t - a->start_us), d->name, s->seq,
+                (unsigned long long)rtt);
+      }
+    }
+    d->seg_head = (d->seg_head + 1) & (d->seg_cap - 1);
+    d->seg_count--;
+  }
+}
+
+/*
+ * Processes one CMU-TCP packet, sent from endpoint `from` of a flow.
+ */
+static void on_packet(analyzer_t *a, flow_t *f, int from, const cmu_hdr_t *h,
+                      uint64_t t) {
+  uint8_t len;
+
+  // Path MTU probes and FEC repairs carry no new data of their own.
+  if (h->payload_len > 0 &&
+      (opt_find(h->ext, h->ext_len, OPT_PMTU, &len) != NULL ||
+       opt_find(h->ext, h->ext_len, OPT_FEC_REPAIR, &len) != NULL)) {
+    return;
+  }
+  on_data(a, &f->dir[from], h, t);
+  if (h->flags & ACK_FLAG_MASK) {
+    on_ack(a, &f->dir[!from], h, t);
+  }
+}
+
+/*
+ * Finds the IPv4 header in a captured frame.
+ *
+ * @return The header, or NULL if the frame does not carry IPv4.
+ */
+static const uint8_t *ipv4_header(const uint8_t *frame, uint32_t caplen,
+                                  uint32_t linktype, uint32_t *len) {
+  uint32_t off;
+  uint16_t type;
+
+  switch (linktype) {
+    case LINKTYPE_ETHERNET:
+      off = 12;
+      if (caplen < off + 2) {
+        return NULL;
+      }
+      type = rd16be(frame + off);
+      while ((type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ) &&
+             caplen >= off + 6) {
+        off += 4;
+        type = rd16be(frame + off);
+      }
+      off += 2;
+      break;
+    case LINKTYPE_LINUX_SLL:
+      if (caplen < 16) {
+        return NULL;
+      }
+      type = rd16be(frame + 14);
+      off = 16;
+      break;
+    case LINKTYPE_LINUX_SLL2:
+      if (caplen < 20) {
+        return NULL;
+      }
+      type = rd16be(frame);
+      off = 20;
+      break;
+    case LINKTYPE_NULL:
+      // The address family, in the byte order of the capturing host.
+      if (caplen < 4 ||
+          (rd32(frame, 0) != AF_INET && rd32(frame, 1) != AF_INET)) {
+        return NULL;
+      }
+      type = ETHERTYPE_IPV4;
+      off = 4;
+      break;
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+      type = ETHERTYPE_IPV4;
+      off = 0;
+      break;
+    default:
+      return NULL;
+  }
+  if (type != ETHERTYPE_IPV4 || caplen <= off) {
+    return NULL;
+  }
+  *len = caplen - off;
+  return frame + off;
+}
+
+static void analyze_frame(analyzer_t *a, const uint8_t *frame,
+                          uint32_t caplen, uint32_t linktype, uint64_t t) {
+  uint8_t buf[sizeof(cmu_tcp_header_t)];
+  const uint8_t *ip, *udp, *pkt;
+  uint32_t iplen, ihl, udplen, src, dst;
+  uint16_t sport, dport;
+  cmu_hdr_t h;
+  flow_t *f;
+  int from;
+
+  ip = ipv4_header(frame, caplen, linktype, &iplen);
+  if (ip == NULL || iplen < 20 || (ip[0] >> 4) != 4) {
+    return;
+  }
+  ihl = (ip[0] & 0x0f) * 4;
+  // Only whole UDP datagrams; a fragment has no CMU-TCP header to read.
+  if (ip[9] != IPPROTO_UDP_NUM || (rd16be(ip + 6) & 0x3fff) != 0 ||
+      iplen < ihl + UDP_HEADER_LEN) {
+    return;
+  }
+  udp = ip + ihl;
+  udplen = rd16be(udp + 4);
+  pkt = udp + UDP_HEADER_LEN;
+  if (udplen < UDP_HEADER_LEN + sizeof(cmu_tcp_header_t) ||
+      iplen - ihl < UDP_HEADER_LEN + sizeof(cmu_tcp_header_t) ||
+      rd32be(pkt) != IDENTIFIER) {
+    return;
+  }
+
+  // The codec takes a mutable buffer, and the mapping is read-only.
+  memcpy(buf, pkt, sizeof(buf));
+  hdr_decode(buf, &h);
+  if (h.hlen != sizeof(cmu_tcp_header_t) + h.ext_len || h.plen < h.hlen ||
+      h.plen > udplen - UDP_HEADER_LEN) {
+    return;
+  }
+  // Options past the snap length can't be read.
+  h.ext = (uint8_t *)pkt + sizeof(cmu_tcp_header_t);
+  if (iplen - ihl - UDP_HEADER_LEN < h.hlen) {
+    h.ext_len = 0;
+  }
+  a->cmu_packets++;
+
+  src = rd32be(ip + 12);
+  dst = rd32be(ip + 16);
+  sport = rd16be(udp);
+  dport = rd16be(udp + 2);
+  from = src > dst || (src == dst && sport > dport);
+  if (a->last != NULL && a->last->addr[from] == src &&
+      a->last->port[from] == sport && a->last->addr[!from] == dst && a->last->port[!from] == dport) {
+    f = a->last;
+  } else if (from == 0) {
+    f = find_flow(a, src, sport, dst, dport);
+  } else {
+    f = find_flow(a, dst, dport, src, sport);
+  }
+  a->last = f;
+  on_packet(a, f, from, &h, t);
+}
+
+static void print_summary(analyzer_t *a) {
+  fprintf(stderr, "%llu records, %llu CMU-TCP packets, %u flows\n",
+          (unsigned long long)a->records, (unsigned long long)a->cmu_packets,
+          a->flow_count);
+  for (uint32_t i = 0; i < a->flow_cap; i++) {
+    for (int j = 0; a->flows[i].used && j < 2; j++) {
+      direction_t *d = &a->flows[i].dir[j];
+      double secs = (double)(d->last_us - d->first_us) / 1e6;
+      if (d->packets == 0) {
+        continue;
+      }
+      fprintf(stderr,
+              "%s: %llu packets, %llu bytes, %llu retransmits, "
+              "%.0f bps goodput",
+              d->name, (unsigned long long)d->packets,
+              (unsigned long long)d->bytes, (unsigned long long)d->retx,
+              secs > 0 ? d->new_bytes * 8 / secs : 0);
+      if (d->rtt_n > 0) {
+        fprintf(stderr, ", rtt min %llu us mean %llu us",
+                (unsigned long long)d->rtt_min,
+                (unsigned long long)(d->rtt_sum / d->rtt_n));
+      }
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *output = NULL, *rtt_output = NULL;
+  analyzer_t a;
+  const uint8_t *map, *p, *end;
+  struct stat st;
+  uint32_t magic, linktype;
+  int fd, opt, swap, nsec;
+
+  memset(&a, 0, sizeof(a));
+  a.interval_us = DEFAULT_INTERVAL_US;
+  a.out = stdout;
+  while ((opt = getopt(argc, argv, "i:o:r:")) != -1) {
+    switch (opt) {
+      case 'i':
+        a.interval_us = strtoull(optarg, NULL, 10);
+        if (a.interval_us == 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'r':
+        rtt_output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+  }
+
+  fd = open(argv[optind], O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if (st.st_size < PCAP_FILE_HEADER_LEN) {
+    fprintf(stderr, "%s: not a pcap file\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+  magic = rd32(map, 0);
+  swap = magic == __builtin_bswap32(PCAP_MAGIC_USEC) ||
+         magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+  nsec = rd32(map, swap) == PCAP_MAGIC_NSEC;
+  if (rd32(map, swap) != PCAP_MAGIC_USEC && !nsec) {
+    fprintf(stderr, "%s: not a pcap file%s\n", argv[optind],
+            magic == PCAPNG_MAGIC ? " (pcapng isn't supported, convert it "
+                                    "with `editcap -F pcap`)"
+                                  : "");
+    return EXIT_FAILURE;
+  }
+  linktype = rd32(map + 20, swap) & 0x0fffffff;
+
+  if (output != NULL) {
+    a.out = fopen(output, "w");
+    if (a.out == NULL) {
+      perror(output);
+      return EXIT_FAILURE;
+    }
+  }
+  setvbuf(a.out, NULL, _IOFBF, OUT_BUF_SIZE);
+  if (rtt_output != NULL) {
+    a.rtt_out = fopen(rtt_output, "w");
+    if (a.rtt_out == NULL) {
+      perror(rtt_output);
+      return EXIT_FAILURE;
+    }
+    setvbuf(a.rtt_out, NULL, _IOFBF, OUT_BUF_SIZE);
+    fprintf(a.rtt_out, "time_us,flow,seq,rtt_us\n");
+  }
+  fprintf(a.out,
+          "time_us,flow,packets,bytes,new_bytes,throughput_bps,goodput_bps,"
+          "retransmits,in_flight,rtt_us,rtt_samples,adv_window\n");
+
+  p = map + PCAP_FILE_HEADER_LEN;
+  end = map + st.st_size;
+  while (end - p >= PCAP_RECORD_HEADER_LEN) {
+    uint64_t sec = rd32(p, swap);
+    uint64_t frac = rd32(p + 4, swap);
+    uint32_t caplen = rd32(p + 8, swap);
+    uint64_t t = sec * 1000000 + (nsec ? frac / 1000 : frac);
+
+    p += PCAP_RECORD_HEADER_LEN;
+    if (caplen > (uint64_t)(end - p)) {
+      fprintf(stderr, "%s: truncated after %llu records\n", argv[optind],
+              (unsigned long long)a.records);
+      break;
+    }
+    if (a.records == 0) {
+      a.start_us = t;
+    }
+    // A clock step back would put packets before the start.
+    if (t < a.start_us) {
+      t = a.start_us;
+    }
+    analyze_frame(&a, p, caplen, linktype, t);
+    a.records++;
+    p += caplen;
+  }
+
+  for (uint32_t i = 0; i < a.flow_cap; i++) {
+    if (a.flows[i].used) {
+      flush_bin(&a, &a.flows[i].dir[0]);
+      flush_bin(&a, &a.flows[i].dir[1]);
+    }
+  }
+  print_summary(&a);
+
+  if (a.out != stdout) {
+    fclose(a.out);
+  } else {
+    fflush(a.out);
+  }
+  if (a.rtt_out != NULL) {
+    fclose(a.rtt_out);
+  }
+  munmap((void *)map, st.st_size);
+  return EXIT_SUCCESS;
+}
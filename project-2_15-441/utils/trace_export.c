@@ -0,0 +1,115 @@
+/**
+ * Copyright (C) 2022 Carnegie Mellon University
+ *
+ * This file is part of the TCP in the Wild course project developed for the
+ * Computer Networks course (15-441/641) taught at Carnegie Mellon University.
+ *
+ * No part of the project may be copied and/or distributed without the express
+ * permission of the 15-441/641 course staff.
+ *
+ *
+ * This file implements a converter from CMU-TCP trace files to CSV or JSON.
+ *
+ * Times are printed in microseconds since the trace was opened. The output
+ * can be plotted directly, e.g. with `gen_graph.py <file>.csv`.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmu_tcp.h"
+#include "trace.h"
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-f csv|json] [-o output] trace_file\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  const char *format = "csv";
+  const char *output = NULL;
+  cmu_trace_header_t header;
+  cmu_trace_event_t e;
+  FILE *in, *out = stdout;
+  int json, opt;
+  unsigned long n = 0;
+
+  while ((opt = getopt(argc, argv, "f:o:")) != -1) {
+    switch (opt) {
+      case 'f':
+        format = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+  }
+  json = strcmp(format, "json") == 0;
+  if (!json && strcmp(format, "csv") != 0) {
+    usage(argv[0]);
+  }
+
+  in = fopen(argv[optind], "rb");
+  if (in == NULL) {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "%s: not a CMU-TCP trace\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+  if (header.version != TRACE_VERSION ||
+      header.event_size != sizeof(cmu_trace_event_t)) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", argv[optind],
+            header.version);
+    return EXIT_FAILURE;
+  }
+  if (output != NULL) {
+    out = fopen(output, "w");
+    if (out == NULL) {
+      perror(output);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (json) {
+    fprintf(out,
+            "{\"local_port\": %u, \"peer_port\": %u, \"role\": \"%s\", "
+            "\"events\": [",
+            header.local_port, header.peer_port,
+            header.role == TCP_INITIATOR ? "initiator" : "listener");
+  } else {
+    fprintf(out, "time_us,event,seq,len,cwnd,in_flight,value\n");
+  }
+  while (fread(&e, sizeof(e), 1, in) == 1) {
+    unsigned long long t = e.time_us - header.start_us;
+    if (json) {
+      fprintf(out,
+              "%s\n  {\"time_us\": %llu, \"event\": \"%s\", \"seq\": %u, "
+              "\"len\": %u, \"cwnd\": %u, \"in_flight\": %u, \"value\": %u}",
+              n > 0 ? "," : "", t, trace_event_name(e.type), e.seq, e.len,
+              e.cwnd, e.in_flight, e.value);
+    } else {
+      fprintf(out, "%llu,%s,%u,%u,%u,%u,%u\n", t, trace_event_name(e.type),
+              e.seq, e.len, e.cwnd, e.in_flight, e.value);
+    }
+    n++;
+  }
+  if (json) {
+    fprintf(out, "\n]}\n");
+  }
+
+  fclose(in);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return EXIT_SUCCESS;
+}